@@ -0,0 +1,1134 @@
+/*
+ * mock_router.c
+ * * Purpose:
+ * Local stand-in for an OpenWrt router's SSH endpoint, so router_cli.cpp and
+ * router_monitor.c can be exercised (and timed) through their real libssh2
+ * code paths without hardware.
+ *
+ * The SSH side is built on libssh's server API: password auth, any number of
+ * session channels per connection, `exec` requests with stdin, stdout,
+ * stderr and exit status. Commands run under a real /bin/sh, so the CLI's
+ * batched apply scripts behave as they would on the router, but `uci`, `ip`,
+ * `ifconfig`, `wifi` and `/etc/init.d/<service>` resolve to this same binary
+ * acting as an emulated command (multi-call, like busybox). The emulated
+ * commands keep the router's state in plain text files under the state
+ * directory and sleep for the configured latency +/- jitter on every call.
+ *
+ * Build: gcc bench/mock_router.c -o bench/mock_router -lssh
+ * Usage: ./bench/mock_router [-p PORT] [-u USER] [-P PASSWORD] [-d STATE_DIR]
+ *                            [-l LATENCY_MS] [-j JITTER_MS] [-k HOSTKEY]
+ */
+
+#define _GNU_SOURCE   // pipe2()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/file.h>   // flock()
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <libssh/libssh.h>
+#include <libssh/server.h>
+#include <libssh/callbacks.h>
+
+#define DEFAULT_PORT 2222
+#define DEFAULT_USER "root"
+#define DEFAULT_PASSWORD "root"
+#define DEFAULT_STATE_DIR "bench/mock_state"
+#define MAX_AUTH_ATTEMPTS 3
+#define IO_CHUNK 16384
+
+/*
+ * Emulated Router State
+ * * Line-oriented files under the state directory:
+ *   uci     committed options, one `key=value` per line (`pkg.section=type` for sections)
+ *   staged  uncommitted `uci set`s, merged into uci by `uci commit`
+ *   routes  `ip route show` lines
+ *   ifaces  `name admin_up address prefix mtu mac` (address `-` when unset)
+ * Every emulated command takes an exclusive flock on `lock`, so concurrent
+ * channels see consistent state.
+ */
+typedef struct {
+    char** lines;
+    size_t count, cap;
+} LineList;
+
+static const char* state_dir;
+
+static void lines_add(LineList* l, const char* text) {
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->lines = realloc(l->lines, l->cap * sizeof(char*));
+        if (!l->lines) exit(1);
+    }
+    l->lines[l->count++] = strdup(text);
+}
+
+static void lines_remove(LineList* l, size_t i) {
+    free(l->lines[i]);
+    memmove(&l->lines[i], &l->lines[i + 1], (l->count - i - 1) * sizeof(char*));
+    l->count--;
+}
+
+static void state_path(const char* name, char* path, size_t size) {
+    snprintf(path, size, "%s/%s", state_dir, name);
+}
+
+static void lines_load(const char* name, LineList* l) {
+    char path[4096];
+    state_path(name, path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    char* line = NULL;
+    size_t n = 0;
+    ssize_t len;
+    while ((len = getline(&line, &n, f)) > 0) {
+        if (line[len - 1] == '\n') line[len - 1] = '\0';
+        if (line[0]) lines_add(l, line);
+    }
+    free(line);
+    fclose(f);
+}
+
+// Writes the list to a temp file and renames it over the old one
+static void lines_save(const char* name, const LineList* l) {
+    char path[4096], tmp[4200];
+    state_path(name, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) return;
+    for (size_t i = 0; i < l->count; i++) fprintf(f, "%s\n", l->lines[i]);
+    fclose(f);
+    rename(tmp, path);
+}
+
+static void lines_free(LineList* l) {
+    for (size_t i = 0; i < l->count; i++) free(l->lines[i]);
+    free(l->lines);
+    l->lines = NULL;
+    l->count = l->cap = 0;
+}
+
+// Index of the first line starting with `prefix` followed by `sep`, or -1
+static long lines_find(const LineList* l, const char* prefix, char sep) {
+    size_t len = strlen(prefix);
+    for (size_t i = 0; i < l->count; i++) {
+        if (strncmp(l->lines[i], prefix, len) == 0 && l->lines[i][len] == sep) return (long)i;
+    }
+    return -1;
+}
+
+// Creates the default state of a freshly flashed router, unless one exists
+static void seed_state(void) {
+    char path[4096];
+    state_path("uci", path, sizeof(path));
+    if (access(path, F_OK) == 0) return;
+
+    static const char* uci[] = {
+        "system.@system[0]=system",
+        "system.@system[0].hostname=OpenWrt",
+        "system.@system[0].timezone=UTC",
+        "network.loopback=interface",
+        "network.loopback.device=lo",
+        "network.loopback.proto=static",
+        "network.loopback.ipaddr=127.0.0.1",
+        "network.lan=interface",
+        "network.lan.device=br-lan",
+        "network.lan.proto=static",
+        "network.lan.ipaddr=192.168.1.1",
+        "network.lan.netmask=255.255.255.0",
+        "network.wan=interface",
+        "network.wan.device=eth1",
+        "network.wan.proto=dhcp",
+        "wireless.radio0=wifi-device",
+        "wireless.radio0.band=5g",
+        "wireless.radio0.channel=36",
+        "wireless.default_radio0=wifi-iface",
+        "wireless.default_radio0.device=radio0",
+        "wireless.default_radio0.mode=ap",
+        "wireless.default_radio0.ssid=OpenWrt",
+    };
+    static const char* routes[] = {
+        "default via 10.0.0.1 dev eth1 proto static",
+        "10.0.0.0/24 dev eth1 proto kernel scope link src 10.0.0.2",
+        "192.168.1.0/24 dev br-lan proto kernel scope link src 192.168.1.1",
+    };
+    static const char* ifaces[] = {
+        "lo 1 127.0.0.1 8 65536 00:00:00:00:00:00",
+        "eth0 1 - 0 1500 02:00:00:00:00:01",
+        "eth1 1 10.0.0.2 24 1500 02:00:00:00:00:02",
+        "br-lan 1 192.168.1.1 24 1500 02:00:00:00:00:01",
+        "wlan0 1 - 0 1500 02:00:00:00:00:03",
+    };
+
+    LineList l = {0};
+    for (size_t i = 0; i < sizeof(uci) / sizeof(uci[0]); i++) lines_add(&l, uci[i]);
+    lines_save("uci", &l);
+    lines_free(&l);
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) lines_add(&l, routes[i]);
+    lines_save("routes", &l);
+    lines_free(&l);
+    for (size_t i = 0; i < sizeof(ifaces) / sizeof(ifaces[0]); i++) lines_add(&l, ifaces[i]);
+    lines_save("ifaces", &l);
+    lines_free(&l);
+}
+
+/*
+ * Emulated Commands
+ * * Each returns the exit status the real command would. Output formats match
+ * OpenWrt (busybox ifconfig, iproute2 ip, uci) closely enough for the CLI and
+ * the monitor's parsers.
+ */
+
+// `uci show` and `uci get` see staged values on top of committed ones
+static void uci_merged(LineList* merged) {
+    LineList staged = {0};
+    lines_load("uci", merged);
+    lines_load("staged", &staged);
+    for (size_t i = 0; i < staged.count; i++) {
+        char* eq = strchr(staged.lines[i], '=');
+        if (!eq) continue;
+        *eq = '\0';
+        long at = lines_find(merged, staged.lines[i], '=');
+        *eq = '=';
+        if (at >= 0) {
+            free(merged->lines[at]);
+            merged->lines[at] = strdup(staged.lines[i]);
+        } else {
+            lines_add(merged, staged.lines[i]);
+        }
+    }
+    lines_free(&staged);
+}
+
+static int cmd_uci(int argc, char** argv) {
+    if (argc >= 3 && strcmp(argv[1], "set") == 0) {
+        char* eq = strchr(argv[2], '=');
+        if (!eq || eq == argv[2] || !strchr(argv[2], '.')) {
+            fprintf(stderr, "uci: Invalid argument\n");
+            return 1;
+        }
+        LineList staged = {0};
+        lines_load("staged", &staged);
+        *eq = '\0';
+        long at = lines_find(&staged, argv[2], '=');
+        *eq = '=';
+        if (at >= 0) lines_remove(&staged, at);
+        lines_add(&staged, argv[2]);
+        lines_save("staged", &staged);
+        lines_free(&staged);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "commit") == 0) {
+        const char* pkg = argc >= 3 ? argv[2] : NULL;
+        size_t pkg_len = pkg ? strlen(pkg) : 0;
+        LineList committed = {0}, staged = {0}, rest = {0};
+        lines_load("uci", &committed);
+        lines_load("staged", &staged);
+        for (size_t i = 0; i < staged.count; i++) {
+            char* line = staged.lines[i];
+            if (pkg && (strncmp(line, pkg, pkg_len) != 0 || line[pkg_len] != '.')) {
+                lines_add(&rest, line);
+                continue;
+            }
+            char* eq = strchr(line, '=');
+            *eq = '\0';
+            long at = lines_find(&committed, line, '=');
+            *eq = '=';
+            if (at >= 0) {
+                free(committed.lines[at]);
+                committed.lines[at] = strdup(line);
+            } else {
+                lines_add(&committed, line);
+            }
+        }
+        lines_save("uci", &committed);
+        lines_save("staged", &rest);
+        lines_free(&committed);
+        lines_free(&staged);
+        lines_free(&rest);
+        return 0;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "get") == 0) {
+        LineList merged = {0};
+        uci_merged(&merged);
+        long at = lines_find(&merged, argv[2], '=');
+        if (at >= 0) printf("%s\n", strchr(merged.lines[at], '=') + 1);
+        else fprintf(stderr, "uci: Entry not found\n");
+        lines_free(&merged);
+        return at >= 0 ? 0 : 1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "show") == 0) {
+        const char* filter = argc >= 3 ? argv[2] : "";
+        size_t filter_len = strlen(filter);
+        LineList merged = {0};
+        uci_merged(&merged);
+        int found = 0;
+        for (size_t i = 0; i < merged.count; i++) {
+            const char* line = merged.lines[i];
+            char next = line[filter_len];
+            if (filter_len && (strncmp(line, filter, filter_len) != 0 || (next != '.' && next != '='))) {
+                continue;
+            }
+            const char* eq = strchr(line, '=');
+            printf("%.*s='%s'\n", (int)(eq - line), line, eq + 1);
+            found = 1;
+        }
+        lines_free(&merged);
+        if (!found && filter_len) {
+            fprintf(stderr, "uci: Entry not found\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) {
+        // Committed state only, grouped by package and section like the real export
+        const char* filter = argc >= 3 ? argv[2] : NULL;
+        LineList committed = {0};
+        lines_load("uci", &committed);
+        char current_pkg[128] = "";
+        int first_section = 1;
+        for (size_t i = 0; i < committed.count; i++) {
+            char* line = committed.lines[i];
+            char* eq = strchr(line, '=');
+            char* dot = strchr(line, '.');
+            if (!eq || !dot || dot > eq) continue;
+            size_t pkg_len = dot - line;
+            if (filter && (strlen(filter) != pkg_len || strncmp(line, filter, pkg_len) != 0)) continue;
+
+            if (strlen(current_pkg) != pkg_len || strncmp(current_pkg, line, pkg_len) != 0) {
+                snprintf(current_pkg, sizeof(current_pkg), "%.*s", (int)pkg_len, line);
+                printf("%spackage %s\n\n", current_pkg[0] && !first_section ? "\n" : "", current_pkg);
+                first_section = 1;
+            }
+            char* opt = strchr(dot + 1, '.');
+            if (!opt || opt > eq) {
+                // Section header: anonymous sections (@type[n]) have no name
+                if (!first_section) printf("\n");
+                first_section = 0;
+                if (dot[1] == '@') printf("config %s\n", eq + 1);
+                else printf("config %s '%.*s'\n", eq + 1, (int)(eq - dot - 1), dot + 1);
+            } else {
+                printf("\toption %.*s '%s'\n", (int)(eq - opt - 1), opt + 1, eq + 1);
+            }
+        }
+        lines_free(&committed);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "revert") == 0) {
+        // Drops staged changes (of one package)
+        const char* pkg = argc >= 3 ? argv[2] : NULL;
+        size_t pkg_len = pkg ? strlen(pkg) : 0;
+        LineList staged = {0}, rest = {0};
+        lines_load("staged", &staged);
+        for (size_t i = 0; pkg && i < staged.count; i++) {
+            if (strncmp(staged.lines[i], pkg, pkg_len) != 0 || staged.lines[i][pkg_len] != '.') {
+                lines_add(&rest, staged.lines[i]);
+            }
+        }
+        lines_save("staged", &rest);
+        lines_free(&staged);
+        lines_free(&rest);
+        return 0;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "import") == 0) {
+        // Replaces the committed package with `uci export` text from stdin
+        const char* pkg = argv[2];
+        size_t pkg_len = strlen(pkg);
+        LineList committed = {0}, kept = {0};
+        lines_load("uci", &committed);
+        for (size_t i = 0; i < committed.count; i++) {
+            if (strncmp(committed.lines[i], pkg, pkg_len) != 0 || committed.lines[i][pkg_len] != '.') {
+                lines_add(&kept, committed.lines[i]);
+            }
+        }
+
+        char line[1024], type[128], section[256] = "", entry[1536];
+        char types[32][128];
+        int type_counts[32], type_total = 0;
+        while (fgets(line, sizeof(line), stdin)) {
+            char key[128], value[512], name[256];
+            if (sscanf(line, " config %127s '%255[^']'", type, name) == 2) {
+                snprintf(section, sizeof(section), "%s", name);
+            } else if (sscanf(line, " config %127s", type) == 1) {
+                // Anonymous section: @type[n], numbered per type
+                int t = 0;
+                while (t < type_total && strcmp(types[t], type) != 0) t++;
+                if (t == type_total && type_total < 32) {
+                    snprintf(types[type_total], sizeof(types[0]), "%s", type);
+                    type_counts[type_total++] = 0;
+                }
+                snprintf(section, sizeof(section), "@%s[%d]", type, t < 32 ? type_counts[t]++ : 0);
+            } else if (section[0] && sscanf(line, " option %127s '%511[^']'", key, value) == 2) {
+                snprintf(entry, sizeof(entry), "%s.%s.%s=%s", pkg, section, key, value);
+                lines_add(&kept, entry);
+                continue;
+            } else {
+                continue;
+            }
+            snprintf(entry, sizeof(entry), "%s.%s=%s", pkg, section, type);
+            lines_add(&kept, entry);
+        }
+        lines_save("uci", &kept);
+        lines_free(&committed);
+        lines_free(&kept);
+        return 0;
+    }
+
+    fprintf(stderr, "uci: Invalid argument\n");
+    return 1;
+}
+
+static int netmask_to_prefix(const char* mask) {
+    unsigned a, b, c, d;
+    if (sscanf(mask, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+        return -1;
+    }
+    unsigned long bits = ((unsigned long)a << 24) | (b << 16) | (c << 8) | d;
+    int prefix = 0;
+    while (prefix < 32 && (bits & (0x80000000UL >> prefix))) prefix++;
+    // Reject non-contiguous masks such as 255.0.255.0
+    if ((bits & (0xFFFFFFFFUL >> prefix)) != 0) return -1;
+    return prefix;
+}
+
+static long find_iface(const LineList* ifaces, const char* name) {
+    return lines_find(ifaces, name, ' ');
+}
+
+static void set_iface(LineList* ifaces, long at, int up, const char* addr, int prefix) {
+    char name[64], old_addr[64], mac[32];
+    int old_up, old_prefix, mtu;
+    sscanf(ifaces->lines[at], "%63s %d %63s %d %d %31s", name, &old_up, old_addr, &old_prefix, &mtu, mac);
+    if (up < 0) up = old_up;
+    if (!addr) {
+        addr = old_addr;
+        prefix = old_prefix;
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "%s %d %s %d %d %s", name, up, addr, prefix, mtu, mac);
+    free(ifaces->lines[at]);
+    ifaces->lines[at] = strdup(line);
+}
+
+static int cmd_ifconfig(int argc, char** argv) {
+    LineList ifaces = {0};
+    lines_load("ifaces", &ifaces);
+    int rc = 0;
+
+    if (argc < 3) {
+        // Listing: one short block per interface, enough for a human glance
+        for (size_t i = 0; i < ifaces.count; i++) {
+            char name[64], addr[64], mac[32];
+            int up, prefix, mtu;
+            sscanf(ifaces.lines[i], "%63s %d %63s %d %d %31s", name, &up, addr, &prefix, &mtu, mac);
+            if (argc == 2 && strcmp(argv[1], name) != 0) continue;
+            printf("%-10sLink encap:Ethernet  HWaddr %s\n", name, mac);
+            if (strcmp(addr, "-") != 0) {
+                unsigned long mask = prefix ? 0xFFFFFFFFUL << (32 - prefix) & 0xFFFFFFFFUL : 0;
+                printf("          inet addr:%s  Mask:%lu.%lu.%lu.%lu\n", addr, mask >> 24,
+                       (mask >> 16) & 255, (mask >> 8) & 255, mask & 255);
+            }
+            printf("          %sMTU:%d\n\n", up ? "UP RUNNING  " : "", mtu);
+        }
+    } else {
+        long at = find_iface(&ifaces, argv[1]);
+        if (at < 0) {
+            fprintf(stderr, "ifconfig: SIOCGIFFLAGS: No such device\n");
+            rc = 1;
+        } else if (strcmp(argv[2], "up") == 0 || strcmp(argv[2], "down") == 0) {
+            set_iface(&ifaces, at, strcmp(argv[2], "up") == 0, NULL, 0);
+        } else {
+            // ifconfig IFACE ADDR [netmask MASK] [up|down]
+            int prefix = 24, up = -1;
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "netmask") == 0 && i + 1 < argc) {
+                    prefix = netmask_to_prefix(argv[++i]);
+                } else if (strcmp(argv[i], "up") == 0) {
+                    up = 1;
+                } else if (strcmp(argv[i], "down") == 0) {
+                    up = 0;
+                }
+            }
+            unsigned a, b, c, d;
+            char tail;
+            if (sscanf(argv[2], "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 ||
+                a > 255 || b > 255 || c > 255 || d > 255) {
+                fprintf(stderr, "ifconfig: %s: Unknown host\n", argv[2]);
+                rc = 1;
+            } else if (prefix < 0) {
+                fprintf(stderr, "ifconfig: SIOCSIFNETMASK: Invalid argument\n");
+                rc = 1;
+            } else if (strcmp(argv[2], "0.0.0.0") == 0) {
+                set_iface(&ifaces, at, up, "-", 0);    // Clears the address
+            } else {
+                set_iface(&ifaces, at, up, argv[2], prefix);
+            }
+        }
+        if (rc == 0) lines_save("ifaces", &ifaces);
+    }
+
+    lines_free(&ifaces);
+    return rc;
+}
+
+// `ip -j address show`: the iproute2 JSON fields the CLI reads
+static void print_addresses_json(const LineList* ifaces, const char* only) {
+    int first = 1;
+    printf("[");
+    for (size_t i = 0; i < ifaces->count; i++) {
+        char name[64], addr[64], mac[32];
+        int up, prefix, mtu;
+        sscanf(ifaces->lines[i], "%63s %d %63s %d %d %31s", name, &up, addr, &prefix, &mtu, mac);
+        if (only && strcmp(only, name) != 0) continue;
+
+        int loopback = strcmp(name, "lo") == 0;
+        printf("%s{\"ifindex\":%zu,\"ifname\":\"%s\",\"flags\":[\"%s\"%s],\"mtu\":%d,"
+               "\"operstate\":\"%s\",\"link_type\":\"%s\",\"address\":\"%s\",\"addr_info\":[",
+               first ? "" : ",", i + 1, name, loopback ? "LOOPBACK" : "BROADCAST\",\"MULTICAST",
+               up ? ",\"UP\",\"LOWER_UP\"" : "", mtu, loopback ? "UNKNOWN" : (up ? "UP" : "DOWN"),
+               loopback ? "loopback" : "ether", mac);
+        if (strcmp(addr, "-") != 0) {
+            printf("{\"family\":\"inet\",\"local\":\"%s\",\"prefixlen\":%d,\"scope\":\"%s\",\"label\":\"%s\"}",
+                   addr, prefix, loopback ? "host" : "global", name);
+        }
+        printf("]}");
+        first = 0;
+    }
+    printf("]\n");
+}
+
+// `ip -j route show`: "DEST [via GW] [dev DEV] [proto P] [scope S] [src A]"
+static void print_routes_json(const LineList* routes) {
+    static const struct { const char* word; const char* key; } fields[] = {
+        { "via", "gateway" }, { "dev", "dev" }, { "proto", "protocol" },
+        { "scope", "scope" }, { "src", "prefsrc" },
+    };
+    printf("[");
+    for (size_t r = 0; r < routes->count; r++) {
+        char* line = strdup(routes->lines[r]);
+        char* save = NULL;
+        char* word = strtok_r(line, " ", &save);
+        printf("%s{\"dst\":\"%s\"", r ? "," : "", word ? word : "");
+        while ((word = strtok_r(NULL, " ", &save))) {
+            char* value = strtok_r(NULL, " ", &save);
+            if (!value) break;
+            for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+                if (strcmp(word, fields[f].word) == 0) printf(",\"%s\":\"%s\"", fields[f].key, value);
+            }
+        }
+        printf(",\"flags\":[]}");
+        free(line);
+    }
+    printf("]\n");
+}
+
+static void print_addresses(const LineList* ifaces, const char* only) {
+    for (size_t i = 0; i < ifaces->count; i++) {
+        char name[64], addr[64], mac[32];
+        int up, prefix, mtu;
+        sscanf(ifaces->lines[i], "%63s %d %63s %d %d %31s", name, &up, addr, &prefix, &mtu, mac);
+        if (only && strcmp(only, name) != 0) continue;
+
+        int loopback = strcmp(name, "lo") == 0;
+        printf("%zu: %s: <%s%s> mtu %d qdisc %s state %s qlen 1000\n", i + 1, name,
+               loopback ? "LOOPBACK" : "BROADCAST,MULTICAST", up ? ",UP,LOWER_UP" : "",
+               mtu, loopback ? "noqueue" : "mq", loopback ? "UNKNOWN" : (up ? "UP" : "DOWN"));
+        printf("    link/%s %s brd %s\n", loopback ? "loopback" : "ether", mac,
+               loopback ? "00:00:00:00:00:00" : "ff:ff:ff:ff:ff:ff");
+        if (strcmp(addr, "-") != 0) {
+            printf("    inet %s/%d scope %s %s\n", addr, prefix, loopback ? "host" : "global", name);
+            printf("       valid_lft forever preferred_lft forever\n");
+        }
+    }
+}
+
+static int cmd_ip(int argc, char** argv) {
+    // Options such as -4 / -o are skipped; -j switches show to JSON
+    int i = 1, json = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-json") == 0) json = 1;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: ip [ OPTIONS ] OBJECT { COMMAND | help }\n");
+        return 255;
+    }
+    const char* object = argv[i++];
+    const char* verb = i < argc ? argv[i++] : "show";
+
+    if (strncmp(object, "route", strlen(object)) == 0) {
+        LineList routes = {0};
+        lines_load("routes", &routes);
+        int rc = 0;
+        if (json && (strcmp(verb, "show") == 0 || strcmp(verb, "list") == 0)) {
+            print_routes_json(&routes);
+        } else if (strcmp(verb, "show") == 0 || strcmp(verb, "list") == 0) {
+            for (size_t r = 0; r < routes.count; r++) printf("%s\n", routes.lines[r]);
+        } else if (strcmp(verb, "add") == 0 || strcmp(verb, "del") == 0) {
+            if (i >= argc) {
+                fprintf(stderr, "Command line is not complete. Try option \"help\"\n");
+                rc = 1;
+            } else {
+                const char* dest = argv[i++];
+                long at = lines_find(&routes, dest, ' ');
+                if (strcmp(verb, "del") == 0) {
+                    if (at < 0) {
+                        fprintf(stderr, "RTNETLINK answers: No such process\n");
+                        rc = 2;
+                    } else {
+                        lines_remove(&routes, at);
+                    }
+                } else if (at >= 0) {
+                    fprintf(stderr, "RTNETLINK answers: File exists\n");
+                    rc = 2;
+                } else {
+                    char line[512];
+                    size_t len = snprintf(line, sizeof(line), "%s", dest);
+                    for (; i < argc && len < sizeof(line); i++) {
+                        len += snprintf(line + len, sizeof(line) - len, " %s", argv[i]);
+                    }
+                    if (!strstr(line, " dev ") && len < sizeof(line)) {
+                        snprintf(line + len, sizeof(line) - len, " dev eth1");
+                    }
+                    lines_add(&routes, line);
+                }
+                if (rc == 0) lines_save("routes", &routes);
+            }
+        } else {
+            fprintf(stderr, "Command \"%s\" is unknown, try \"ip route help\".\n", verb);
+            rc = 255;
+        }
+        lines_free(&routes);
+        return rc;
+    }
+
+    if (strncmp(object, "address", strlen(object)) == 0 || strncmp(object, "link", strlen(object)) == 0) {
+        LineList ifaces = {0};
+        lines_load("ifaces", &ifaces);
+        int rc = 0;
+        if (strcmp(verb, "show") == 0 || strcmp(verb, "list") == 0) {
+            const char* only = NULL;
+            if (i < argc && strcmp(argv[i], "dev") == 0) i++;
+            if (i < argc) only = argv[i];
+            if (only && find_iface(&ifaces, only) < 0) {
+                fprintf(stderr, "Device \"%s\" does not exist.\n", only);
+                rc = 1;
+            } else if (json) {
+                print_addresses_json(&ifaces, only);
+            } else {
+                print_addresses(&ifaces, only);
+            }
+        } else if (strcmp(verb, "set") == 0) {
+            // ip link set [dev] IFACE up|down
+            if (i < argc && strcmp(argv[i], "dev") == 0) i++;
+            long at = i < argc ? find_iface(&ifaces, argv[i]) : -1;
+            if (at < 0 || i + 1 >= argc) {
+                fprintf(stderr, "Cannot find device \"%s\"\n", i < argc ? argv[i] : "");
+                rc = 1;
+            } else {
+                set_iface(&ifaces, at, strcmp(argv[i + 1], "up") == 0, NULL, 0);
+                lines_save("ifaces", &ifaces);
+            }
+        } else {
+            fprintf(stderr, "Command \"%s\" is unknown, try \"ip %s help\".\n", verb, object);
+            rc = 255;
+        }
+        lines_free(&ifaces);
+        return rc;
+    }
+
+    fprintf(stderr, "Object \"%s\" is unknown, try \"ip help\".\n", object);
+    return 255;
+}
+
+// `wifi [reload|up|down] [radio]` and `/etc/init.d/<service> <action>`: only the latency
+static int cmd_service(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    return 0;
+}
+
+static void simulate_latency(void) {
+    const char* latency = getenv("MOCK_LATENCY_MS");
+    const char* jitter = getenv("MOCK_JITTER_MS");
+    long ms = latency ? atol(latency) : 0;
+    long spread = jitter ? atol(jitter) : 0;
+    if (spread > 0) {
+        srand((unsigned)(getpid() ^ time(NULL)));
+        ms += rand() % (2 * spread + 1) - spread;
+    }
+    if (ms <= 0) return;
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * run_applet
+ * * Multi-call entry point: returns the exit status if argv[0] names an
+ * emulated command, or -1 if this process is the server.
+ */
+static int run_applet(int argc, char** argv) {
+    char* self = strdup(argv[0]);
+    const char* name = basename(self);
+    int (*applet)(int, char**) = NULL;
+
+    if (strcmp(name, "uci") == 0) applet = cmd_uci;
+    else if (strcmp(name, "ip") == 0) applet = cmd_ip;
+    else if (strcmp(name, "ifconfig") == 0) applet = cmd_ifconfig;
+    else if (strcmp(name, "wifi") == 0 || strstr(argv[0], "/etc/init.d/")) applet = cmd_service;
+    free(self);
+    if (!applet) return -1;
+
+    state_dir = getenv("MOCK_STATE");
+    if (!state_dir) {
+        fprintf(stderr, "%s: MOCK_STATE not set\n", argv[0]);
+        return 1;
+    }
+
+    char lock_path[4096];
+    state_path("lock", lock_path, sizeof(lock_path));
+    int lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock >= 0) flock(lock, LOCK_EX);
+
+    simulate_latency();
+    int rc = applet(argc, argv);
+    fflush(stdout);
+
+    if (lock >= 0) close(lock);
+    return rc;
+}
+
+/*
+ * Server Options
+ * * The emulated commands live in <state>/root: bin/ holds symlinks to this
+ * binary, and etc/init.d/ the service scripts. Commands are run with that
+ * bin/ first in PATH, and `/etc/init.d/` is rewritten to the local copy.
+ */
+static struct {
+    int port;
+    const char* user;
+    const char* password;
+    const char* hostkey;
+    int latency_ms;
+    int jitter_ms;
+    char root[PATH_MAX + 8];
+} opts = { DEFAULT_PORT, DEFAULT_USER, DEFAULT_PASSWORD, NULL, 0, 0, "" };
+
+static int setup_root(void) {
+    char self[4096];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0) return 0;
+    self[n] = '\0';
+
+    char abs_state[PATH_MAX];
+    if (!realpath(state_dir, abs_state)) return 0;
+    snprintf(opts.root, sizeof(opts.root), "%s/root", abs_state);
+
+    static const char* dirs[] = { "", "/bin", "/etc", "/etc/init.d" };
+    static const char* links[] = {
+        "/bin/uci", "/bin/ip", "/bin/ifconfig", "/bin/wifi",
+        "/etc/init.d/system", "/etc/init.d/network", "/etc/init.d/firewall",
+        "/etc/init.d/dnsmasq", "/etc/init.d/dropbear",
+    };
+    char path[PATH_MAX + 64];
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", opts.root, dirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return 0;
+    }
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", opts.root, links[i]);
+        unlink(path);
+        if (symlink(self, path) != 0) return 0;
+    }
+    return 1;
+}
+
+// Returns a malloc'd copy of `text` with /etc/init.d/ pointing into the mock root
+static char* rewrite_paths(const char* text, size_t len, size_t* out_len) {
+    static const char needle[] = "/etc/init.d/";
+    size_t needle_len = sizeof(needle) - 1;
+    size_t root_len = strlen(opts.root);
+
+    size_t hits = 0;
+    for (const char* p = text; (p = memmem(p, len - (p - text), needle, needle_len)); p += needle_len) hits++;
+
+    char* out = malloc(len + hits * root_len + 1);
+    if (!out) return NULL;
+    size_t o = 0;
+    const char* p = text;
+    const char* hit;
+    while ((hit = memmem(p, len - (p - text), needle, needle_len))) {
+        memcpy(out + o, p, hit - p);
+        o += hit - p;
+        memcpy(out + o, opts.root, root_len);
+        o += root_len;
+        p = hit;
+        memcpy(out + o, p, needle_len);
+        o += needle_len;
+        p += needle_len;
+    }
+    memcpy(out + o, p, len - (p - text));
+    o += len - (p - text);
+    out[o] = '\0';
+    *out_len = o;
+    return out;
+}
+
+/*
+ * Session Handling
+ * * Each accepted connection is served by its own forked process running a
+ * libssh event loop. Every channel gets a MockChannel: the exec request forks
+ * `/bin/sh -c`, the child's stdout/stderr fds are added to the event loop and
+ * forwarded as channel data, and channel stdin is buffered until EOF (so the
+ * path rewrite also applies to `sh -s` scripts) and then fed to the child.
+ */
+typedef struct MockChannel {
+    ssh_channel channel;
+    struct ssh_channel_callbacks_struct cb;
+    pid_t pid;
+    int in_fd, out_fd, err_fd;   // Child's stdin (write end), stdout and stderr (read ends)
+    char* input;                 // Buffered channel stdin, then the rewritten copy being written
+    size_t input_len, input_cap, input_sent;
+    int input_eof;
+    int exited, exit_status;
+    int finished;                // Exit status sent and channel closed
+    struct MockChannel* next;
+} MockChannel;
+
+typedef struct {
+    ssh_session session;
+    ssh_event event;
+    int authenticated;
+    int auth_attempts;
+    MockChannel* channels;
+} MockSession;
+
+static MockSession mock_session;
+
+static int auth_password(ssh_session session, const char* user, const char* password, void* userdata) {
+    (void)session;
+    MockSession* s = userdata;
+    if (strcmp(user, opts.user) == 0 && strcmp(password, opts.password) == 0) {
+        s->authenticated = 1;
+        return SSH_AUTH_SUCCESS;
+    }
+    s->auth_attempts++;
+    return SSH_AUTH_DENIED;
+}
+
+static void close_fd(int* fd) {
+    if (*fd < 0) return;
+    ssh_event_remove_fd(mock_session.event, *fd);
+    close(*fd);
+    *fd = -1;
+}
+
+static int forward_output(socket_t fd, int revents, void* userdata) {
+    MockChannel* c = userdata;
+    (void)revents;
+    char buf[IO_CHUNK];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) {
+        if (fd == c->out_fd) ssh_channel_write(c->channel, buf, n);
+        else ssh_channel_write_stderr(c->channel, buf, n);
+        return 0;
+    }
+    if (n < 0 && errno == EAGAIN) return 0;
+    close_fd(fd == c->out_fd ? &c->out_fd : &c->err_fd);
+    return 0;
+}
+
+static int feed_input(socket_t fd, int revents, void* userdata) {
+    MockChannel* c = userdata;
+    (void)fd;
+    (void)revents;
+    while (c->input_sent < c->input_len) {
+        ssize_t n = write(c->in_fd, c->input + c->input_sent, c->input_len - c->input_sent);
+        if (n < 0) {
+            if (errno == EAGAIN) return 0;  // Pipe full: wait for the next POLLOUT
+            break;                          // Child stopped reading
+        }
+        c->input_sent += n;
+    }
+    close_fd(&c->in_fd);
+    return 0;
+}
+
+static void start_input(MockChannel* c) {
+    if (c->in_fd < 0) return;
+    size_t len;
+    char* rewritten = rewrite_paths(c->input ? c->input : "", c->input_len, &len);
+    free(c->input);
+    c->input = rewritten;
+    c->input_len = rewritten ? len : 0;
+    c->input_sent = 0;
+    ssh_event_add_fd(mock_session.event, c->in_fd, POLLOUT, feed_input, c);
+}
+
+static int on_channel_data(ssh_session session, ssh_channel channel, void* data, uint32_t len,
+                           int is_stderr, void* userdata) {
+    (void)session;
+    (void)channel;
+    (void)is_stderr;
+    MockChannel* c = userdata;
+    if (c->input_len + len + 1 > c->input_cap) {
+        size_t cap = c->input_cap ? c->input_cap : IO_CHUNK;
+        while (cap < c->input_len + len + 1) cap *= 2;
+        char* bigger = realloc(c->input, cap);
+        if (!bigger) return 0;
+        c->input = bigger;
+        c->input_cap = cap;
+    }
+    memcpy(c->input + c->input_len, data, len);
+    c->input_len += len;
+    return len;
+}
+
+static void on_channel_eof(ssh_session session, ssh_channel channel, void* userdata) {
+    (void)session;
+    (void)channel;
+    MockChannel* c = userdata;
+    c->input_eof = 1;
+    if (c->pid > 0) start_input(c);
+}
+
+static int on_exec_request(ssh_session session, ssh_channel channel, const char* command, void* userdata) {
+    (void)session;
+    (void)channel;
+    MockChannel* c = userdata;
+    if (c->pid > 0) return SSH_ERROR;
+
+    size_t cmd_len;
+    char* cmd = rewrite_paths(command, strlen(command), &cmd_len);
+    int in[2], out[2], err[2];
+    if (!cmd || pipe2(in, O_CLOEXEC) != 0 || pipe2(out, O_CLOEXEC) != 0 || pipe2(err, O_CLOEXEC) != 0) {
+        free(cmd);
+        return SSH_ERROR;
+    }
+
+    c->pid = fork();
+    if (c->pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+
+        char path[PATH_MAX + 64], latency[16], jitter[16];
+        snprintf(path, sizeof(path), "%s/bin:/usr/sbin:/usr/bin:/sbin:/bin", opts.root);
+        snprintf(latency, sizeof(latency), "%d", opts.latency_ms);
+        snprintf(jitter, sizeof(jitter), "%d", opts.jitter_ms);
+        setenv("PATH", path, 1);
+        setenv("MOCK_STATE", state_dir, 1);
+        setenv("MOCK_LATENCY_MS", latency, 1);
+        setenv("MOCK_JITTER_MS", jitter, 1);
+        execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+        _exit(127);
+    }
+    free(cmd);
+    close(in[0]);
+    close(out[1]);
+    close(err[1]);
+    if (c->pid < 0) {
+        close(in[1]);
+        close(out[0]);
+        close(err[0]);
+        return SSH_ERROR;
+    }
+
+    c->in_fd = in[1];
+    c->out_fd = out[0];
+    c->err_fd = err[0];
+    fcntl(c->in_fd, F_SETFL, O_NONBLOCK);
+    fcntl(c->out_fd, F_SETFL, O_NONBLOCK);
+    fcntl(c->err_fd, F_SETFL, O_NONBLOCK);
+    ssh_event_add_fd(mock_session.event, c->out_fd, POLLIN, forward_output, c);
+    ssh_event_add_fd(mock_session.event, c->err_fd, POLLIN, forward_output, c);
+    if (c->input_eof) start_input(c);
+    return SSH_OK;
+}
+
+static ssh_channel on_channel_open(ssh_session session, void* userdata) {
+    MockSession* s = userdata;
+    MockChannel* c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->channel = ssh_channel_new(session);
+    c->in_fd = c->out_fd = c->err_fd = -1;
+
+    c->cb.userdata = c;
+    c->cb.channel_data_function = on_channel_data;
+    c->cb.channel_eof_function = on_channel_eof;
+    c->cb.channel_exec_request_function = on_exec_request;
+    ssh_callbacks_init(&c->cb);
+    ssh_set_channel_callbacks(c->channel, &c->cb);
+
+    c->next = s->channels;
+    s->channels = c;
+    return c->channel;
+}
+
+// Sends exit statuses for finished commands and frees closed channels
+static void reap_channels(MockSession* s) {
+    MockChannel** link = &s->channels;
+    while (*link) {
+        MockChannel* c = *link;
+        if (c->pid > 0 && !c->exited) {
+            int status;
+            if (waitpid(c->pid, &status, WNOHANG) == c->pid) {
+                c->exited = 1;
+                c->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+        }
+        if (c->exited && !c->finished && c->out_fd < 0 && c->err_fd < 0) {
+            close_fd(&c->in_fd);
+            ssh_channel_request_send_exit_status(c->channel, c->exit_status);
+            ssh_channel_send_eof(c->channel);
+            ssh_channel_close(c->channel);
+            c->finished = 1;
+        }
+        if (c->finished || ssh_channel_is_closed(c->channel)) {
+            if (!c->finished && c->pid > 0 && !c->exited) kill(c->pid, SIGTERM);
+            close_fd(&c->in_fd);
+            close_fd(&c->out_fd);
+            close_fd(&c->err_fd);
+            *link = c->next;
+            ssh_channel_free(c->channel);
+            free(c->input);
+            free(c);
+            continue;
+        }
+        link = &c->next;
+    }
+}
+
+static void serve_session(ssh_session session) {
+    MockSession* s = &mock_session;
+    memset(s, 0, sizeof(*s));
+    s->session = session;
+
+    struct ssh_server_callbacks_struct server_cb = {
+        .userdata = s,
+        .auth_password_function = auth_password,
+        .channel_open_request_session_function = on_channel_open,
+    };
+    ssh_callbacks_init(&server_cb);
+    ssh_set_server_callbacks(session, &server_cb);
+    ssh_set_auth_methods(session, SSH_AUTH_METHOD_PASSWORD);
+
+    if (ssh_handle_key_exchange(session) != SSH_OK) {
+        fprintf(stderr, "mock_router: key exchange failed: %s\n", ssh_get_error(session));
+        return;
+    }
+
+    s->event = ssh_event_new();
+    ssh_event_add_session(s->event, session);
+    while (s->auth_attempts < MAX_AUTH_ATTEMPTS) {
+        if (ssh_event_dopoll(s->event, 100) == SSH_ERROR) break;
+        reap_channels(s);
+        if (!ssh_is_connected(session)) break;
+    }
+
+    // Client gone: stop whatever it left running
+    for (MockChannel* c = s->channels; c; c = c->next) {
+        if (c->pid > 0 && !c->exited) {
+            kill(c->pid, SIGTERM);
+            waitpid(c->pid, NULL, 0);
+        }
+    }
+    ssh_event_remove_session(s->event, session);
+    ssh_event_free(s->event);
+}
+
+static void print_usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-p PORT] [-u USER] [-P PASSWORD] [-d STATE_DIR]\n"
+            "          [-l LATENCY_MS] [-j JITTER_MS] [-k HOSTKEY]\n", prog);
+}
+
+int main(int argc, char** argv) {
+    int applet_rc = run_applet(argc, argv);
+    if (applet_rc >= 0) return applet_rc;
+
+    state_dir = DEFAULT_STATE_DIR;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:u:P:d:l:j:k:h")) != -1) {
+        switch (opt) {
+            case 'p': opts.port = atoi(optarg); break;
+            case 'u': opts.user = optarg; break;
+            case 'P': opts.password = optarg; break;
+            case 'd': state_dir = optarg; break;
+            case 'l': opts.latency_ms = atoi(optarg); break;
+            case 'j': opts.jitter_ms = atoi(optarg); break;
+            case 'k': opts.hostkey = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (mkdir(state_dir, 0755) != 0 && errno != EEXIST) {
+        perror(state_dir);
+        return 1;
+    }
+    seed_state();
+    if (!setup_root()) {
+        fprintf(stderr, "mock_router: cannot set up %s/root\n", state_dir);
+        return 1;
+    }
+
+    ssh_init();
+    ssh_bind bind = ssh_bind_new();
+    ssh_bind_options_set(bind, SSH_BIND_OPTIONS_BINDADDR, "127.0.0.1");
+    ssh_bind_options_set(bind, SSH_BIND_OPTIONS_BINDPORT, &opts.port);
+    if (opts.hostkey) {
+        ssh_bind_options_set(bind, SSH_BIND_OPTIONS_HOSTKEY, opts.hostkey);
+    } else {
+        // Throwaway host key: the CLIs do not verify host keys
+        ssh_key key = NULL;
+        if (ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &key) != SSH_OK) {
+            fprintf(stderr, "mock_router: cannot generate a host key\n");
+            return 1;
+        }
+        ssh_bind_options_set(bind, SSH_BIND_OPTIONS_IMPORT_KEY, key);
+    }
+    if (ssh_bind_listen(bind) != SSH_OK) {
+        fprintf(stderr, "mock_router: %s\n", ssh_get_error(bind));
+        return 1;
+    }
+
+    // Session processes are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    printf("mock_router: listening on 127.0.0.1:%d (state %s, latency %d+/-%d ms)\n",
+           opts.port, state_dir, opts.latency_ms, opts.jitter_ms);
+    fflush(stdout);
+
+    for (;;) {
+        ssh_session session = ssh_new();
+        if (ssh_bind_accept(bind, session) != SSH_OK) {
+            ssh_free(session);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Command children must be waitable for their exit status
+            signal(SIGCHLD, SIG_DFL);
+            ssh_bind_free(bind);
+            serve_session(session);
+            ssh_disconnect(session);
+            ssh_free(session);
+            _exit(0);
+        }
+        ssh_free(session);
+    }
+}
@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+"""
+Mock rpcd for router_cli's ubus transport (--transport ubus).
+
+Serves OpenWrt's JSON-RPC endpoint (POST /ubus) over HTTP/1.1 keep-alive
+with the calls the CLI makes: session login, uci set/get/commit/revert and
+the apply/confirm/rollback transaction, network.interface dump,
+network.device status, network reload, network.wireless up and rc init.
+Configuration lives in memory and starts like bench/mock_router's.
+
+    python3 bench/mock_rpcd.py [--port 8080] [--latency MS] [--chunked]
+                               [--session-timeout S] [--fail OBJECT.METHOD]
+                               [--drop-every N]
+    ./router_cli --host 127.0.0.1 --port 2222 --transport ubus --ubus-port 8080
+
+--chunked sends replies with chunked transfer encoding, as uhttpd does.
+--session-timeout expires sessions (the CLI must log in again).
+--fail makes every call of OBJECT.METHOD return UBUS_STATUS_UNKNOWN_ERROR,
+to exercise the CLI's rollback.
+--drop-every N cuts every Nth reply off halfway through its body and closes
+the connection, like rpcd dying mid-reply (the CLI must recover on a new
+connection).
+"""
+
+import argparse
+import copy
+import json
+import os
+import re
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# ubus status codes (libubus.h)
+OK, INVALID_ARGUMENT, METHOD_NOT_FOUND, NOT_FOUND, NO_DATA, PERMISSION_DENIED, UNKNOWN_ERROR = 0, 2, 3, 4, 5, 6, 9
+NULL_SESSION = "0" * 32
+ACCESS_DENIED = -32002
+
+CONFIG = {
+    "system": [("@system[0]", "system", {"hostname": "OpenWrt", "timezone": "UTC"})],
+    "network": [
+        ("loopback", "interface", {"device": "lo", "proto": "static", "ipaddr": "127.0.0.1"}),
+        ("lan", "interface", {"device": "br-lan", "proto": "static", "ipaddr": "192.168.1.1",
+                              "netmask": "255.255.255.0"}),
+        ("wan", "interface", {"device": "eth1", "proto": "dhcp"}),
+    ],
+    "wireless": [
+        ("radio0", "wifi-device", {"band": "5g", "channel": "36"}),
+        ("radio1", "wifi-device", {"band": "2g", "channel": "1"}),
+        ("default_radio0", "wifi-iface", {"device": "radio0", "mode": "ap", "ssid": "OpenWrt"}),
+        ("default_radio1", "wifi-iface", {"device": "radio1", "mode": "ap", "ssid": "OpenWrt"}),
+    ],
+}
+
+DEVICES = {
+    "lo": {"macaddr": "00:00:00:00:00:00", "mtu": 65536},
+    "eth0": {"macaddr": "02:00:00:00:00:01", "mtu": 1500},
+    "eth1": {"macaddr": "02:00:00:00:00:02", "mtu": 1500},
+    "br-lan": {"macaddr": "02:00:00:00:00:01", "mtu": 1500},
+}
+
+SERVICES = {"network", "system", "firewall", "dnsmasq", "dropbear", "uhttpd"}
+
+
+def mask_len(netmask):
+    return sum(bin(int(part)).count("1") for part in netmask.split("."))
+
+
+class Router:
+    """Committed config, per-session staged changes and the apply transaction."""
+
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.config = {pkg: [[name, typ, dict(opts)] for name, typ, opts in sections]
+                       for pkg, sections in CONFIG.items()}
+        self.sessions = {}        # id -> last use
+        self.staged = {}          # session -> [(config, section, option, value)]
+        self.backup = None        # Config before an unconfirmed apply
+        self.rollback_timer = None
+
+    # --- sessions ---
+
+    def session_valid(self, sid):
+        used = self.sessions.get(sid)
+        if used is None:
+            return False
+        if self.args.session_timeout and time.time() - used > self.args.session_timeout:
+            del self.sessions[sid]
+            return False
+        self.sessions[sid] = time.time()
+        return True
+
+    def login(self, params):
+        if params.get("username") != "root" or params.get("password") != self.args.password:
+            return PERMISSION_DENIED, None
+        sid = os.urandom(16).hex()
+        self.sessions[sid] = time.time()
+        return OK, {"ubus_rpc_session": sid, "timeout": self.args.session_timeout or 300}
+
+    # --- uci ---
+
+    def find_section(self, config, name):
+        sections = self.config.get(config)
+        if sections is None:
+            return None
+        m = re.fullmatch(r"@([\w-]+)\[(-?\d+)\]", name)
+        if m:
+            typed = [s for s in sections if s[1] == m.group(1)]
+            index = int(m.group(2))
+            return typed[index] if -len(typed) <= index < len(typed) else None
+        return next((s for s in sections if s[0] == name), None)
+
+    def commit(self, sid, configs=None):
+        keep = []
+        for change in self.staged.pop(sid, []):
+            config, section, option, value = change
+            if configs is not None and config not in configs:
+                keep.append(change)
+                continue
+            target = self.find_section(config, section)
+            if target is None:
+                return NOT_FOUND
+            target[2][option] = value
+        if keep:
+            self.staged[sid] = keep
+        return OK
+
+    def uci(self, sid, method, params):
+        config = params.get("config")
+        if method == "set":
+            section = params.get("section")
+            if self.find_section(config, section or "") is None:
+                return NOT_FOUND, None
+            for option, value in params.get("values", {}).items():
+                self.staged.setdefault(sid, []).append((config, section, option, str(value)))
+            return OK, None
+        if method == "get":
+            section = self.find_section(config, params.get("section", ""))
+            if section is None:
+                return NOT_FOUND, None
+            values = dict(section[2], **{".name": section[0], ".type": section[1]})
+            option = params.get("option")
+            if option:
+                return (OK, {"value": values[option]}) if option in values else (NOT_FOUND, None)
+            return OK, {"values": values}
+        if method == "revert":
+            self.staged[sid] = [c for c in self.staged.get(sid, []) if c[0] != config]
+            return OK, None
+        if method == "commit":
+            return self.commit(sid, {config}), None
+        if method == "apply":
+            if self.backup is not None:
+                return PERMISSION_DENIED, None    # Another apply awaits confirmation
+            if not self.staged.get(sid):
+                return NO_DATA, None
+            backup = copy.deepcopy(self.config)
+            status = self.commit(sid)
+            if status != OK:
+                self.config = backup
+                return status, None
+            if params.get("rollback"):
+                self.backup = backup
+                self.rollback_timer = threading.Timer(params.get("timeout", 30), self.expire)
+                self.rollback_timer.daemon = True
+                self.rollback_timer.start()
+            return OK, None
+        if method in ("confirm", "rollback"):
+            if self.backup is None:
+                return NO_DATA, None
+            self.rollback_timer.cancel()
+            if method == "rollback":
+                self.config = self.backup
+            self.backup = None
+            return OK, None
+        return METHOD_NOT_FOUND, None
+
+    def expire(self):
+        with self.lock:
+            if self.backup is not None:
+                log("apply not confirmed in time: rolled back")
+                self.config, self.backup = self.backup, None
+
+    # --- network ---
+
+    def interfaces(self):
+        out = []
+        for name, typ, opts in self.config["network"]:
+            if typ != "interface":
+                continue
+            entry = {"interface": name, "up": True, "pending": False, "available": True,
+                     "proto": opts.get("proto", "none"), "device": opts.get("device", ""),
+                     "l3_device": opts.get("device", ""), "ipv4-address": [], "ipv6-address": []}
+            if opts.get("proto") == "static" and "ipaddr" in opts:
+                entry["ipv4-address"].append({"address": opts["ipaddr"],
+                                              "mask": mask_len(opts.get("netmask", "255.0.0.0"))})
+            elif opts.get("proto") == "dhcp":
+                entry["ipv4-address"].append({"address": "10.0.0.2", "mask": 24})
+            out.append(entry)
+        return {"interface": out}
+
+    def devices(self, params):
+        status = {name: dict(info, up=True, carrier=True, type="Network device") for name, info in DEVICES.items()}
+        name = params.get("name")
+        if name:
+            return (OK, status[name]) if name in status else (NOT_FOUND, None)
+        return OK, status
+
+    # --- dispatch ---
+
+    def call(self, sid, obj, method, params):
+        if "%s.%s" % (obj, method) == self.args.fail:
+            return UNKNOWN_ERROR, None
+        if obj == "session" and method == "login":
+            return self.login(params)
+        if obj == "uci":
+            return self.uci(sid, method, params)
+        if obj == "network.interface" and method == "dump":
+            return OK, self.interfaces()
+        if obj == "network.device" and method == "status":
+            return self.devices(params)
+        if obj == "network" and method == "reload":
+            return OK, None
+        if obj == "network.wireless" and method == "up":
+            radios = {s[0] for s in self.config["wireless"] if s[1] == "wifi-device"}
+            device = params.get("device")
+            return (OK, None) if device is None or device in radios else (NOT_FOUND, None)
+        if obj == "rc" and method == "init":
+            if params.get("name") not in SERVICES:
+                return NOT_FOUND, None
+            return (OK, None) if params.get("action") in ("start", "stop", "restart", "reload") else (INVALID_ARGUMENT, None)
+        return METHOD_NOT_FOUND, None
+
+
+def log(message):
+    print("mock_rpcd: " + message, file=sys.stderr, flush=True)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, fmt, *args):
+        if self.server.args.verbose:
+            log(fmt % args)
+
+    def reply(self, payload):
+        body = json.dumps(payload).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        with self.server.replies_lock:
+            self.server.replies += 1
+            drop = self.server.args.drop_every and self.server.replies % self.server.args.drop_every == 0
+        if drop:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body[:len(body) // 2])
+            self.wfile.flush()
+            self.close_connection = True
+            log("dropped the connection mid-reply")
+        elif self.server.args.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            # Two chunks, to exercise reassembly
+            for part in (body[:len(body) // 2], body[len(body) // 2:]):
+                if part:
+                    self.wfile.write(b"%x\r\n%s\r\n" % (len(part), part))
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    def do_POST(self):
+        if self.path != "/ubus":
+            self.send_error(404)
+            return
+        request = json.loads(self.rfile.read(int(self.headers.get("Content-Length", 0))))
+        rid = request.get("id")
+        try:
+            sid, obj, method, params = request["params"]
+        except (KeyError, ValueError):
+            self.reply({"jsonrpc": "2.0", "id": rid, "error": {"code": -32602, "message": "Invalid params"}})
+            return
+        if self.server.args.latency:
+            time.sleep(self.server.args.latency / 1000.0)
+
+        router = self.server.router
+        with router.lock:
+            if not (obj == "session" and method == "login") and not router.session_valid(sid):
+                self.reply({"jsonrpc": "2.0", "id": rid, "error": {"code": ACCESS_DENIED, "message": "Access denied"}})
+                return
+            status, data = router.call(sid, obj, method, params)
+        if self.server.args.verbose:
+            log("%s %s %s -> %d" % (obj, method, json.dumps(params), status))
+        result = [status] if data is None else [status, data]
+        self.reply({"jsonrpc": "2.0", "id": rid, "result": result})
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--password", default="root")
+    parser.add_argument("--latency", type=float, default=0, help="ms added to every call")
+    parser.add_argument("--chunked", action="store_true")
+    parser.add_argument("--session-timeout", type=float, default=0)
+    parser.add_argument("--fail", default="", metavar="OBJECT.METHOD")
+    parser.add_argument("--drop-every", type=int, default=0, metavar="N")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.args = args
+    server.router = Router(args)
+    server.replies = 0
+    server.replies_lock = threading.Lock()
+    log("listening on 127.0.0.1:%d" % args.port)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
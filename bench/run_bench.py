@@ -0,0 +1,279 @@
+#!/usr/bin/env python3
+"""
+End-to-end benchmark for router_cli (C++) and router_monitor against the
+local mock router (bench/mock_router).
+
+Starts the mock and the monitor in a scratch directory, drives the CLI
+through a scripted session over a pipe (timing each command from send to
+the next prompt), times control-socket requests to the monitor, and reports
+p50/p99 latency per command type, apply throughput in commands/sec, and
+CPU time / peak RSS of the CLI and monitor processes.
+
+Build first:
+    g++ -std=c++17 -O2 router_cli.cpp -o router_cli -lssh2 -lz -pthread
+    gcc router_monitor.c -o router_monitor -lssh2 -pthread
+    gcc bench/mock_router.c -o bench/mock_router -lssh
+    gcc c_helpers/state_tool.c -o c_helpers/state_tool
+
+Usage:
+    python3 bench/run_bench.py [--latency MS] [--jitter MS] [--iterations N]
+                               [--apply-batch N] [--json OUT] [--compare BASELINE]
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import select
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PROMPT = re.compile(rb"(?:^|\n)[\w.-]+(?:\(config(?:-if)?\))?[>#] $")
+TIMEOUT = 60
+
+
+def percentile(samples, pct):
+    ordered = sorted(samples)
+    if not ordered:
+        return 0.0
+    # Nearest-rank percentile
+    rank = max(1, math.ceil(pct / 100.0 * len(ordered)))
+    return ordered[rank - 1]
+
+
+def wait_for(predicate, what, timeout=10):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if predicate():
+            return
+        time.sleep(0.05)
+    sys.exit("bench: timed out waiting for " + what)
+
+
+def port_open(port):
+    try:
+        socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+        return True
+    except OSError:
+        return False
+
+
+def reap(proc):
+    """Waits for a child and returns (cpu_seconds, max_rss_kb)."""
+    _, _, usage = os.wait4(proc.pid, 0)
+    proc.returncode = 0
+    return usage.ru_utime + usage.ru_stime, usage.ru_maxrss
+
+
+class CliSession:
+    """router_cli over a pipe; send() returns (seconds, output) up to the next prompt."""
+
+    def __init__(self, cli, port, workdir):
+        self.proc = subprocess.Popen(
+            [cli, "--host", "127.0.0.1", "--port", str(port)],
+            cwd=workdir, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        self.read_prompt()
+
+    def read_prompt(self):
+        out = b""
+        fd = self.proc.stdout.fileno()
+        while not PROMPT.search(out):
+            chunk = os.read(fd, 65536) if select.select([fd], [], [], TIMEOUT)[0] else b""
+            if not chunk:
+                sys.exit("bench: CLI stopped responding; output so far:\n" + out.decode(errors="replace"))
+            out += chunk
+        return out.decode(errors="replace")
+
+    def send(self, line):
+        start = time.perf_counter()
+        self.proc.stdin.write(line.encode() + b"\n")
+        self.proc.stdin.flush()
+        out = self.read_prompt()
+        return time.perf_counter() - start, out
+
+    def close(self):
+        self.proc.stdin.write(b"exit\n")
+        self.proc.stdin.close()
+        return reap(self.proc)
+
+
+def check_batch_rejects(cli, port, workdir):
+    """A batch script that enters a missing radio must fail cleanly, not crash."""
+    script = "enable\nconfigure terminal\nwireless radio9\nssid bench\nexit\nexit\napply\n"
+    proc = subprocess.run([cli, "--host", "127.0.0.1", "--port", str(port), "--batch", "-"],
+                          cwd=workdir, input=script.encode(), stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, timeout=TIMEOUT)
+    out = proc.stdout.decode(errors="replace")
+    if proc.returncode != 1 or "rejected: wireless radio9" not in out:
+        sys.exit("bench: batch with a missing radio exited %d:\n%s" % (proc.returncode, out))
+
+
+def monitor_request(sock_path, request):
+    start = time.perf_counter()
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.settimeout(TIMEOUT)
+    s.connect(sock_path)
+    s.sendall(request.encode() + b"\n")
+    s.shutdown(socket.SHUT_WR)
+    reply = b""
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        reply += chunk
+    s.close()
+    if not reply.startswith(b"OK "):
+        sys.exit("bench: monitor %s failed: %s" % (request, reply.decode(errors="replace").strip()))
+    return time.perf_counter() - start
+
+
+def run(args):
+    workdir = tempfile.mkdtemp(prefix="router_bench.")
+    state = os.path.join(workdir, "state")
+    os.mkdir(state)
+    # The monitor reads its target from the state store
+    subprocess.run([args.state_tool, "-f", os.path.join(state, "state.db"), "set",
+                    "router_ip", "127.0.0.1", "router_port", str(args.port),
+                    "username", "root", "password", "root"], check=True)
+
+    samples = {}
+    resources = {}
+    apply_rates = []
+    mock = monitor = None
+
+    def record(kind, seconds):
+        samples.setdefault(kind, []).append(seconds)
+
+    try:
+        mock = subprocess.Popen(
+            [args.mock, "-p", str(args.port), "-d", os.path.join(workdir, "mock_state"),
+             "-l", str(args.latency), "-j", str(args.jitter)],
+            stdout=subprocess.DEVNULL)
+        wait_for(lambda: port_open(args.port), "the mock router")
+
+        monitor_log = open(os.path.join(workdir, "monitor.log"), "w")
+        monitor = subprocess.Popen([args.monitor, "--poll-interval", "0"], cwd=workdir,
+                                   stdout=monitor_log, stderr=subprocess.STDOUT)
+        sock_path = os.path.join(state, "monitor.sock")
+        wait_for(lambda: os.path.exists(sock_path), "the monitor control socket")
+
+        # Monitor: control-socket round trips, each refresh hits the mock
+        for _ in range(args.iterations):
+            record("monitor REFRESH", monitor_request(sock_path, "REFRESH"))
+            record("monitor REFRESH_INTERFACES", monitor_request(sock_path, "REFRESH_INTERFACES"))
+
+        check_batch_rejects(args.cli, args.port, workdir)
+
+        # CLI: connect (handshake + auth) is the time to the first prompt
+        start = time.perf_counter()
+        cli = CliSession(args.cli, args.port, workdir)
+        record("cli connect", time.perf_counter() - start)
+        cli.send("enable")
+
+        for _ in range(args.iterations):
+            record("show ip route fresh", cli.send("show ip route fresh")[0])
+            record("show ip interface fresh", cli.send("show ip interface fresh")[0])
+            record("show ip route (cached)", cli.send("show ip route")[0])
+            record("show tech-support fresh", cli.send("show tech-support fresh")[0])
+
+        for i in range(args.iterations):
+            cli.send("configure terminal")
+            cli.send("hostname bench%d" % i)
+            for k in range(args.apply_batch):
+                cli.send("ip route 10.%d.%d.0 255.255.255.0 10.0.0.1" % (i % 250, k % 250))
+            cli.send("interface eth0")
+            cli.send("ip address 172.16.%d.1 255.255.255.0" % (i % 250))
+            cli.send("shutdown")
+            cli.send("no shutdown")
+            cli.send("exit")
+            cli.send("exit")
+            seconds, out = cli.send("apply")
+            record("apply", seconds)
+            applied = re.search(r"Applying (\d+) commands", out)
+            if "FAILED" in out or not applied:
+                sys.exit("bench: apply failed:\n" + out)
+            apply_rates.append(int(applied.group(1)) / seconds)
+
+        resources["router_cli"] = cli.close()
+        monitor.send_signal(signal.SIGTERM)
+        resources["router_monitor"] = reap(monitor)
+        monitor = None
+    finally:
+        for proc in (monitor, mock):
+            if proc and proc.poll() is None:
+                proc.terminate()
+                proc.wait()
+        if not args.keep:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    results = {
+        "settings": {"latency_ms": args.latency, "jitter_ms": args.jitter,
+                     "iterations": args.iterations, "apply_batch": args.apply_batch},
+        "latency_ms": {kind: {"p50": percentile(v, 50) * 1000, "p99": percentile(v, 99) * 1000,
+                              "count": len(v)} for kind, v in samples.items()},
+        "apply_cmds_per_sec": percentile(apply_rates, 50),
+        "resources": {name: {"cpu_s": cpu, "max_rss_kb": rss} for name, (cpu, rss) in resources.items()},
+    }
+    return results
+
+
+def report(results, baseline=None):
+    def delta(now, before):
+        if not before:
+            return ""
+        return "  (%+.1f%%)" % ((now - before) / before * 100.0)
+
+    base_lat = baseline["latency_ms"] if baseline else {}
+    print("%-28s %6s %10s %10s" % ("Command", "Count", "p50 ms", "p99 ms"))
+    for kind, stats in results["latency_ms"].items():
+        before = base_lat.get(kind, {})
+        print("%-28s %6d %10.2f %10.2f%s" % (kind, stats["count"], stats["p50"], stats["p99"],
+                                             delta(stats["p50"], before.get("p50"))))
+    print()
+    rate = results["apply_cmds_per_sec"]
+    print("apply throughput: %.1f commands/sec%s" %
+          (rate, delta(rate, baseline["apply_cmds_per_sec"] if baseline else None)))
+    for name, res in results["resources"].items():
+        print("%-15s cpu %.3f s, max RSS %d KB" % (name, res["cpu_s"], res["max_rss_kb"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark router_cli and router_monitor against the mock router")
+    parser.add_argument("--cli", default=os.path.join(REPO, "router_cli"))
+    parser.add_argument("--monitor", default=os.path.join(REPO, "router_monitor"))
+    parser.add_argument("--mock", default=os.path.join(REPO, "bench", "mock_router"))
+    parser.add_argument("--state-tool", default=os.path.join(REPO, "c_helpers", "state_tool"))
+    parser.add_argument("--port", type=int, default=2222)
+    parser.add_argument("--latency", type=int, default=20, help="per-command latency of the mock (ms)")
+    parser.add_argument("--jitter", type=int, default=5, help="latency jitter of the mock (+/- ms)")
+    parser.add_argument("--iterations", type=int, default=20)
+    parser.add_argument("--apply-batch", type=int, default=10, help="routes queued per apply")
+    parser.add_argument("--json", help="write results to this file (use as a baseline later)")
+    parser.add_argument("--compare", help="baseline JSON to compare p50s and throughput against")
+    parser.add_argument("--keep", action="store_true", help="keep the scratch directory")
+    args = parser.parse_args()
+
+    for path in (args.cli, args.monitor, args.mock, args.state_tool):
+        if not os.access(path, os.X_OK):
+            sys.exit("bench: %s not built (see the build lines at the top of this script)" % path)
+
+    results = run(args)
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    report(results, baseline)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,139 @@
+/*
+ * arena.h
+ * * Bump allocator for data that is freed all at once: the C CLI's pending
+ * queue (freed after `apply`) and the tokens of one input line (freed before
+ * the next).
+ *
+ * Memory comes in chunks kept on a list, newest first. An allocation bumps
+ * the offset in the newest chunk; when it does not fit, a new chunk twice the
+ * size of the previous one (or large enough for the request) is added, so
+ * there is no size limit and the number of mallocs grows with the log of the
+ * total. arena_reset() frees every chunk but the newest, which is the
+ * largest, and rewinds it: memory follows actual use, and a reused arena
+ * costs no malloc at all.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE 4096      // First chunk; each later one doubles
+#define ARENA_ALIGN sizeof(void*)  // Alignment of arena_alloc() results
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;       // Older chunk
+    size_t size;                   // Bytes in data[]
+    size_t used;
+    char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk* head;              // Newest (and largest) chunk, or NULL
+} Arena;
+
+#define ARENA_INIT { NULL }
+
+// Adds a chunk of at least `min_size` bytes. Returns 0 if out of memory.
+static inline int arena_grow(Arena* a, size_t min_size) {
+    size_t size = a->head ? a->head->size * 2 : ARENA_CHUNK_SIZE;
+    if (size < min_size) size = min_size;
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) return 0;
+    chunk->next = a->head;
+    chunk->size = size;
+    chunk->used = 0;
+    a->head = chunk;
+    return 1;
+}
+
+// Returns `size` bytes aligned to `align` (a power of two), or NULL if out
+// of memory. Only freed by arena_reset() / arena_free().
+static inline void* arena_alloc_aligned(Arena* a, size_t size, size_t align) {
+    if (a->head) {
+        size_t at = (a->head->used + align - 1) & ~(align - 1);
+        if (at + size <= a->head->size) {
+            a->head->used = at + size;
+            return a->head->data + at;
+        }
+    }
+    if (!arena_grow(a, size + align)) return NULL;
+    size_t at = ((size_t)(-(uintptr_t)a->head->data)) & (align - 1);
+    a->head->used = at + size;
+    return a->head->data + at;
+}
+
+static inline void* arena_alloc(Arena* a, size_t size) {
+    return arena_alloc_aligned(a, size, ARENA_ALIGN);
+}
+
+// Copies `len` bytes of `s` and adds a NUL
+static inline char* arena_strndup(Arena* a, const char* s, size_t len) {
+    char* out = (char*)arena_alloc_aligned(a, len + 1, 1);
+    if (!out) return NULL;
+    memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
+
+/*
+ * arena_vprintf
+ * * Formats straight into the free end of the newest chunk. Only if the text
+ * does not fit is it measured and formatted a second time into a new chunk.
+ * Stores the length in *len_out (if not NULL). Returns NULL if out of memory.
+ */
+static inline char* arena_vprintf(Arena* a, size_t* len_out, const char* fmt, va_list ap) {
+    va_list again;
+    va_copy(again, ap);
+    char* dst = a->head ? a->head->data + a->head->used : NULL;
+    size_t room = a->head ? a->head->size - a->head->used : 0;
+    int n = vsnprintf(dst, room, fmt, ap);
+    if (n < 0) {
+        va_end(again);
+        return NULL;
+    }
+    if ((size_t)n < room) {
+        a->head->used += n + 1;
+    } else {
+        dst = (char*)arena_alloc_aligned(a, n + 1, 1);
+        if (dst) vsnprintf(dst, n + 1, fmt, again);
+    }
+    va_end(again);
+    if (dst && len_out) *len_out = n;
+    return dst;
+}
+
+static inline char* arena_printf(Arena* a, size_t* len_out, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+static inline char* arena_printf(Arena* a, size_t* len_out, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char* out = arena_vprintf(a, len_out, fmt, ap);
+    va_end(ap);
+    return out;
+}
+
+// Frees everything allocated so far in one step, keeping the largest chunk
+static inline void arena_reset(Arena* a) {
+    if (!a->head) return;
+    ArenaChunk* chunk = a->head->next;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    a->head->next = NULL;
+    a->head->used = 0;
+}
+
+static inline void arena_free(Arena* a) {
+    arena_reset(a);
+    free(a->head);
+    a->head = NULL;
+}
+
+#endif /* ARENA_H */
@@ -0,0 +1,372 @@
+/*
+ * async_log.h
+ * * Asynchronous logger for the monitor and the C++ CLI.
+ *
+ * Producers format a message straight into a slot of a bounded lock-free
+ * ring (multi-producer, single-consumer, per-slot sequence numbers) and
+ * return: no lock, no syscall, no strftime. When the ring is full the record
+ * is dropped and counted, so logging never blocks a fetch or an apply.
+ *
+ * A background thread drains the ring in batches and hands each batch to a
+ * single writev() that points into the ring slots themselves. The text
+ * prefix ("[2025-12-30 10:00:00] [MONITOR] ") is formatted once per second
+ * and reused. While the ring is empty the thread sleeps on an eventfd, and
+ * only the first record after a quiet spell pays for a wakeup.
+ *
+ * Output goes to stdout or to a file that is rotated by size
+ * (path -> path.1 -> ... -> path.N). In binary mode each record is written
+ * as-is (AlogRecord + message), which skips the timestamp formatting
+ * entirely; c_helpers/log_decode turns such files back into text.
+ *
+ * There is one logger per process.
+ */
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define ALOG_SLOTS 1024                 // Ring capacity in records (power of two)
+#define ALOG_MSG_MAX 488                // Longer messages are truncated
+#define ALOG_BATCH 64                   // Records per writev()
+#define ALOG_SOURCE_LEN 16
+#define ALOG_MAGIC "RLOG"               // Binary file header: magic, version, source
+#define ALOG_VERSION 1
+
+// One binary record; the message bytes follow (no newline, no NUL)
+typedef struct {
+    uint64_t time_us;                   // CLOCK_REALTIME
+    uint32_t len;
+    uint32_t reserved;
+} AlogRecord;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    char source[ALOG_SOURCE_LEN];
+} AlogFileHeader;
+
+typedef struct {
+    uint64_t seq;                       // Ring protocol: which lap owns the slot
+    AlogRecord rec;
+    char msg[ALOG_MSG_MAX];
+} AlogSlot;
+
+typedef struct {
+    AlogSlot slots[ALOG_SLOTS];
+    uint64_t enqueue_pos;               // Shared by producers
+    uint64_t dequeue_pos;               // Writer thread only
+    uint64_t dropped;
+    int sleeping;                       // Writer is (about to be) blocked on wake_fd
+    int stop;
+    int running;
+    int wake_fd;
+    int fd;
+    int binary;
+    size_t written;                     // Bytes in the current file
+    size_t rotate_bytes;                // 0: never rotate
+    int keep;                           // Rotated files kept
+    char path[PATH_MAX];                // "" for stdout
+    char source[ALOG_SOURCE_LEN];
+    pthread_t thread;
+} AsyncLog;
+
+static AsyncLog alog_state;
+
+static inline uint64_t alog_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static inline void alog_write_all(int fd, const char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+// Opens (or reopens after rotation) the output file; stdout when no path
+static inline int alog_open_file(AsyncLog* log) {
+    log->fd = log->path[0] ? open(log->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644) : STDOUT_FILENO;
+    if (log->fd < 0) return -1;
+    struct stat sb;
+    log->written = fstat(log->fd, &sb) == 0 && S_ISREG(sb.st_mode) ? (size_t)sb.st_size : 0;
+    if (log->binary && log->written == 0) {
+        AlogFileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, ALOG_MAGIC, 4);
+        h.version = ALOG_VERSION;
+        memcpy(h.source, log->source, ALOG_SOURCE_LEN);
+        alog_write_all(log->fd, (const char*)&h, sizeof(h));
+        log->written = sizeof(h);
+    }
+    return 0;
+}
+
+// path.(keep-1) -> path.keep, ..., path -> path.1, then a fresh path
+static inline void alog_rotate(AsyncLog* log) {
+    char from[PATH_MAX + 16], to[PATH_MAX + 16];
+    close(log->fd);
+    for (int i = log->keep - 1; i >= 0; i--) {
+        if (i == 0) snprintf(from, sizeof(from), "%s", log->path);
+        else snprintf(from, sizeof(from), "%s.%d", log->path, i);
+        snprintf(to, sizeof(to), "%s.%d", log->path, i + 1);
+        rename(from, to);
+    }
+    if (log->keep == 0) unlink(log->path);
+    if (alog_open_file(log) != 0) log->fd = STDERR_FILENO;
+}
+
+/*
+ * Writer thread
+ */
+
+// Cached "[YYYY-mm-dd HH:MM:SS] [SOURCE] " for one second of wall time
+typedef struct {
+    uint64_t second;
+    size_t len;
+    char text[64];
+} AlogPrefix;
+
+static inline void alog_prefix_for(AlogPrefix* p, const char* source, uint64_t time_us) {
+    time_t second = (time_t)(time_us / 1000000u);
+    struct tm tm;
+    localtime_r(&second, &tm);
+    char stamp[24];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    p->second = (uint64_t)second;
+    p->len = (size_t)snprintf(p->text, sizeof(p->text), "[%s] [%s] ", stamp, source);
+}
+
+// Writes up to ALOG_BATCH ready records with one writev(); returns how many
+static inline int alog_flush_batch(AsyncLog* log, AlogPrefix* prefixes, int* current) {
+    static const char newline = '\n';
+    struct iovec iov[ALOG_BATCH * 3];
+    int iovcnt = 0;
+    int count = 0;
+    size_t bytes = 0;
+    int first_prefix = *current;
+    uint64_t pos = log->dequeue_pos;
+
+    for (; count < ALOG_BATCH; count++, pos++) {
+        AlogSlot* slot = &log->slots[pos & (ALOG_SLOTS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) break;
+
+        if (log->binary) {
+            iov[iovcnt].iov_base = &slot->rec;
+            iov[iovcnt++].iov_len = sizeof(AlogRecord) + slot->rec.len;
+            bytes += sizeof(AlogRecord) + slot->rec.len;
+            continue;
+        }
+
+        // An empty message is a bare separator line
+        if (slot->rec.len == 0) {
+            iov[iovcnt].iov_base = (void*)&newline;
+            iov[iovcnt++].iov_len = 1;
+            bytes += 1;
+            continue;
+        }
+
+        // A new second needs its own prefix buffer; the old one may still be
+        // referenced by earlier entries of this batch
+        uint64_t second = slot->rec.time_us / 1000000u;
+        AlogPrefix* p = &prefixes[*current];
+        if (p->second != second) {
+            int next = (*current + 1) % 2;
+            if (count > 0 && next == first_prefix) break;
+            *current = next;
+            p = &prefixes[next];
+            alog_prefix_for(p, log->source, slot->rec.time_us);
+        }
+        iov[iovcnt].iov_base = p->text;
+        iov[iovcnt++].iov_len = p->len;
+        iov[iovcnt].iov_base = slot->msg;
+        iov[iovcnt++].iov_len = slot->rec.len;
+        iov[iovcnt].iov_base = (void*)&newline;
+        iov[iovcnt++].iov_len = 1;
+        bytes += p->len + slot->rec.len + 1;
+    }
+    if (count == 0) return 0;
+
+    // A short write only happens on a full disk or a closed pipe; the batch
+    // is dropped then rather than retried forever
+    while (writev(log->fd, iov, iovcnt) < 0 && errno == EINTR) {
+    }
+
+    for (int i = 0; i < count; i++, log->dequeue_pos++) {
+        AlogSlot* slot = &log->slots[log->dequeue_pos & (ALOG_SLOTS - 1)];
+        __atomic_store_n(&slot->seq, log->dequeue_pos + ALOG_SLOTS, __ATOMIC_RELEASE);
+    }
+
+    log->written += bytes;
+    if (log->path[0] && log->rotate_bytes && log->written >= log->rotate_bytes) alog_rotate(log);
+    return count;
+}
+
+static inline int alog_ring_empty(AsyncLog* log) {
+    AlogSlot* slot = &log->slots[log->dequeue_pos & (ALOG_SLOTS - 1)];
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log->dequeue_pos + 1;
+}
+
+static inline void* alog_thread(void* arg) {
+    AsyncLog* log = (AsyncLog*)arg;
+    AlogPrefix prefixes[2];
+    memset(prefixes, 0, sizeof(prefixes));
+    prefixes[0].second = prefixes[1].second = UINT64_MAX;
+    int current = 0;
+
+    for (;;) {
+        while (alog_flush_batch(log, prefixes, &current) > 0) {
+        }
+        if (__atomic_load_n(&log->stop, __ATOMIC_ACQUIRE)) {
+            if (alog_ring_empty(log)) break;
+            continue;
+        }
+
+        // Announce the sleep, then re-check so a record enqueued in between
+        // is not left waiting for the next one
+        __atomic_store_n(&log->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!alog_ring_empty(log) || __atomic_load_n(&log->stop, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&log->sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        struct pollfd pfd = { log->wake_fd, POLLIN, 0 };
+        poll(&pfd, 1, -1);
+        uint64_t wakeups;
+        ssize_t n = read(log->wake_fd, &wakeups, sizeof(wakeups));
+        (void)n;
+    }
+    return NULL;
+}
+
+static inline void alog_wake(AsyncLog* log) {
+    if (__atomic_load_n(&log->sleeping, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&log->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        ssize_t n = write(log->wake_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * alog_open
+ * * Starts the writer thread. `path` NULL or "" logs to stdout; otherwise the
+ * file is appended to and rotated once it reaches `rotate_bytes` (0: never),
+ * keeping `keep` old files. Returns 0, or -1 if the file cannot be opened.
+ */
+static inline int alog_open(const char* path, const char* source, int binary, size_t rotate_bytes, int keep) {
+    AsyncLog* log = &alog_state;
+    memset(log, 0, sizeof(*log));
+    for (uint64_t i = 0; i < ALOG_SLOTS; i++) log->slots[i].seq = i;
+    snprintf(log->source, sizeof(log->source), "%s", source);
+    snprintf(log->path, sizeof(log->path), "%s", path ? path : "");
+    log->binary = binary;
+    log->rotate_bytes = rotate_bytes;
+    log->keep = keep;
+    if (alog_open_file(log) != 0) return -1;
+
+    log->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (log->wake_fd < 0 || pthread_create(&log->thread, NULL, alog_thread, log) != 0) {
+        if (log->wake_fd >= 0) close(log->wake_fd);
+        if (log->fd != STDOUT_FILENO) close(log->fd);
+        return -1;
+    }
+    log->running = 1;
+    return 0;
+}
+
+// Queues one line (without newline); an empty line is written without a
+// prefix. Before alog_open() the line is written synchronously to stdout, so
+// early messages are not lost.
+static inline void alog_write(const char* msg, size_t len) {
+    AsyncLog* log = &alog_state;
+    if (len > ALOG_MSG_MAX) len = ALOG_MSG_MAX;
+    if (!log->running) {
+        if (len == 0) {
+            fputc('\n', stdout);
+            return;
+        }
+        AlogPrefix p;
+        alog_prefix_for(&p, log->source[0] ? log->source : "LOG", alog_now_us());
+        fprintf(stdout, "%s%.*s\n", p.text, (int)len, msg);
+        fflush(stdout);
+        return;
+    }
+
+    uint64_t pos = __atomic_load_n(&log->enqueue_pos, __ATOMIC_RELAXED);
+    AlogSlot* slot;
+    for (;;) {
+        slot = &log->slots[pos & (ALOG_SLOTS - 1)];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&log->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);   // Full: never wait for the writer
+            return;
+        } else {
+            pos = __atomic_load_n(&log->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->rec.time_us = alog_now_us();
+    slot->rec.len = (uint32_t)len;
+    memcpy(slot->msg, msg, len);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    alog_wake(log);
+}
+
+static inline void alog_vprintf(const char* fmt, va_list ap) {
+    char msg[ALOG_MSG_MAX + 1];
+    int n = vsnprintf(msg, sizeof(msg), fmt, ap);
+    if (n < 0) return;
+    alog_write(msg, (size_t)n < sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
+}
+
+static inline void alog_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static inline void alog_printf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    alog_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+static inline uint64_t alog_dropped(void) {
+    return __atomic_load_n(&alog_state.dropped, __ATOMIC_RELAXED);
+}
+
+// Drains everything queued, stops the writer and closes the file
+static inline void alog_close(void) {
+    AsyncLog* log = &alog_state;
+    if (!log->running) return;
+    __atomic_store_n(&log->stop, 1, __ATOMIC_SEQ_CST);
+    uint64_t one = 1;
+    ssize_t n = write(log->wake_fd, &one, sizeof(one));
+    (void)n;
+    pthread_join(log->thread, NULL);
+    log->running = 0;
+    close(log->wake_fd);
+    if (log->fd != STDOUT_FILENO && log->fd != STDERR_FILENO) close(log->fd);
+}
+
+#endif /* ASYNC_LOG_H */
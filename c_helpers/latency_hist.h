@@ -0,0 +1,143 @@
+/*
+ * latency_hist.h
+ * * Lock-free latency histograms for the SSH hot paths of the CLI and monitor.
+ *
+ * Buckets are HDR-style log-linear: values below 16 us get one bucket each,
+ * and every power of two above that is split into 16 linear sub-buckets, so
+ * any recorded value is off by at most 1/16 (6.25%) from its bucket bound.
+ * 608 buckets cover 1 us to 2^41 us (~25 days) in under 5 KB per histogram.
+ *
+ * Recording is three relaxed atomic adds plus a CAS loop for the maximum, so
+ * it is safe from any thread (fleet workers, the pool's keepalive thread)
+ * without a lock and cheap enough to leave on. Readers take a relaxed copy;
+ * a percentile may miss samples recorded while it is being computed, which
+ * is fine for monitoring.
+ */
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40            // Largest power of two with its own sub-buckets
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct {
+    const char* name;              // Phase label: "handshake", "channel_open", ...
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} LatencyHist;
+
+// Static initializer: LatencyHist stat_auth = HIST_INIT("auth");
+#define HIST_INIT(label) { label, { 0 }, 0, 0, 0 }
+
+static inline uint64_t hist_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static inline int hist_bucket(uint64_t us) {
+    if (us < HIST_SUB_BUCKETS) return (int)us;
+    int exp = 63 - __builtin_clzll(us);
+    if (exp > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int sub = (int)((us >> (exp - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+    return HIST_SUB_BUCKETS + (exp - HIST_SUB_BITS) * HIST_SUB_BUCKETS + sub;
+}
+
+// Largest value that falls into bucket `b`
+static inline uint64_t hist_bucket_upper(int b) {
+    if (b < HIST_SUB_BUCKETS) return (uint64_t)b;
+    int shift = (b - HIST_SUB_BUCKETS) / HIST_SUB_BUCKETS;
+    int sub = (b - HIST_SUB_BUCKETS) % HIST_SUB_BUCKETS;
+    return ((uint64_t)(HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+static inline void hist_record(LatencyHist* h, uint64_t us) {
+    __atomic_fetch_add(&h->counts[hist_bucket(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_us, us, __ATOMIC_RELAXED);
+    uint64_t prev = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    while (us > prev &&
+           !__atomic_compare_exchange_n(&h->max_us, &prev, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Records the time elapsed since `start_us` (from hist_now_us())
+static inline void hist_record_since(LatencyHist* h, uint64_t start_us) {
+    hist_record(h, hist_now_us() - start_us);
+}
+
+/*
+ * hist_percentile
+ * * Returns the upper bound of the bucket holding the `pct` percentile
+ * (nearest rank), capped at the recorded maximum. 0 if nothing was recorded.
+ */
+static inline uint64_t hist_percentile(const LatencyHist* h, double pct) {
+    uint64_t total = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) total += __atomic_load_n(&h->counts[b], __ATOMIC_RELAXED);
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)total + 0.999999);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    uint64_t max_us = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += __atomic_load_n(&h->counts[b], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t upper = hist_bucket_upper(b);
+            return upper < max_us ? upper : max_us;
+        }
+    }
+    return max_us;
+}
+
+// Human-readable table, one row per phase (milliseconds)
+static inline void hist_write_table(FILE* out, LatencyHist* const* hists, int n) {
+    fprintf(out, "%-16s %8s %10s %10s %10s %10s %10s\n",
+            "Phase", "Count", "Avg ms", "p50 ms", "p90 ms", "p99 ms", "Max ms");
+    for (int i = 0; i < n; i++) {
+        const LatencyHist* h = hists[i];
+        uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        uint64_t sum = __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED);
+        if (count == 0) {
+            fprintf(out, "%-16s %8d %10s %10s %10s %10s %10s\n", h->name, 0, "-", "-", "-", "-", "-");
+            continue;
+        }
+        fprintf(out, "%-16s %8llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", h->name,
+                (unsigned long long)count, sum / 1000.0 / count,
+                hist_percentile(h, 50) / 1000.0, hist_percentile(h, 90) / 1000.0,
+                hist_percentile(h, 99) / 1000.0,
+                __atomic_load_n(&h->max_us, __ATOMIC_RELAXED) / 1000.0);
+    }
+}
+
+/*
+ * hist_write_prometheus
+ * * Prometheus text exposition: one summary `metric` with a `phase` label per
+ * histogram and 0.5/0.9/0.99/0.999 quantiles, in seconds.
+ */
+static inline void hist_write_prometheus(FILE* out, const char* metric, const char* help,
+                                         LatencyHist* const* hists, int n) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    fprintf(out, "# HELP %s %s\n", metric, help);
+    fprintf(out, "# TYPE %s summary\n", metric);
+    for (int i = 0; i < n; i++) {
+        const LatencyHist* h = hists[i];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(out, "%s{phase=\"%s\",quantile=\"%g\"} %.6f\n", metric, h->name, quantiles[q],
+                    hist_percentile(h, quantiles[q] * 100) / 1e6);
+        }
+        fprintf(out, "%s_sum{phase=\"%s\"} %.6f\n", metric, h->name,
+                __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED) / 1e6);
+        fprintf(out, "%s_count{phase=\"%s\"} %llu\n", metric, h->name,
+                (unsigned long long)__atomic_load_n(&h->count, __ATOMIC_RELAXED));
+    }
+}
+
+#endif /* LATENCY_HIST_H */
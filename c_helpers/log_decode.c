@@ -0,0 +1,68 @@
+/*
+ * log_decode.c
+ * * Prints binary logs written by async_log.h (--log-binary) as text, in the
+ * same form the text mode writes, with millisecond timestamps.
+ *
+ * Build: gcc c_helpers/log_decode.c -o c_helpers/log_decode -pthread
+ * Usage: log_decode [FILE]...      (no FILE or '-': stdin)
+ *
+ * Rotated files decode independently; pass them oldest first
+ * (log_decode router_monitor.log.2 router_monitor.log.1 router_monitor.log).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "async_log.h"
+
+int decode(FILE* in, const char* label) {
+    AlogFileHeader h;
+    if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, ALOG_MAGIC, 4) != 0) {
+        fprintf(stderr, "log_decode: %s: not a binary log\n", label);
+        return 1;
+    }
+    if (h.version != ALOG_VERSION) {
+        fprintf(stderr, "log_decode: %s: unsupported version %u\n", label, h.version);
+        return 1;
+    }
+    char source[ALOG_SOURCE_LEN + 1];
+    memcpy(source, h.source, ALOG_SOURCE_LEN);
+    source[ALOG_SOURCE_LEN] = '\0';
+
+    AlogRecord rec;
+    char msg[ALOG_MSG_MAX];
+    time_t last = (time_t)-1;
+    char stamp[24] = "";
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        if (rec.len > ALOG_MSG_MAX || fread(msg, 1, rec.len, in) != rec.len) {
+            fprintf(stderr, "log_decode: %s: truncated record\n", label);
+            return 1;
+        }
+        time_t second = (time_t)(rec.time_us / 1000000u);
+        if (second != last) {
+            struct tm tm;
+            localtime_r(&second, &tm);
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+            last = second;
+        }
+        printf("[%s.%03u] [%s] %.*s\n", stamp, (unsigned)(rec.time_us / 1000u % 1000u),
+               source, (int)rec.len, msg);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return decode(stdin, "<stdin>");
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE* in = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+        if (!in) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        status |= decode(in, in == stdin ? "<stdin>" : argv[i]);
+        if (in != stdin) fclose(in);
+    }
+    return status;
+}
@@ -0,0 +1,128 @@
+/*
+ * md5.h
+ * * MD5 (RFC 1321), so the CLI can compare local files with the router's
+ * `md5sum` output without downloading them. Used to detect change, not for
+ * security.
+ */
+#ifndef MD5_H
+#define MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;               // Bytes hashed so far
+    unsigned char buffer[64];
+} Md5;
+
+static inline uint32_t md5_rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline void md5_block(Md5* m, const unsigned char* p) {
+    static const uint32_t K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+    };
+    static const int R[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+    };
+
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[i * 4] | (uint32_t)p[i * 4 + 1] << 8 |
+               (uint32_t)p[i * 4 + 2] << 16 | (uint32_t)p[i * 4 + 3] << 24;
+    }
+
+    uint32_t a = m->state[0], b = m->state[1], c = m->state[2], d = m->state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t next = d;
+        d = c;
+        c = b;
+        b = b + md5_rotl(a + f + K[i] + w[g], R[i]);
+        a = next;
+    }
+    m->state[0] += a;
+    m->state[1] += b;
+    m->state[2] += c;
+    m->state[3] += d;
+}
+
+static inline void md5_init(Md5* m) {
+    m->state[0] = 0x67452301;
+    m->state[1] = 0xefcdab89;
+    m->state[2] = 0x98badcfe;
+    m->state[3] = 0x10325476;
+    m->length = 0;
+}
+
+static inline void md5_update(Md5* m, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    size_t have = (size_t)(m->length % 64);
+    m->length += len;
+    if (have) {
+        size_t take = 64 - have < len ? 64 - have : len;
+        memcpy(m->buffer + have, p, take);
+        p += take;
+        len -= take;
+        if (have + take < 64) return;
+        md5_block(m, m->buffer);
+    }
+    for (; len >= 64; p += 64, len -= 64) md5_block(m, p);
+    memcpy(m->buffer, p, len);
+}
+
+// Writes the digest as 32 lowercase hex digits plus a NUL, like md5sum
+static inline void md5_final_hex(Md5* m, char out[33]) {
+    static const unsigned char pad[64] = { 0x80 };
+    uint64_t bits = m->length * 8;
+    size_t have = (size_t)(m->length % 64);
+    md5_update(m, pad, have < 56 ? 56 - have : 120 - have);
+    unsigned char tail[8];
+    for (int i = 0; i < 8; i++) tail[i] = (unsigned char)(bits >> (8 * i));
+    md5_update(m, tail, 8);
+
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        unsigned char byte = (unsigned char)(m->state[i / 4] >> (8 * (i % 4)));
+        out[i * 2] = hex[byte >> 4];
+        out[i * 2 + 1] = hex[byte & 15];
+    }
+    out[32] = '\0';
+}
+
+// md5sum of one buffer
+static inline void md5_hex(const void* data, size_t len, char out[33]) {
+    Md5 m;
+    md5_init(&m);
+    md5_update(&m, data, len);
+    md5_final_hex(&m, out);
+}
+
+#endif /* MD5_H */
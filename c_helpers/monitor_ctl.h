@@ -0,0 +1,170 @@
+/*
+ * monitor_ctl.h
+ * * Control protocol between the CLIs and router_monitor.
+ *
+ * router_monitor listens on a Unix-domain stream socket. A client connects,
+ * writes one request line, and reads back one reply:
+ *
+ *     request:  <VERB> [arguments]\n
+ *     reply:    OK <length>\n<length bytes of payload>
+ *           or  ERR <message>\n
+ *
+ * One request per connection keeps the monitor's event loop simple: it
+ * accepts, answers and closes without tracking per-client state.
+ */
+#ifndef MONITOR_CTL_H
+#define MONITOR_CTL_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define MONITOR_SOCKET_PATH "state/monitor.sock"
+#define MONITOR_TIMEOUT_MS 15000   // A refresh may include an SSH reconnect
+
+/* Request verbs */
+#define MONITOR_REQ_REFRESH "REFRESH"                        // Fetch everything, log deltas
+#define MONITOR_REQ_REFRESH_INTERFACES "REFRESH_INTERFACES"  // Fetch interfaces only
+#define MONITOR_REQ_CONFIG "CONFIG"        // CONFIG router_ip=.. router_port=.. username=.. password=..
+                                           // (values percent-encoded, see monitor_encode_value)
+#define MONITOR_REQ_INTERFACES "INTERFACES" // Last `ip address show` output (fetched if none yet)
+#define MONITOR_REQ_SNAPSHOT "SNAPSHOT"     // Parsed state as STATE lines
+#define MONITOR_REQ_STATS "STATS"           // SSH latency table (see latency_hist.h)
+#define MONITOR_REQ_TELEMETRY "TELEMETRY"   // TELEMETRY [samples=N] [iface=NAME]: interface rate history
+
+/*
+ * monitor_encode_value / monitor_decode_value
+ * * CONFIG values are percent-encoded so that a password may contain spaces,
+ * '=' or '%' without splitting or adding fields. Everything but letters,
+ * digits and "-._~:/@" becomes %XX.
+ * encode returns 0, or -1 if `out` is too small (3 * strlen(in) + 1 always fits).
+ * decode works in place and returns 0 on a bad or %00 escape.
+ */
+static inline int monitor_encode_value(const char* in, char* out, size_t out_size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for (; *in; in++) {
+        unsigned char c = (unsigned char)*in;
+        int plain = isalnum(c) || strchr("-._~:/@", c) != NULL;
+        if (n + (plain ? 1 : 3) >= out_size) return -1;
+        if (plain) {
+            out[n++] = (char)c;
+        } else {
+            out[n++] = '%';
+            out[n++] = hex[c >> 4];
+            out[n++] = hex[c & 15];
+        }
+    }
+    if (n >= out_size) return -1;
+    out[n] = '\0';
+    return 0;
+}
+
+static inline int monitor_decode_value(char* s) {
+    char* out = s;
+    for (; *s; s++) {
+        if (*s != '%') {
+            *out++ = *s;
+            continue;
+        }
+        if (!isxdigit((unsigned char)s[1]) || !isxdigit((unsigned char)s[2])) return 0;
+        char hex[3] = { s[1], s[2], '\0' };
+        long c = strtol(hex, NULL, 16);
+        if (c == 0) return 0;
+        *out++ = (char)c;
+        s += 2;
+    }
+    *out = '\0';
+    return 1;
+}
+
+/*
+ * monitor_request
+ * * Sends `request` (without trailing newline) and waits for the reply.
+ * On OK or ERR, *reply receives a malloc'd NUL-terminated payload or error
+ * message (caller frees) and *reply_len its length.
+ * Returns 0 on OK, 1 on ERR, -1 if the monitor is not reachable.
+ */
+static int monitor_request(const char* request, char** reply, size_t* reply_len) {
+    *reply = NULL;
+    *reply_len = 0;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, MONITOR_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = MONITOR_TIMEOUT_MS / 1000;
+    tv.tv_usec = (MONITOR_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    size_t req_len = strlen(request);
+    if (write(fd, request, req_len) != (ssize_t)req_len || write(fd, "\n", 1) != 1) {
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // Read the whole reply; the monitor closes the connection when done
+    size_t cap = 4096, len = 0;
+    char* buf = (char*)malloc(cap);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    ssize_t n;
+    while ((n = read(fd, buf + len, cap - len - 1)) > 0) {
+        len += n;
+        if (cap - len < 1024) {
+            char* bigger = (char*)realloc(buf, cap * 2);
+            if (!bigger) break;
+            buf = bigger;
+            cap *= 2;
+        }
+    }
+    close(fd);
+    buf[len] = '\0';
+
+    char* header_end = strchr(buf, '\n');
+    if (!header_end) {
+        free(buf);
+        return -1;
+    }
+
+    int status;
+    size_t payload_start = header_end - buf + 1;
+    size_t payload_len;
+    if (strncmp(buf, "OK ", 3) == 0) {
+        status = 0;
+        payload_len = strtoul(buf + 3, NULL, 10);
+        if (payload_len > len - payload_start) payload_len = len - payload_start;
+    } else if (strncmp(buf, "ERR ", 4) == 0) {
+        status = 1;
+        payload_start = 4;
+        payload_len = header_end - buf - 4;
+    } else {
+        free(buf);
+        return -1;
+    }
+
+    memmove(buf, buf + payload_start, payload_len);
+    buf[payload_len] = '\0';
+    *reply = buf;
+    *reply_len = payload_len;
+    return status;
+}
+
+#endif /* MONITOR_CTL_H */
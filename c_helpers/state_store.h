@@ -0,0 +1,426 @@
+/*
+ * state_store.h
+ * * Versioned binary store for the local state the CLIs and the monitor
+ * share: config keys (router_ip, hostname, enable_secret_hash, ...),
+ * interfaces and static routes. It replaces router_cli.conf, router.conf,
+ * interfaces.conf and routes.conf, which were rewritten with sed/grep on
+ * every change and re-parsed line by line on every read.
+ *
+ * The file is one fixed layout that readers mmap read-only:
+ *
+ *   StateHeader | StateConfig[STATE_CONFIG_SLOTS] | StateIface[STATE_MAX_IFACES] | StateRoute[route_count]
+ *
+ * Config keys sit in an open-addressed hash table and interfaces in a fixed
+ * array, so a read is a hash and a compare or two, with no parsing.
+ *
+ * Writers never touch the mapped file. state_begin() takes an exclusive
+ * flock on "<path>.lock" and copies the current state; state_commit() writes
+ * the new image to a temporary file, fsyncs it and renames it over the old
+ * one. Readers see the old state or the new one, never a half-written file,
+ * and concurrent writers are serialized instead of losing each other's
+ * edits. state_refresh() remaps once the file has been replaced.
+ *
+ * c_helpers/state_tool.c converts to and from a text form for inspection.
+ */
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STATE_DB_PATH "state/state.db"
+#define STATE_MAGIC 0x31545352u        // "RST1"
+#define STATE_VERSION 1                // Bump when the layout changes
+#define STATE_KEY_LEN 32               // Including the terminating NUL
+#define STATE_VALUE_LEN 128
+#define STATE_CONFIG_SLOTS 64          // Power of two
+#define STATE_MAX_IFACES 64
+#define STATE_IFNAME_LEN 16            // IFNAMSIZ
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;              // sizeof(StateHeader) of the writer
+    uint64_t generation;               // Incremented by every commit
+    uint32_t config_count;
+    uint32_t iface_count;
+    uint32_t route_count;
+    uint32_t reserved;
+} StateHeader;
+
+typedef struct {
+    char key[STATE_KEY_LEN];           // "" marks a free slot
+    char value[STATE_VALUE_LEN];
+} StateConfig;
+
+typedef struct {
+    char name[STATE_IFNAME_LEN];
+    uint32_t addr;                     // Host byte order, 0 = no address
+    uint32_t mask;
+    uint32_t up;
+} StateIface;
+
+typedef struct {
+    uint32_t dest;                     // Host byte order
+    uint32_t mask;
+    uint32_t gateway;
+} StateRoute;
+
+#define STATE_CONFIG_OFFSET sizeof(StateHeader)
+#define STATE_IFACE_OFFSET (STATE_CONFIG_OFFSET + STATE_CONFIG_SLOTS * sizeof(StateConfig))
+#define STATE_ROUTE_OFFSET (STATE_IFACE_OFFSET + STATE_MAX_IFACES * sizeof(StateIface))
+#define STATE_SIZE(routes) (STATE_ROUTE_OFFSET + (size_t)(routes) * sizeof(StateRoute))
+
+#define STATE_CONFIGS(h) ((StateConfig*)((char*)(h) + STATE_CONFIG_OFFSET))
+#define STATE_IFACES(h) ((StateIface*)((char*)(h) + STATE_IFACE_OFFSET))
+#define STATE_ROUTES(h) ((StateRoute*)((char*)(h) + STATE_ROUTE_OFFSET))
+
+static inline int state_valid(const void* data, size_t size) {
+    const StateHeader* h = (const StateHeader*)data;
+    return size >= STATE_ROUTE_OFFSET && h->magic == STATE_MAGIC && h->version == STATE_VERSION &&
+           h->header_size == sizeof(StateHeader) && h->config_count <= STATE_CONFIG_SLOTS &&
+           h->iface_count <= STATE_MAX_IFACES && size >= STATE_SIZE(h->route_count);
+}
+
+// FNV-1a
+static inline uint32_t state_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding `key`, or the free slot where it would go (-1 if full)
+static inline int state_config_slot(const StateHeader* h, const char* key) {
+    const StateConfig* slots = STATE_CONFIGS(h);
+    uint32_t s = state_hash(key) & (STATE_CONFIG_SLOTS - 1);
+    for (int i = 0; i < STATE_CONFIG_SLOTS; i++, s = (s + 1) & (STATE_CONFIG_SLOTS - 1)) {
+        if (!slots[s].key[0] || strncmp(slots[s].key, key, STATE_KEY_LEN) == 0) return (int)s;
+    }
+    return -1;
+}
+
+// Value of a config key, or NULL
+static inline const char* state_get(const StateHeader* h, const char* key) {
+    if (!h) return NULL;
+    int s = state_config_slot(h, key);
+    return s >= 0 && STATE_CONFIGS(h)[s].key[0] ? STATE_CONFIGS(h)[s].value : NULL;
+}
+
+static inline const StateIface* state_iface(const StateHeader* h, const char* name) {
+    if (!h) return NULL;
+    for (uint32_t i = 0; i < h->iface_count; i++) {
+        if (strncmp(STATE_IFACES(h)[i].name, name, STATE_IFNAME_LEN) == 0) return &STATE_IFACES(h)[i];
+    }
+    return NULL;
+}
+
+static inline int state_parse_ipv4(const char* s, uint32_t* out) {
+    struct in_addr a;
+    if (inet_pton(AF_INET, s, &a) != 1) return 0;
+    *out = ntohl(a.s_addr);
+    return 1;
+}
+
+static inline const char* state_format_ipv4(uint32_t addr, char buf[INET_ADDRSTRLEN]) {
+    struct in_addr a;
+    a.s_addr = htonl(addr);
+    return inet_ntop(AF_INET, &a, buf, INET_ADDRSTRLEN);
+}
+
+/*
+ * Readers
+ */
+typedef struct {
+    const StateHeader* hdr;            // NULL while the store is missing or unreadable
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+} StateStore;
+
+static inline void state_close(StateStore* st) {
+    if (st->hdr) munmap((void*)st->hdr, st->size);
+    memset(st, 0, sizeof(*st));
+}
+
+// Maps `path` if it was replaced since the last call. Returns 1 if the
+// mapping changed (including the store appearing or going away).
+static inline int state_refresh(StateStore* st, const char* path) {
+    struct stat sb;
+    if (stat(path, &sb) != 0) {
+        if (!st->hdr) return 0;
+        state_close(st);
+        return 1;
+    }
+    if (st->hdr && sb.st_dev == st->dev && sb.st_ino == st->ino) return 0;
+    state_close(st);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 1;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+        map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    if (!state_valid(map, (size_t)sb.st_size)) {
+        munmap(map, (size_t)sb.st_size);
+        return 1;
+    }
+    st->hdr = (const StateHeader*)map;
+    st->size = (size_t)sb.st_size;
+    st->dev = sb.st_dev;
+    st->ino = sb.st_ino;
+    return 1;
+}
+
+static inline int state_open(StateStore* st, const char* path) {
+    memset(st, 0, sizeof(*st));
+    state_refresh(st, path);
+    return st->hdr != NULL;
+}
+
+/*
+ * Writers
+ */
+typedef struct {
+    StateHeader* hdr;                  // Private, writable copy of the state
+    uint32_t route_cap;
+    int lock_fd;
+    char path[PATH_MAX];
+} StateTxn;
+
+static inline void state_abort(StateTxn* tx) {
+    free(tx->hdr);
+    tx->hdr = NULL;
+    if (tx->lock_fd >= 0) close(tx->lock_fd);   // Releases the flock
+    tx->lock_fd = -1;
+}
+
+// Locks the store and copies its state. Fails (EINVAL) rather than start
+// over when the file exists but is corrupt or from another version.
+static inline int state_begin(StateTxn* tx, const char* path) {
+    memset(tx, 0, sizeof(*tx));
+    tx->lock_fd = -1;
+    char lock_path[PATH_MAX];
+    if (snprintf(tx->path, sizeof(tx->path), "%s", path) >= (int)sizeof(tx->path) ||
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", path) >= (int)sizeof(lock_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    tx->lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (tx->lock_fd < 0) return -1;
+    if (flock(tx->lock_fd, LOCK_EX) != 0) {
+        state_abort(tx);
+        return -1;
+    }
+
+    StateStore cur;
+    struct stat sb;
+    if (!state_open(&cur, path) && stat(path, &sb) == 0) {
+        state_abort(tx);
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t routes = cur.hdr ? cur.hdr->route_count : 0;
+    tx->route_cap = routes < 64 ? 64 : routes;
+    tx->hdr = (StateHeader*)calloc(1, STATE_SIZE(tx->route_cap));
+    if (tx->hdr && cur.hdr) memcpy(tx->hdr, cur.hdr, STATE_SIZE(routes));
+    state_close(&cur);
+    if (!tx->hdr) {
+        state_abort(tx);
+        errno = ENOMEM;
+        return -1;
+    }
+    tx->hdr->magic = STATE_MAGIC;
+    tx->hdr->version = STATE_VERSION;
+    tx->hdr->header_size = sizeof(StateHeader);
+    return 0;
+}
+
+// Empties the copy (for a full import)
+static inline void state_clear(StateTxn* tx) {
+    uint64_t generation = tx->hdr->generation;
+    memset((char*)tx->hdr + sizeof(StateHeader), 0, STATE_SIZE(tx->hdr->route_count) - sizeof(StateHeader));
+    tx->hdr->generation = generation;
+    tx->hdr->config_count = tx->hdr->iface_count = tx->hdr->route_count = 0;
+}
+
+// Returns -1 (EINVAL) if the key or value is too long, (ENOSPC) if the table is full
+static inline int state_set(StateTxn* tx, const char* key, const char* value) {
+    if (!key[0] || strlen(key) >= STATE_KEY_LEN || strlen(value) >= STATE_VALUE_LEN) {
+        errno = EINVAL;
+        return -1;
+    }
+    int s = state_config_slot(tx->hdr, key);
+    StateConfig* slots = STATE_CONFIGS(tx->hdr);
+    if (s < 0 || (!slots[s].key[0] && tx->hdr->config_count >= STATE_CONFIG_SLOTS * 3 / 4)) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (!slots[s].key[0]) {
+        snprintf(slots[s].key, STATE_KEY_LEN, "%s", key);
+        tx->hdr->config_count++;
+    }
+    snprintf(slots[s].value, STATE_VALUE_LEN, "%s", value);
+    return 0;
+}
+
+// Removes a key; the table is rebuilt so no probe chain is broken
+static inline void state_unset(StateTxn* tx, const char* key) {
+    StateConfig* slots = STATE_CONFIGS(tx->hdr);
+    int s = state_config_slot(tx->hdr, key);
+    if (s < 0 || !slots[s].key[0]) return;
+    memset(&slots[s], 0, sizeof(slots[s]));
+
+    StateConfig saved[STATE_CONFIG_SLOTS];
+    memcpy(saved, slots, sizeof(saved));
+    memset(slots, 0, sizeof(saved));
+    tx->hdr->config_count = 0;
+    for (int i = 0; i < STATE_CONFIG_SLOTS; i++) {
+        if (saved[i].key[0]) state_set(tx, saved[i].key, saved[i].value);
+    }
+}
+
+// The interface record for `name`, created (down, no address) if missing.
+// NULL if the name is too long or the table is full.
+static inline StateIface* state_iface_edit(StateTxn* tx, const char* name) {
+    StateIface* found = (StateIface*)state_iface(tx->hdr, name);
+    if (found) return found;
+    if (!name[0] || strlen(name) >= STATE_IFNAME_LEN || tx->hdr->iface_count >= STATE_MAX_IFACES) {
+        errno = strlen(name) >= STATE_IFNAME_LEN ? EINVAL : ENOSPC;
+        return NULL;
+    }
+    StateIface* rec = &STATE_IFACES(tx->hdr)[tx->hdr->iface_count++];
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->name, STATE_IFNAME_LEN, "%s", name);
+    return rec;
+}
+
+// Adds a route, or changes the gateway of the route with the same dest/mask
+static inline int state_add_route(StateTxn* tx, uint32_t dest, uint32_t mask, uint32_t gateway) {
+    StateRoute* routes = STATE_ROUTES(tx->hdr);
+    for (uint32_t i = 0; i < tx->hdr->route_count; i++) {
+        if (routes[i].dest == dest && routes[i].mask == mask) {
+            routes[i].gateway = gateway;
+            return 0;
+        }
+    }
+    if (tx->hdr->route_count == tx->route_cap) {
+        uint32_t cap = tx->route_cap * 2;
+        StateHeader* grown = (StateHeader*)realloc(tx->hdr, STATE_SIZE(cap));
+        if (!grown) {
+            errno = ENOMEM;
+            return -1;
+        }
+        tx->hdr = grown;
+        tx->route_cap = cap;
+    }
+    StateRoute* r = &STATE_ROUTES(tx->hdr)[tx->hdr->route_count++];
+    r->dest = dest;
+    r->mask = mask;
+    r->gateway = gateway;
+    return 0;
+}
+
+// Returns -1 (ENOENT) if there is no such route
+static inline int state_del_route(StateTxn* tx, uint32_t dest, uint32_t mask) {
+    StateRoute* routes = STATE_ROUTES(tx->hdr);
+    for (uint32_t i = 0; i < tx->hdr->route_count; i++) {
+        if (routes[i].dest == dest && routes[i].mask == mask) {
+            memmove(&routes[i], &routes[i + 1], (tx->hdr->route_count - i - 1) * sizeof(StateRoute));
+            tx->hdr->route_count--;
+            return 0;
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+// Writes the new image next to the store and renames it into place, then
+// releases the lock. On failure the store is left as it was.
+static inline int state_commit(StateTxn* tx) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%d", tx->path, (int)getpid()) >= (int)sizeof(tmp)) {
+        state_abort(tx);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    tx->hdr->generation++;
+
+    int rc = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        const char* p = (const char*)tx->hdr;
+        size_t left = STATE_SIZE(tx->hdr->route_count);
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            p += n;
+            left -= (size_t)n;
+        }
+        if (left == 0 && fsync(fd) == 0 && close(fd) == 0) {
+            fd = -1;
+            rc = rename(tmp, tx->path);
+        }
+        if (fd >= 0) close(fd);
+        if (rc != 0) unlink(tmp);
+    }
+    int saved = errno;
+    state_abort(tx);
+    errno = saved;
+    return rc;
+}
+
+/*
+ * Text form
+ * * "[config]" key=value lines, "[interfaces]" name,ip,mask,up|down lines
+ * and "[routes]" dest,mask,gateway lines: the old .conf formats under
+ * section headers. Config keys are sorted so exports diff cleanly.
+ */
+static inline int state_config_cmp(const void* a, const void* b) {
+    return strcmp(((const StateConfig*)a)->key, ((const StateConfig*)b)->key);
+}
+
+static inline void state_export(const StateHeader* h, FILE* out) {
+    char a[INET_ADDRSTRLEN], m[INET_ADDRSTRLEN], g[INET_ADDRSTRLEN];
+    fprintf(out, "# state v%u, generation %llu\n", (unsigned)h->version, (unsigned long long)h->generation);
+
+    StateConfig sorted[STATE_CONFIG_SLOTS];
+    int n = 0;
+    for (int i = 0; i < STATE_CONFIG_SLOTS; i++) {
+        if (STATE_CONFIGS(h)[i].key[0]) sorted[n++] = STATE_CONFIGS(h)[i];
+    }
+    qsort(sorted, n, sizeof(StateConfig), state_config_cmp);
+    fprintf(out, "[config]\n");
+    for (int i = 0; i < n; i++) fprintf(out, "%s=%s\n", sorted[i].key, sorted[i].value);
+
+    fprintf(out, "[interfaces]\n");
+    for (uint32_t i = 0; i < h->iface_count; i++) {
+        const StateIface* f = &STATE_IFACES(h)[i];
+        fprintf(out, "%s,%s,%s,%s\n", f->name, f->addr ? state_format_ipv4(f->addr, a) : "",
+                f->addr ? state_format_ipv4(f->mask, m) : "", f->up ? "up" : "down");
+    }
+
+    fprintf(out, "[routes]\n");
+    for (uint32_t i = 0; i < h->route_count; i++) {
+        const StateRoute* r = &STATE_ROUTES(h)[i];
+        fprintf(out, "%s,%s,%s\n", state_format_ipv4(r->dest, a), state_format_ipv4(r->mask, m),
+                state_format_ipv4(r->gateway, g));
+    }
+}
+
+#endif /* STATE_STORE_H */
@@ -0,0 +1,281 @@
+/*
+ * state_tool.c
+ * * Command-line access to the binary state store (state_store.h), for the
+ * Bash CLI and for inspecting or hand-editing the state.
+ *
+ * Build: gcc c_helpers/state_tool.c -o c_helpers/state_tool
+ * Usage: state_tool [-f DB] export
+ *        state_tool [-f DB] import [FILE]      replace everything with a text dump ('-' or none: stdin)
+ *        state_tool [-f DB] migrate [DIR]      import the old .conf files in DIR (default state)
+ *        state_tool [-f DB] get KEY
+ *        state_tool [-f DB] set KEY VALUE [KEY VALUE]...
+ *        state_tool [-f DB] unset KEY...
+ *        state_tool [-f DB] iface NAME [IP MASK] [up|down]
+ *        state_tool [-f DB] route add|del DEST MASK [GATEWAY]
+ *
+ * Every write is one transaction: it is either committed whole or not at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "state_store.h"
+
+const char* db_path = STATE_DB_PATH;
+
+enum Section { SECTION_NONE, SECTION_CONFIG, SECTION_INTERFACES, SECTION_ROUTES };
+
+int fail(const char* what) {
+    fprintf(stderr, "state_tool: %s: %s\n", what, strerror(errno));
+    return 1;
+}
+
+// Splits a comma-separated line in place; returns the number of fields
+int split_fields(char* line, char** fields, int max) {
+    int n = 0;
+    for (char* p = line; n < max; ) {
+        fields[n++] = p;
+        p = strchr(p, ',');
+        if (!p) break;
+        *p++ = '\0';
+    }
+    return n;
+}
+
+// Applies one line of `section` to the transaction; returns 0 or -1
+int import_line(StateTxn* tx, enum Section section, char* line) {
+    char* fields[4];
+    uint32_t dest, mask, gateway;
+
+    switch (section) {
+        case SECTION_CONFIG: {
+            char* eq = strchr(line, '=');
+            if (!eq) return -1;
+            *eq = '\0';
+            return state_set(tx, line, eq + 1);
+        }
+        case SECTION_INTERFACES: {
+            // name,ip,mask,state; ip and mask may be empty ("eth0,,,")
+            int n = split_fields(line, fields, 4);
+            StateIface* f = state_iface_edit(tx, fields[0]);
+            if (!f) return -1;
+            f->addr = f->mask = 0;
+            if (n >= 3 && fields[1][0] && (!state_parse_ipv4(fields[1], &f->addr) ||
+                                            !state_parse_ipv4(fields[2], &f->mask))) {
+                return -1;
+            }
+            f->up = n == 4 && strcmp(fields[3], "up") == 0;
+            return 0;
+        }
+        case SECTION_ROUTES:
+            if (split_fields(line, fields, 3) != 3 || !state_parse_ipv4(fields[0], &dest) ||
+                !state_parse_ipv4(fields[1], &mask) || !state_parse_ipv4(fields[2], &gateway)) {
+                return -1;
+            }
+            return state_add_route(tx, dest, mask, gateway);
+        default:
+            return -1;
+    }
+}
+
+// Reads text from `in` into the transaction. `section` is the section lines
+// belong to before the first header (the old .conf files have none).
+int import_stream(StateTxn* tx, FILE* in, const char* label, enum Section section) {
+    char line[512];
+    int number = 0, errors = 0;
+    while (fgets(line, sizeof(line), in)) {
+        number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char* text = line;
+        while (*text == ' ' || *text == '\t') text++;
+        if (!*text || *text == '#') continue;
+
+        if (strcmp(text, "[config]") == 0) section = SECTION_CONFIG;
+        else if (strcmp(text, "[interfaces]") == 0) section = SECTION_INTERFACES;
+        else if (strcmp(text, "[routes]") == 0) section = SECTION_ROUTES;
+        else if (import_line(tx, section, text) != 0) {
+            fprintf(stderr, "state_tool: %s:%d: cannot import '%s'\n", label, number, line);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int cmd_export(void) {
+    StateStore st;
+    if (!state_open(&st, db_path)) {
+        fprintf(stderr, "state_tool: %s: missing or not a version %d store\n", db_path, STATE_VERSION);
+        return 1;
+    }
+    state_export(st.hdr, stdout);
+    state_close(&st);
+    return 0;
+}
+
+int cmd_get(const char* key) {
+    StateStore st;
+    state_open(&st, db_path);
+    const char* value = state_get(st.hdr, key);
+    if (value) printf("%s\n", value);
+    state_close(&st);
+    return value ? 0 : 1;
+}
+
+int cmd_import(const char* path) {
+    FILE* in = (!path || strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (!in) return fail(path);
+
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    state_clear(&tx);
+    int errors = import_stream(&tx, in, in == stdin ? "<stdin>" : path, SECTION_NONE);
+    if (in != stdin) fclose(in);
+    if (errors) {
+        state_abort(&tx);
+        fprintf(stderr, "state_tool: %d error(s); %s left unchanged\n", errors, db_path);
+        return 1;
+    }
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+// One-time conversion of the text files the store replaces
+int cmd_migrate(const char* dir) {
+    static const struct { const char* file; enum Section section; } legacy[] = {
+        { "router.conf", SECTION_CONFIG },
+        { "router_cli.conf", SECTION_CONFIG },
+        { "interfaces.conf", SECTION_INTERFACES },
+        { "routes.conf", SECTION_ROUTES },
+    };
+
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    int errors = 0;
+    for (size_t i = 0; i < sizeof(legacy) / sizeof(legacy[0]); i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, legacy[i].file);
+        FILE* in = fopen(path, "r");
+        if (!in) continue;
+        errors += import_stream(&tx, in, path, legacy[i].section);
+        fclose(in);
+    }
+    if (errors) fprintf(stderr, "state_tool: skipped %d unreadable line(s)\n", errors);
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+int cmd_set(int argc, char** argv) {
+    if (argc == 0 || argc % 2) {
+        fprintf(stderr, "state_tool: set needs KEY VALUE pairs\n");
+        return 1;
+    }
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    for (int i = 0; i < argc; i += 2) {
+        if (state_set(&tx, argv[i], argv[i + 1]) != 0) {
+            state_abort(&tx);
+            return fail(argv[i]);
+        }
+    }
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+int cmd_unset(int argc, char** argv) {
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    for (int i = 0; i < argc; i++) state_unset(&tx, argv[i]);
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+// iface NAME [IP MASK] [up|down]
+int cmd_iface(int argc, char** argv) {
+    if (argc < 1 || argc > 4) {
+        fprintf(stderr, "state_tool: iface NAME [IP MASK] [up|down]\n");
+        return 1;
+    }
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    StateIface* f = state_iface_edit(&tx, argv[0]);
+    if (!f) {
+        state_abort(&tx);
+        return fail(argv[0]);
+    }
+
+    int i = 1;
+    if (argc - i >= 2) {
+        if (!state_parse_ipv4(argv[i], &f->addr) || !state_parse_ipv4(argv[i + 1], &f->mask)) {
+            state_abort(&tx);
+            fprintf(stderr, "state_tool: invalid address or mask\n");
+            return 1;
+        }
+        i += 2;
+    }
+    if (i < argc) {
+        if (strcmp(argv[i], "up") != 0 && strcmp(argv[i], "down") != 0) {
+            state_abort(&tx);
+            fprintf(stderr, "state_tool: expected up or down, got '%s'\n", argv[i]);
+            return 1;
+        }
+        f->up = strcmp(argv[i], "up") == 0;
+    }
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+// route add|del DEST MASK [GATEWAY]
+int cmd_route(int argc, char** argv) {
+    int add = argc == 4 && strcmp(argv[0], "add") == 0;
+    int del = argc == 3 && strcmp(argv[0], "del") == 0;
+    uint32_t dest, mask, gateway = 0;
+    if ((!add && !del) || !state_parse_ipv4(argv[1], &dest) || !state_parse_ipv4(argv[2], &mask) ||
+        (add && !state_parse_ipv4(argv[3], &gateway))) {
+        fprintf(stderr, "state_tool: route add DEST MASK GATEWAY | route del DEST MASK\n");
+        return 1;
+    }
+
+    StateTxn tx;
+    if (state_begin(&tx, db_path) != 0) return fail(db_path);
+    if (add ? state_add_route(&tx, dest, mask, gateway) != 0 : state_del_route(&tx, dest, mask) != 0) {
+        state_abort(&tx);
+        if (del && errno == ENOENT) {
+            fprintf(stderr, "state_tool: no route to %s %s\n", argv[1], argv[2]);
+            return 1;
+        }
+        return fail("route");
+    }
+    return state_commit(&tx) == 0 ? 0 : fail(db_path);
+}
+
+void usage(void) {
+    fprintf(stderr,
+            "Usage: state_tool [-f DB] export\n"
+            "       state_tool [-f DB] import [FILE]\n"
+            "       state_tool [-f DB] migrate [DIR]\n"
+            "       state_tool [-f DB] get KEY\n"
+            "       state_tool [-f DB] set KEY VALUE [KEY VALUE]...\n"
+            "       state_tool [-f DB] unset KEY...\n"
+            "       state_tool [-f DB] iface NAME [IP MASK] [up|down]\n"
+            "       state_tool [-f DB] route add|del DEST MASK [GATEWAY]\n");
+}
+
+int main(int argc, char** argv) {
+    int i = 1;
+    if (i + 1 < argc && strcmp(argv[i], "-f") == 0) {
+        db_path = argv[i + 1];
+        i += 2;
+    }
+    if (i >= argc) {
+        usage();
+        return 1;
+    }
+
+    const char* cmd = argv[i++];
+    int rest = argc - i;
+    if (strcmp(cmd, "export") == 0 && rest == 0) return cmd_export();
+    if (strcmp(cmd, "import") == 0 && rest <= 1) return cmd_import(rest ? argv[i] : NULL);
+    if (strcmp(cmd, "migrate") == 0 && rest <= 1) return cmd_migrate(rest ? argv[i] : "state");
+    if (strcmp(cmd, "get") == 0 && rest == 1) return cmd_get(argv[i]);
+    if (strcmp(cmd, "set") == 0) return cmd_set(rest, argv + i);
+    if (strcmp(cmd, "unset") == 0 && rest >= 1) return cmd_unset(rest, argv + i);
+    if (strcmp(cmd, "iface") == 0) return cmd_iface(rest, argv + i);
+    if (strcmp(cmd, "route") == 0 && rest >= 1) return cmd_route(rest, argv + i);
+    usage();
+    return 1;
+}
@@ -8,6 +8,21 @@ mkdir -p state
 touch state/router.log
 rm -f state/signal.flag
 
+# Settings, interfaces and routes live in state/state.db (utils/storage.sh)
+source utils/storage.sh
+if [ ! -x "$STATE_TOOL" ] || [ "c_helpers/state_tool.c" -nt "$STATE_TOOL" ]; then
+  echo "[INFO] Compiling state_tool..."
+  if ! gcc c_helpers/state_tool.c -o "$STATE_TOOL"; then
+    echo "Fatal: Could not compile state_tool."
+    exit 1
+  fi
+fi
+
+# First start on state.db: import router.conf, interfaces.conf and routes.conf
+if [ ! -f "$STATE_DB" ]; then
+  "$STATE_TOOL" -f "$STATE_DB" migrate state
+fi
+
 # Start C signal handler once
 ./c_helpers/signal_handler &
 SIGNAL_PID=$!
@@ -1,4 +1,5 @@
 source utils/prompt.sh
+source utils/storage.sh
 source utils/logger.sh
 
 while true; do
@@ -9,21 +10,19 @@ while true; do
   print_prompt
   read -r cmd a b c
 
-  IF_ESC="${CURRENT_IF//\//\\/}"
-
   case "$cmd" in
     ip)
       [[ "$a" == "address" ]] || { echo "% Invalid command"; continue; }
-      sed -i "/^${IF_ESC},/c\\${CURRENT_IF},${b},${c},down" state/interfaces.conf
+      set_interface_status "$CURRENT_IF" "$b" "$c" down || continue
       log "Interface $CURRENT_IF IP set to $b $c"
       ;;
     shutdown)
-      sed -i "/^${IF_ESC},/s/up/down/" state/interfaces.conf
+      set_interface_status "$CURRENT_IF" "" "" down
       log "Interface $CURRENT_IF shutdown"
       ;;
     no)
       [[ "$a" == "shutdown" ]] || { echo "% Invalid command"; continue; }
-      sed -i "/^${IF_ESC},/s/down/up/" state/interfaces.conf
+      set_interface_status "$CURRENT_IF" "" "" up
       log "Interface $CURRENT_IF enabled"
       ;;
     exit)
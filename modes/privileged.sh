@@ -1,4 +1,5 @@
 source utils/prompt.sh
+source utils/storage.sh
 source utils/logger.sh
 
 while true; do
@@ -29,13 +30,9 @@ while true; do
       ;;
     show)
       if [[ "$a" == "running-config" ]]; then
-        cat state/router.conf
-        echo "!"
-        cat state/interfaces.conf
-        echo "!"
-        cat state/routes.conf
+        show_running_config
       elif [[ "$a" == "ip" && "$b" == "route" ]]; then
-        cat state/routes.conf
+        show_routes
       else
         echo "% Invalid command"
       fi
@@ -1,4 +1,5 @@
 source utils/prompt.sh
+source utils/storage.sh
 source utils/logger.sh
 
 while true; do
@@ -6,29 +6,42 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include "c_helpers/arena.h"
 
 // Configuration
 #define ROUTER_IP "192.168.1.2"
 #define ROUTER_PORT 22
 #define USERNAME "root"
 #define PASSWORD "root"
-#define MAX_COMMANDS 1000
-#define MAX_COMMAND_LEN 512
-#define MAX_TOKENS 50
-#define MAX_TOKEN_LEN 256
-#define MAX_HOSTNAME_LEN 256
-#define MAX_INTERFACE_LEN 64
 
 // Global SSH state
 int sock = -1;
 LIBSSH2_SESSION* session = NULL;
 bool mock_mode = false;
 
-// Command buffer for "apply"
-char pending_commands[MAX_COMMANDS][MAX_COMMAND_LEN];
+// Command buffer for "apply": a list of length-prefixed commands in
+// pending_arena, freed in one step after apply (see c_helpers/arena.h)
+typedef struct PendingCommand {
+    struct PendingCommand* next;
+    size_t len;
+    const char* text;
+} PendingCommand;
+
+Arena pending_arena = ARENA_INIT;
+PendingCommand* pending_head = NULL;
+PendingCommand** pending_tail = &pending_head;
 int pending_count = 0;
 
+// One word of the input line: NUL-terminated in place in the line buffer
+typedef struct {
+    char* s;
+    size_t len;
+} Token;
+
+Arena line_arena = ARENA_INIT;   // Token array of the current line, reset per line
+
 typedef enum {
     MODE_USER,
     MODE_PRIVILEGED,
@@ -37,8 +50,8 @@ typedef enum {
 } Mode;
 
 Mode current_mode = MODE_USER;
-char current_interface[MAX_INTERFACE_LEN] = "";
-char hostname[MAX_HOSTNAME_LEN] = "Router";
+char* current_interface = NULL;   // malloc'd; NULL outside interface mode
+char* hostname = NULL;            // malloc'd in main()
 
 // --- SSH Helper Functions ---
 
@@ -137,38 +150,84 @@ void print_prompt() {
     fflush(stdout);
 }
 
-int split_command(const char* line, char tokens[][MAX_TOKEN_LEN]) {
-    int count = 0;
-    char* line_copy = strdup(line);
-    char* token = strtok(line_copy, " \t\n");
-    
-    while (token && count < MAX_TOKENS) {
-        strncpy(tokens[count], token, MAX_TOKEN_LEN - 1);
-        tokens[count][MAX_TOKEN_LEN - 1] = '\0';
-        count++;
-        token = strtok(NULL, " \t\n");
+/*
+ * split_command
+ * * Splits `line` into words in place: each word is NUL-terminated where it
+ * ends and returned as a pointer + length into the line, nothing is copied.
+ * The token array comes from line_arena, sized for the worst case of one
+ * word per two bytes, so there is no word limit.
+ */
+Token* split_command(char* line, size_t len, int* count) {
+    Token* tokens = arena_alloc(&line_arena, (len / 2 + 1) * sizeof(Token));
+    *count = 0;
+    if (!tokens) return NULL;
+
+    char* p = line;
+    char* end = line + len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+        if (p == end) break;
+        char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+        tokens[*count].s = start;
+        tokens[*count].len = p - start;
+        (*count)++;
+        if (p < end) *p++ = '\0';
     }
-    
-    free(line_copy);
-    return count;
+    return tokens;
+}
+
+bool token_is(const Token* t, const char* word) {
+    size_t len = strlen(word);
+    return t->len == len && memcmp(t->s, word, len) == 0;
+}
+
+// Replaces a malloc'd string with a copy of `t`
+void set_string(char** dst, const Token* t) {
+    char* copy = realloc(*dst, t->len + 1);
+    if (!copy) return;
+    memcpy(copy, t->s, t->len + 1);
+    *dst = copy;
 }
 
-void add_pending_command(const char* command) {
-    if (pending_count < MAX_COMMANDS) {
-        strncpy(pending_commands[pending_count], command, MAX_COMMAND_LEN - 1);
-        pending_commands[pending_count][MAX_COMMAND_LEN - 1] = '\0';
-        pending_count++;
+// Queues a printf-formatted command, formatted straight into pending_arena
+void add_pending_command(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void add_pending_command(const char* fmt, ...) {
+    PendingCommand* cmd = arena_alloc(&pending_arena, sizeof(PendingCommand));
+    if (!cmd) {
+        fprintf(stderr, "%% Out of memory; command not queued\n");
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    cmd->text = arena_vprintf(&pending_arena, &cmd->len, fmt, ap);
+    va_end(ap);
+    if (!cmd->text) {
+        fprintf(stderr, "%% Out of memory; command not queued\n");
+        return;
     }
+    cmd->next = NULL;
+    *pending_tail = cmd;
+    pending_tail = &cmd->next;
+    pending_count++;
+}
+
+// Drops the whole queue in one step
+void clear_pending_commands(void) {
+    arena_reset(&pending_arena);
+    pending_head = NULL;
+    pending_tail = &pending_head;
+    pending_count = 0;
 }
 
 // --- Mode Handlers ---
 
-void handle_user_mode(char tokens[][MAX_TOKEN_LEN], int token_count) {
-    if (strcmp(tokens[0], "enable") == 0) {
+void handle_user_mode(Token* tokens, int token_count) {
+    if (token_is(&tokens[0], "enable")) {
         // Simulating simple auth or no auth for now as per shell scripts
         current_mode = MODE_PRIVILEGED;
         printf("%% Entered privileged mode\n");
-    } else if (strcmp(tokens[0], "exit") == 0) {
+    } else if (token_is(&tokens[0], "exit")) {
         printf("Bye!\n");
         cleanup_ssh();
         exit(0);
@@ -177,94 +236,97 @@ void handle_user_mode(char tokens[][MAX_TOKEN_LEN], int token_count) {
     }
 }
 
-void handle_privileged_mode(char tokens[][MAX_TOKEN_LEN], int token_count) {
-    if (strcmp(tokens[0], "disable") == 0) {
+void handle_privileged_mode(Token* tokens, int token_count) {
+    if (token_is(&tokens[0], "disable")) {
         current_mode = MODE_USER;
         printf("%% Returned to user mode\n");
-    } else if (strcmp(tokens[0], "configure") == 0 || strcmp(tokens[0], "conf") == 0) {
-        if (token_count > 1 && (strcmp(tokens[1], "terminal") == 0 || strcmp(tokens[1], "t") == 0)) {
+    } else if (token_is(&tokens[0], "configure") || token_is(&tokens[0], "conf")) {
+        if (token_count > 1 && (token_is(&tokens[1], "terminal") || token_is(&tokens[1], "t"))) {
             current_mode = MODE_CONFIG;
             printf("%% Entered config mode\n");
         } else {
             printf("%% Invalid command\n");
         }
-    } else if (strcmp(tokens[0], "show") == 0) {
-        if (token_count > 1 && strcmp(tokens[1], "running-config") == 0) {
+    } else if (token_is(&tokens[0], "show")) {
+        if (token_count > 1 && token_is(&tokens[1], "running-config")) {
             // In a real scenario, we might dump local state or fetch from router
             printf("! Pending commands:\n");
-            for (int i = 0; i < pending_count; i++) {
-                printf("%s\n", pending_commands[i]);
+            for (const PendingCommand* cmd = pending_head; cmd; cmd = cmd->next) {
+                fwrite(cmd->text, 1, cmd->len, stdout);
+                putchar('\n');
             }
-        } else if (token_count >= 3 && strcmp(tokens[1], "ip") == 0 && strcmp(tokens[2], "route") == 0) {
+        } else if (token_count >= 3 && token_is(&tokens[1], "ip") && token_is(&tokens[2], "route")) {
              execute_remote_command("ip route show");
         } else {
             printf("%% Invalid command\n");
         }
-    } else if (strcmp(tokens[0], "apply") == 0) {
+    } else if (token_is(&tokens[0], "apply")) {
         if (pending_count == 0) {
             printf("%% No changes to apply\n");
         } else {
             printf("Applying %d commands...\n", pending_count);
-            for (int i = 0; i < pending_count; i++) {
-                execute_remote_command(pending_commands[i]);
+            for (const PendingCommand* cmd = pending_head; cmd; cmd = cmd->next) {
+                execute_remote_command(cmd->text);
             }
-            pending_count = 0;
+            clear_pending_commands();
         }
-    } else if (strcmp(tokens[0], "exit") == 0) {
+    } else if (token_is(&tokens[0], "exit")) {
         current_mode = MODE_USER;
     } else {
         printf("%% Unknown command\n");
     }
 }
 
-void handle_config_mode(char tokens[][MAX_TOKEN_LEN], int token_count) {
-    if (strcmp(tokens[0], "hostname") == 0 && token_count > 1) {
-        strncpy(hostname, tokens[1], MAX_HOSTNAME_LEN - 1);
-        hostname[MAX_HOSTNAME_LEN - 1] = '\0';
+void handle_config_mode(Token* tokens, int token_count) {
+    if (token_is(&tokens[0], "hostname") && token_count > 1) {
+        set_string(&hostname, &tokens[1]);
         // OpenWrt: uci set system.@system[0].hostname='hostname'; uci commit
-        char cmd[MAX_COMMAND_LEN];
-        snprintf(cmd, sizeof(cmd), "uci set system.@system[0].hostname='%s'", hostname);
-        add_pending_command(cmd);
+        add_pending_command("uci set system.@system[0].hostname='%s'", hostname);
         add_pending_command("uci commit system");
         add_pending_command("/etc/init.d/system reload"); // Apply hostname
-    } else if (strcmp(tokens[0], "interface") == 0 && token_count > 1) {
-        strncpy(current_interface, tokens[1], MAX_INTERFACE_LEN - 1);
-        current_interface[MAX_INTERFACE_LEN - 1] = '\0';
+    } else if (token_is(&tokens[0], "interface") && token_count > 1) {
+        set_string(&current_interface, &tokens[1]);
         current_mode = MODE_INTERFACE;
-    } else if (strcmp(tokens[0], "ip") == 0 && token_count >= 5 && strcmp(tokens[1], "route") == 0) {
-        // ip route <net> <mask?> <gateway> -- simplifying to: ip route add <net> via <gateway>
-        // Simple mapping: keys off tokens. 
+    } else if (token_is(&tokens[0], "ip") && token_count >= 5 && token_is(&tokens[1], "route")) {
+        // ip route <net> <mask> <gateway> -> ip route add <net>/<len> via <gateway>
         // Example: ip route 192.168.2.0 255.255.255.0 192.168.1.1
         // Linux: ip route add 192.168.2.0/24 via 192.168.1.1
-        // For simplicity, passing raw tokens or doing basic translation
-        char route_cmd[MAX_COMMAND_LEN];
-        snprintf(route_cmd, sizeof(route_cmd), "ip route add %s via %s", tokens[2], tokens[4]);
-        add_pending_command(route_cmd);
-    } else if (strcmp(tokens[0], "exit") == 0) {
+        struct in_addr net, mask, gw;
+        if (inet_pton(AF_INET, tokens[2].s, &net) != 1 || inet_pton(AF_INET, tokens[3].s, &mask) != 1 ||
+            inet_pton(AF_INET, tokens[4].s, &gw) != 1) {
+            printf("%% Usage: ip route <network> <mask> <gateway>\n");
+            return;
+        }
+        uint32_t bits = ntohl(mask.s_addr);
+        if ((bits & (~bits >> 1)) != 0) {
+            printf("%% Invalid netmask '%s'\n", tokens[3].s);
+            return;
+        }
+        if (ntohl(net.s_addr) & ~bits) {
+            printf("%% Network %s has host bits set for mask %s\n", tokens[2].s, tokens[3].s);
+            return;
+        }
+        add_pending_command("ip route add %s/%d via %s", tokens[2].s, __builtin_popcount(bits), tokens[4].s);
+    } else if (token_is(&tokens[0], "exit")) {
         current_mode = MODE_PRIVILEGED;
     } else {
         printf("%% Unknown command\n");
     }
 }
 
-void handle_interface_mode(char tokens[][MAX_TOKEN_LEN], int token_count) {
-    if (strcmp(tokens[0], "ip") == 0 && token_count >= 4 && strcmp(tokens[1], "address") == 0) {
+void handle_interface_mode(Token* tokens, int token_count) {
+    if (token_is(&tokens[0], "ip") && token_count >= 4 && token_is(&tokens[1], "address")) {
         // ip address <ip> <mask>
         // Linux: ifconfig <iface> <ip> netmask <mask> up
-        char cmd[MAX_COMMAND_LEN];
-        snprintf(cmd, sizeof(cmd), "ifconfig %s %s netmask %s up", current_interface, tokens[2], tokens[3]);
-        add_pending_command(cmd);
-    } else if (strcmp(tokens[0], "shutdown") == 0) {
-        char cmd[MAX_COMMAND_LEN];
-        snprintf(cmd, sizeof(cmd), "ifconfig %s down", current_interface);
-        add_pending_command(cmd);
-    } else if (strcmp(tokens[0], "no") == 0 && token_count > 1 && strcmp(tokens[1], "shutdown") == 0) {
-        char cmd[MAX_COMMAND_LEN];
-        snprintf(cmd, sizeof(cmd), "ifconfig %s up", current_interface);
-        add_pending_command(cmd);
-    } else if (strcmp(tokens[0], "exit") == 0) {
+        add_pending_command("ifconfig %s %s netmask %s up", current_interface, tokens[2].s, tokens[3].s);
+    } else if (token_is(&tokens[0], "shutdown")) {
+        add_pending_command("ifconfig %s down", current_interface);
+    } else if (token_is(&tokens[0], "no") && token_count > 1 && token_is(&tokens[1], "shutdown")) {
+        add_pending_command("ifconfig %s up", current_interface);
+    } else if (token_is(&tokens[0], "exit")) {
         current_mode = MODE_CONFIG;
-        current_interface[0] = '\0';
+        free(current_interface);
+        current_interface = NULL;
     } else {
         printf("%% Unknown command\n");
     }
@@ -283,22 +345,20 @@ int main(int argc, char** argv) {
         }
     }
 
-    char line[1024];
-    char tokens[MAX_TOKENS][MAX_TOKEN_LEN];
-    
+    hostname = strdup("Router");
+
+    // getline() grows the line buffer as needed and reuses it
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+
     while (true) {
         print_prompt();
-        if (!fgets(line, sizeof(line), stdin)) break;
-        
-        // Remove newline if present
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        if (strlen(line) == 0) continue;
+        if ((len = getline(&line, &line_cap, stdin)) < 0) break;
 
-        int token_count = split_command(line, tokens);
+        arena_reset(&line_arena);
+        int token_count;
+        Token* tokens = split_command(line, (size_t)len, &token_count);
         if (token_count == 0) continue;
 
         switch (current_mode) {
@@ -317,6 +377,9 @@ int main(int argc, char** argv) {
         }
     }
 
+    free(line);
+    arena_free(&line_arena);
+    arena_free(&pending_arena);
     cleanup_ssh();
     return 0;
 }
\ No newline at end of file
@@ -1,26 +1,84 @@
 #include <libssh2.h>
+#include <libssh2_sftp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <iomanip>
+#include <charconv>
+#include <memory>
+#include <regex>
+#include <zlib.h>
 
-// Configuration
+#include "c_helpers/monitor_ctl.h"
+#include "c_helpers/latency_hist.h"
+#include "c_helpers/state_store.h"
+#include "c_helpers/async_log.h"
+#include "c_helpers/md5.h"
+
+// Configuration (defaults; override with --host/--port/--user/--password)
 #define ROUTER_IP "192.168.1.2"
 #define ROUTER_PORT 22
 #define USERNAME "root"
 #define PASSWORD "root"
 
-// Global SSH state
-int sock = -1;
-LIBSSH2_SESSION* session = nullptr;
+// SSH session pool tuning
+#define SSH_POOL_SIZE 2             // Authenticated sessions kept per router
+#define SSH_KEEPALIVE_INTERVAL 15   // Seconds between keepalives on idle sessions
+#define SSH_RECONNECT_ATTEMPTS 4    // Connect attempts before giving up
+#define SSH_BACKOFF_MS 200          // First retry delay, doubled on each attempt
+#define SSH_TIMEOUT_MS 10000        // Upper bound for TCP connect and blocking libssh2 calls
+#define EXEC_MAX_CHANNELS 8         // Channels the executor keeps open at once on one session
+
+// Fleet mode
+#define FLEET_WORKERS 16            // Routers configured in parallel
+#define FLEET_PER_HOST_LIMIT 1      // Concurrent sessions to the same address (NAT'd boxes share one)
+
+// Show result cache
+#define SHOW_CACHE_TTL 30           // Seconds a show result is reused (--cache-ttl N, 0 disables)
+#define SHOW_CACHE_MAX_BYTES (1024 * 1024)  // Larger results are streamed but not cached
+
 bool mock_mode = false;
 
+// One router the CLI can talk to
+struct RouterTarget {
+    std::string name;
+    std::string host;
+    int port = ROUTER_PORT;
+    std::string username = USERNAME;
+    std::string password = PASSWORD;
+};
+
+RouterTarget router_target = {"router", ROUTER_IP, ROUTER_PORT, USERNAME, PASSWORD};
+
+// Fleet mode: `apply` pushes the queue to every router in the inventory
+bool fleet_mode = false;
+std::vector<RouterTarget> fleet;
+
 // Command buffer for "apply"
 std::vector<std::string> pending_commands;
 
@@ -28,246 +86,4707 @@ enum Mode {
     MODE_USER,
     MODE_PRIVILEGED,
     MODE_CONFIG,
-    MODE_INTERFACE
+    MODE_INTERFACE,
+    MODE_WIRELESS
 };
 
 Mode current_mode = MODE_USER;
 std::string current_interface = "";
+std::string current_radio = "";          // Wireless mode: the wifi-device ...
+std::string current_wifi_iface = "";     // ... and the wifi-iface edited on it
 std::string hostname = "Router";
 
-// --- SSH Helper Functions ---
+// --- Latency Statistics ---
+//
+// Each SSH phase is timed into a lock-free histogram (c_helpers/latency_hist.h),
+// so fleet workers and the keepalive thread can record without contention.
+// Only successful phases are recorded. `show statistics` prints them next to
+// the monitor's own table.
 
-void execute_remote_command(const char* command) {
-    if (mock_mode) {
-        std::cout << "[SSH MOCK] Executing: " << command << std::endl;
-        return;
+LatencyHist stat_tcp_connect = HIST_INIT("tcp_connect");
+LatencyHist stat_handshake = HIST_INIT("handshake");
+LatencyHist stat_auth = HIST_INIT("auth");
+LatencyHist stat_channel_open = HIST_INIT("channel_open");
+LatencyHist stat_exec = HIST_INIT("exec");
+LatencyHist stat_read = HIST_INIT("read");
+LatencyHist stat_apply = HIST_INIT("apply");
+LatencyHist stat_show = HIST_INIT("show");
+LatencyHist stat_monitor_call = HIST_INIT("monitor_call");
+LatencyHist stat_sync = HIST_INIT("sync");
+LatencyHist stat_ubus_call = HIST_INIT("ubus_call");
+
+LatencyHist* const all_stats[] = {
+    &stat_tcp_connect, &stat_handshake, &stat_auth, &stat_channel_open, &stat_exec,
+    &stat_read, &stat_apply, &stat_show, &stat_monitor_call, &stat_sync, &stat_ubus_call,
+};
+
+// --- Apply Log ---
+//
+// Connects and per-command apply results go to state/router_cli.log (--log
+// FILE) through the async logger (c_helpers/async_log.h): the caller only
+// formats into a ring slot, so fleet workers never wait on the disk or on
+// each other. Logging is off if the file cannot be opened.
+
+#define CLI_LOG_PATH "state/router_cli.log"
+#define CLI_LOG_ROTATE_BYTES (4 * 1024 * 1024)
+#define CLI_LOG_KEEP 3
+
+void cli_log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void cli_log(const char* fmt, ...) {
+    if (!alog_state.running) return;
+    va_list ap;
+    va_start(ap, fmt);
+    alog_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+// --- SSH Session Pool ---
+//
+// Owns a small set of authenticated sessions to one router so show/apply
+// never pay for a TCP connect + key exchange + auth. Idle sessions get
+// libssh2 keepalives from a background thread; sessions whose socket has
+// died are closed and transparently re-established (with exponential
+// backoff) the next time they are handed out.
+
+// TCP connection to host:port, in blocking mode, or -1
+int tcp_connect(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    std::string port_str = std::to_string(port);
+    if (getaddrinfo(host.c_str(), port_str.c_str(), &hints, &res) != 0 || !res) {
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    // Non-blocking connect so an unreachable router costs SSH_TIMEOUT_MS, not minutes
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0 && errno == EINPROGRESS) {
+        pollfd pfd{fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, SSH_TIMEOUT_MS) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+            rc = 0;
+        }
+    }
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+    return fd;
+}
+
+struct PooledSession {
+    int sock = -1;
+    LIBSSH2_SESSION* session = nullptr;
+    bool in_use = false;
+};
+
+class SshSessionPool {
+public:
+    // Exclusive use of one pooled session; given back to the pool when it
+    // goes out of scope.
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(SshSessionPool* pool, PooledSession* slot) : pool_(pool), slot_(slot) {}
+        Lease(Lease&& other) noexcept : pool_(other.pool_), slot_(other.slot_) {
+            other.pool_ = nullptr;
+            other.slot_ = nullptr;
+        }
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                release();
+                pool_ = other.pool_;
+                slot_ = other.slot_;
+                other.pool_ = nullptr;
+                other.slot_ = nullptr;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { release(); }
+
+        explicit operator bool() const { return slot_ && slot_->session; }
+        LIBSSH2_SESSION* session() const { return slot_ ? slot_->session : nullptr; }
+        int socket() const { return slot_ ? slot_->sock : -1; }
+
+        // Opens a channel, reconnecting once if the session turns out to be dead.
+        LIBSSH2_CHANNEL* open_channel() {
+            if (!slot_) return nullptr;
+            if (slot_->session) {
+                LIBSSH2_CHANNEL* channel = libssh2_channel_open_session(slot_->session);
+                if (channel) return channel;
+            }
+            pool_->close_slot(*slot_);
+            if (!pool_->connect_slot(*slot_)) return nullptr;
+            return libssh2_channel_open_session(slot_->session);
+        }
+
+        // Drops the underlying connection; the next lease reconnects.
+        void mark_broken() {
+            if (slot_) pool_->close_slot(*slot_);
+        }
+
+    private:
+        void release() {
+            if (pool_ && slot_) pool_->release(*slot_);
+            pool_ = nullptr;
+            slot_ = nullptr;
+        }
+
+        SshSessionPool* pool_ = nullptr;
+        PooledSession* slot_ = nullptr;
+    };
+
+    SshSessionPool(const std::string& host, int port, const std::string& user, const std::string& password)
+        : host_(host), port_(port), user_(user), password_(password), slots_(SSH_POOL_SIZE) {}
+
+    ~SshSessionPool() { shutdown(); }
+
+    const std::string& host() const { return host_; }
+    int port() const { return port_; }
+
+    // Hands out an idle session, connecting or reconnecting one if needed.
+    // Returns an empty lease if the router cannot be reached.
+    Lease acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            PooledSession* idle_connected = nullptr;
+            PooledSession* idle_empty = nullptr;
+            for (auto& slot : slots_) {
+                if (slot.in_use) continue;
+                if (slot.session && !idle_connected) idle_connected = &slot;
+                if (!slot.session && !idle_empty) idle_empty = &slot;
+            }
+
+            PooledSession* slot = idle_connected ? idle_connected : idle_empty;
+            if (slot) {
+                slot->in_use = true;
+                lock.unlock();
+                if (slot->session && !socket_alive(slot->sock)) {
+                    close_slot(*slot);
+                }
+                if (!slot->session && !connect_slot(*slot)) {
+                    release(*slot);
+                    return Lease();
+                }
+                return Lease(this, slot);
+            }
+            slot_free_.wait(lock);
+        }
+    }
+
+    // Starts the background keepalive thread.
+    void start_keepalive() {
+        keepalive_thread_ = std::thread(&SshSessionPool::keepalive_loop, this);
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+            stopping_ = true;
+        }
+        keepalive_wake_.notify_all();
+        if (keepalive_thread_.joinable()) keepalive_thread_.join();
+        for (auto& slot : slots_) close_slot(slot);
+    }
+
+private:
+    friend class Lease;
+
+    void release(PooledSession& slot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot.in_use = false;
+        }
+        slot_free_.notify_one();
+    }
+
+    // A peer that closed the connection shows up as a readable socket with
+    // nothing to read, or as POLLHUP/POLLERR. Costs no round trip.
+    static bool socket_alive(int fd) {
+        if (fd < 0) return false;
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) < 0) return false;
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) return false;
+        if (pfd.revents & POLLIN) {
+            char c;
+            if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) return false;
+        }
+        return true;
+    }
+
+    int open_socket() { return tcp_connect(host_, port_); }
+
+    bool connect_once(PooledSession& slot) {
+        uint64_t start = hist_now_us();
+        slot.sock = open_socket();
+        if (slot.sock < 0) {
+            std::cerr << "% Failed to connect to " << host_ << "\n";
+            return false;
+        }
+        hist_record_since(&stat_tcp_connect, start);
+
+        start = hist_now_us();
+        slot.session = libssh2_session_init();
+        libssh2_session_set_timeout(slot.session, SSH_TIMEOUT_MS);
+        // zlib if the router offers it (bulk pushes, large shows); else none
+        libssh2_session_flag(slot.session, LIBSSH2_FLAG_COMPRESS, 1);
+        if (libssh2_session_handshake(slot.session, slot.sock)) {
+            std::cerr << "% SSH Handshake failed with " << host_ << "\n";
+            close_slot(slot);
+            return false;
+        }
+        hist_record_since(&stat_handshake, start);
+
+        start = hist_now_us();
+        if (libssh2_userauth_password(slot.session, user_.c_str(), password_.c_str())) {
+            std::cerr << "% Authentication failed on " << host_ << "\n";
+            close_slot(slot);
+            return false;
+        }
+        hist_record_since(&stat_auth, start);
+
+        libssh2_keepalive_config(slot.session, 1, SSH_KEEPALIVE_INTERVAL);
+        return true;
+    }
+
+    bool connect_slot(PooledSession& slot) {
+        int delay_ms = SSH_BACKOFF_MS;
+        for (int attempt = 1; attempt <= SSH_RECONNECT_ATTEMPTS; attempt++) {
+            if (connect_once(slot)) return true;
+            if (attempt == SSH_RECONNECT_ATTEMPTS) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+            delay_ms *= 2;
+        }
+        return false;
+    }
+
+    void close_slot(PooledSession& slot) {
+        if (slot.session) {
+            libssh2_session_disconnect(slot.session, "Client disconnecting");
+            libssh2_session_free(slot.session);
+            slot.session = nullptr;
+        }
+        if (slot.sock != -1) {
+            close(slot.sock);
+            slot.sock = -1;
+        }
+    }
+
+    void keepalive_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            keepalive_wake_.wait_for(lock, std::chrono::seconds(SSH_KEEPALIVE_INTERVAL));
+            if (stopping_) break;
+
+            for (auto& slot : slots_) {
+                if (slot.in_use || !slot.session) continue;
+                // Borrow the slot so nobody acquires it mid-keepalive
+                slot.in_use = true;
+                lock.unlock();
+                int next = 0;
+                if (!socket_alive(slot.sock) || libssh2_keepalive_send(slot.session, &next) != 0) {
+                    close_slot(slot);
+                }
+                lock.lock();
+                slot.in_use = false;
+            }
+            slot_free_.notify_all();
+        }
+    }
+
+    std::string host_;
+    int port_;
+    std::string user_;
+    std::string password_;
+    std::vector<PooledSession> slots_;   // Fixed size: leases keep pointers into it
+
+    std::mutex mutex_;
+    std::condition_variable slot_free_;
+    std::condition_variable keepalive_wake_;
+    std::thread keepalive_thread_;
+    bool stopping_ = false;
+};
+
+SshSessionPool* ssh_pool = nullptr;
+
+// --- Output Pipeline ---
+//
+// Show output passes through a chain of line stages on its way to the
+// terminal: `| include`, `| exclude` and `| begin` filters and a pager that
+// stops at a --More-- prompt every screen. While a show command runs,
+// std::cout is pointed at the pipeline, so local views and remote output are
+// handled alike. Remote output is read in PIPE_READ_BUFFER chunks and each
+// chunk goes through the stages before the next read: a multi-megabyte
+// `logread` starts printing at once, memory stays at one chunk plus the
+// longest line, and while the pager waits nothing is read, so the SSH window
+// holds the remote command back. Quitting the pager closes the channel.
+
+#define PIPE_READ_BUFFER (64 * 1024)   // Bytes per channel read
+#define PAGER_DEFAULT_LINES 24         // Screen height if the terminal does not report one
+
+// One step of the chain. Gets a complete line without its newline and
+// returns false once nothing more should be passed on.
+class OutputStage {
+public:
+    explicit OutputStage(OutputStage* next) : next_(next) {}
+    virtual ~OutputStage() = default;
+    virtual bool line(std::string_view text) = 0;
+
+protected:
+    OutputStage* next_;
+};
+
+// `| include`, `| exclude` and `| begin`. The pattern is a regular
+// expression as on IOS; plain text is matched with a substring search.
+class LineFilter : public OutputStage {
+public:
+    enum Kind { INCLUDE, EXCLUDE, BEGIN };
+
+    // Throws std::regex_error for a bad expression
+    LineFilter(Kind kind, const std::string& pattern, OutputStage* next)
+        : OutputStage(next), kind_(kind), pattern_(pattern),
+          literal_(pattern.find_first_of(".^$*+?()[]{}|\\") == std::string::npos) {
+        if (!literal_) regex_.assign(pattern, std::regex::extended | std::regex::optimize);
+    }
+
+    bool line(std::string_view text) override {
+        if (kind_ == BEGIN && begun_) return next_->line(text);
+        bool hit = literal_ ? text.find(pattern_) != std::string_view::npos
+                            : std::regex_search(text.begin(), text.end(), regex_);
+        if (kind_ == BEGIN) begun_ = hit;
+        if (hit == (kind_ != EXCLUDE)) return next_->line(text);
+        return true;
+    }
+
+private:
+    Kind kind_;
+    std::string pattern_;
+    bool literal_;
+    std::regex regex_;
+    bool begun_ = false;
+};
+
+// Last stage: writes to the real terminal, pausing every `page_lines`
+// lines (0: never)
+class TerminalSink : public OutputStage {
+public:
+    TerminalSink(std::streambuf* out, int page_lines) : OutputStage(nullptr), out_(out), page_lines_(page_lines) {}
+
+    bool line(std::string_view text) override {
+        if (page_lines_ > 0 && shown_ >= page_lines_) {
+            int key = more_prompt();
+            if (key == 'q' || key == 'Q' || key == 3) return false;
+            // Enter shows one more line, anything else a full page
+            shown_ = (key == '\n' || key == '\r') ? page_lines_ - 1 : 0;
+        }
+        out_->sputn(text.data(), text.size());
+        out_->sputc('\n');
+        shown_++;
+        return true;
+    }
+
+private:
+    int more_prompt() {
+        static const char prompt[] = " --More-- ";
+        out_->sputn(prompt, sizeof(prompt) - 1);
+        out_->pubsync();
+
+        termios saved;
+        char key = 'q';
+        if (tcgetattr(STDIN_FILENO, &saved) == 0) {
+            termios raw = saved;
+            raw.c_lflag &= ~(ICANON | ECHO | ISIG);   // Ctrl-C arrives as a key and quits
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+            if (read(STDIN_FILENO, &key, 1) != 1) key = 'q';
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+        }
+        static const char erase[] = "\r          \r";
+        out_->sputn(erase, sizeof(erase) - 1);
+        return (unsigned char)key;
+    }
+
+    std::streambuf* out_;
+    int page_lines_;
+    int shown_ = 0;
+};
+
+struct OutputModifier {
+    LineFilter::Kind kind;
+    std::string pattern;
+};
+
+// Splits what is written to it into lines and runs them through the stages.
+// A partial line is carried over to the next write.
+class OutputPipeline : public std::streambuf {
+public:
+    // Throws std::regex_error for a bad filter expression
+    OutputPipeline(std::streambuf* out, const std::vector<OutputModifier>& modifiers, int page_lines)
+        : out_(out) {
+        stages_.push_back(std::make_unique<TerminalSink>(out, page_lines));
+        for (auto it = modifiers.rbegin(); it != modifiers.rend(); ++it) {
+            stages_.push_back(std::make_unique<LineFilter>(it->kind, it->pattern, stages_.back().get()));
+        }
+        head_ = stages_.back().get();
+    }
+
+    // True once a stage (the pager) asked for no more output
+    bool stopped() const { return stopped_; }
+
+    // Passes on a last line that had no newline
+    void finish() {
+        if (!carry_.empty() && !stopped_) stopped_ = !head_->line(carry_);
+        carry_.clear();
+        out_->pubsync();
+    }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        feed(s, (size_t)n);
+        return n;   // Output after a stop is swallowed, never an error
+    }
+
+    int_type overflow(int_type ch) override {
+        if (ch != traits_type::eof()) {
+            char c = traits_type::to_char_type(ch);
+            feed(&c, 1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override { return out_->pubsync(); }
+
+private:
+    void feed(const char* data, size_t len) {
+        if (stopped_) return;
+        std::string_view rest(data, len);
+        while (!rest.empty()) {
+            size_t nl = rest.find('\n');
+            if (nl == std::string_view::npos) {
+                carry_.append(rest);
+                return;
+            }
+            std::string_view line = rest.substr(0, nl);
+            rest.remove_prefix(nl + 1);
+            if (!carry_.empty()) {
+                carry_.append(line);
+                stopped_ = !head_->line(carry_);
+                carry_.clear();
+            } else {
+                stopped_ = !head_->line(line);
+            }
+            if (stopped_) return;
+        }
+    }
+
+    std::streambuf* out_;
+    std::vector<std::unique_ptr<OutputStage>> stages_;   // Sink first, head last
+    OutputStage* head_;
+    std::string carry_;
+    bool stopped_ = false;
+};
+
+// Pipeline of the show command being run, if any
+OutputPipeline* active_output = nullptr;
+
+// Screen lines per page for interactive shows (`terminal length`, 0: no pager)
+int terminal_length = -1;   // -1: ask the terminal
+
+int pager_lines() {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return 0;
+    if (terminal_length >= 0) return terminal_length;
+    winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 1) return ws.ws_row - 1;
+    return PAGER_DEFAULT_LINES - 1;
+}
+
+// Points std::cout at a pipeline for the lifetime of the scope
+class OutputCapture {
+public:
+    OutputCapture(const std::vector<OutputModifier>& modifiers, int page_lines)
+        : pipeline_(std::cout.rdbuf(), modifiers, page_lines) {
+        saved_ = std::cout.rdbuf(&pipeline_);
+        active_output = &pipeline_;
+    }
+    ~OutputCapture() {
+        std::cout.flush();
+        pipeline_.finish();
+        std::cout.rdbuf(saved_);
+        active_output = nullptr;
     }
 
-    if (!session) {
+private:
+    OutputPipeline pipeline_;
+    std::streambuf* saved_;
+};
+
+// False once the user quit the pager; long producers should stop
+bool output_wanted() {
+    return !active_output || !active_output->stopped();
+}
+
+// --- SSH Helper Functions ---
+
+// Runs one command on a fresh channel from `pool`. If `input` is non-empty it is written
+// to the command's stdin before EOF is sent. Stdout is handed to `sink` chunk
+// by chunk as it arrives, from a reused PIPE_READ_BUFFER per thread; the next
+// chunk is not read until `sink` returns. If `sink` returns false the channel
+// is closed without reading the rest. Returns the remote exit status, or -1
+// if the command could not be started.
+int run_remote_streamed(SshSessionPool* pool, const char* command, const std::string& input,
+                        const std::function<bool(const char*, size_t)>& sink) {
+    auto lease = pool ? pool->acquire() : SshSessionPool::Lease();
+    if (!lease) {
         std::cerr << "% Not connected to router (SSH session null)\n";
-        return;
+        return -1;
     }
 
-    LIBSSH2_CHANNEL* channel = libssh2_channel_open_session(session);
+    uint64_t start = hist_now_us();
+    LIBSSH2_CHANNEL* channel = lease.open_channel();
     if (!channel) {
         std::cerr << "% Unable to open channel\n";
-        return;
+        return -1;
     }
+    hist_record_since(&stat_channel_open, start);
 
+    start = hist_now_us();
     int rc = libssh2_channel_exec(channel, command);
     if (rc != 0) {
          std::cerr << "% Execution failed: " << rc << "\n";
          libssh2_channel_free(channel);
-         return;
+         return -1;
     }
+    hist_record_since(&stat_exec, start);
 
-    char buffer[4096];
+    start = hist_now_us();
+    size_t written = 0;
+    while (written < input.size()) {
+        ssize_t w = libssh2_channel_write(channel, input.data() + written, input.size() - written);
+        if (w < 0) {
+            std::cerr << "% Error writing to channel\n";
+            break;
+        }
+        written += w;
+    }
+    if (!input.empty()) libssh2_channel_send_eof(channel);
+
+    static thread_local std::vector<char> buffer(PIPE_READ_BUFFER);
     ssize_t n;
-    while ((n = libssh2_channel_read(channel, buffer, sizeof(buffer))) > 0) {
-        std::cout.write(buffer, n);
+    bool stopped = false;
+    while ((n = libssh2_channel_read(channel, buffer.data(), buffer.size())) > 0) {
+        if (!sink(buffer.data(), n)) {
+            stopped = true;
+            break;
+        }
     }
-    
-    // Check for errors (libssh2 returns negative on error)
+    if (!stopped) {
+        while (libssh2_channel_read_stderr(channel, buffer.data(), buffer.size()) > 0) {}
+    }
+
     if (n < 0) {
          std::cerr << "% Error reading from channel\n";
     }
 
     libssh2_channel_close(channel);
+    libssh2_channel_wait_closed(channel);
+    int exit_status = libssh2_channel_get_exit_status(channel);
     libssh2_channel_free(channel);
+    if (n == 0) hist_record_since(&stat_read, start);
+    return exit_status;
 }
 
-bool connect_ssh() {
-    if (mock_mode) return true;
+// run_remote_streamed() collecting the output: appended to `output`
+int run_remote_captured(SshSessionPool* pool, const char* command, const std::string& input, std::string& output) {
+    return run_remote_streamed(pool, command, input, [&](const char* data, size_t len) {
+        output.append(data, len);
+        return true;
+    });
+}
 
-    libssh2_init(0);
-    sock = socket(AF_INET, SOCK_STREAM, 0);
+// Prints a command's output as it arrives (through the active pipeline).
+// Returns the exit status as run_remote_streamed().
+int execute_remote_command(const char* command) {
+    if (mock_mode) {
+        std::cout << "[SSH MOCK] Executing: " << command << std::endl;
+        return 0;
+    }
 
-    sockaddr_in sin{};
-    sin.sin_family = AF_INET;
-    sin.sin_port = htons(ROUTER_PORT);
-    inet_pton(AF_INET, ROUTER_IP, &sin.sin_addr);
+    return run_remote_streamed(ssh_pool, command, "", [](const char* data, size_t len) {
+        std::cout.write(data, len);
+        std::cout.flush();
+        return output_wanted();
+    });
+}
 
-    if (connect(sock, (sockaddr*)(&sin), sizeof(sin)) != 0) {
-        std::cerr << "% Failed to connect to " << ROUTER_IP << "\n";
-        return false;
+// --- Concurrent Channel Executor ---
+//
+// Runs several commands at once on one pooled session. The session is put
+// in non-blocking mode and its socket registered with epoll; every channel
+// is a small state machine that advances whenever libssh2 stops returning
+// EAGAIN. Output is delivered through a completion callback per command, so
+// fetching N tables costs about one round trip instead of N.
+
+class ChannelExecutor {
+public:
+    using Callback = std::function<void(const std::string& command, int exit_status, const std::string& output)>;
+
+    explicit ChannelExecutor(SshSessionPool::Lease& lease) : lease_(lease) {}
+
+    void submit(const std::string& command, Callback done) {
+        Job job;
+        job.command = command;
+        job.done = std::move(done);
+        jobs_.push_back(std::move(job));
     }
 
-    session = libssh2_session_init();
-    if (libssh2_session_handshake(session, sock)) {
-        std::cerr << "% SSH Handshake failed\n";
-        return false;
+    // Drives every submitted command to completion. Returns false if the
+    // session failed or stalled for longer than SSH_TIMEOUT_MS; jobs that
+    // did not finish then complete with exit status -1.
+    bool run() {
+        if (mock_mode) {
+            for (auto& job : jobs_) {
+                std::cout << "[SSH MOCK] Executing: " << job.command << std::endl;
+                job.done(job.command, 0, "");
+            }
+            jobs_.clear();
+            return true;
+        }
+
+        LIBSSH2_SESSION* session = lease_.session();
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (!session || epfd < 0) {
+            fail_remaining();
+            if (epfd >= 0) close(epfd);
+            return false;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, lease_.socket(), &ev);
+
+        libssh2_session_set_blocking(session, 0);
+        bool ok = true;
+        size_t finished = 0;
+        while (finished < jobs_.size()) {
+            bool progressed = false;
+            size_t open_channels = 0;
+            for (auto& job : jobs_) {
+                if (job.state != Job::DONE && job.state != Job::PENDING) open_channels++;
+            }
+            for (auto& job : jobs_) {
+                if (job.state == Job::DONE) continue;
+                if (job.state == Job::PENDING) {
+                    if (open_channels >= EXEC_MAX_CHANNELS) continue;
+                    job.state = Job::OPENING;
+                    job.phase_start = hist_now_us();
+                    open_channels++;
+                }
+                int rc = step(session, job);
+                if (rc > 0) progressed = true;
+                if (rc < 0) {
+                    finish(job, -1);
+                    progressed = true;
+                }
+                if (job.state == Job::DONE) finished++;
+            }
+            if (progressed || finished == jobs_.size()) continue;
+
+            // Everyone is waiting on the socket; sleep until it is ready
+            int dir = libssh2_session_block_directions(session);
+            ev.events = 0;
+            if (dir & LIBSSH2_SESSION_BLOCK_INBOUND) ev.events |= EPOLLIN;
+            if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND) ev.events |= EPOLLOUT;
+            if (!ev.events) ev.events = EPOLLIN;
+            epoll_ctl(epfd, EPOLL_CTL_MOD, lease_.socket(), &ev);
+
+            epoll_event ready;
+            int n = epoll_wait(epfd, &ready, 1, SSH_TIMEOUT_MS);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || (ready.events & (EPOLLERR | EPOLLHUP))) {
+                std::cerr << "% Router stopped responding\n";
+                fail_remaining();
+                lease_.mark_broken();
+                ok = false;
+                break;
+            }
+        }
+
+        if (lease_.session()) libssh2_session_set_blocking(session, 1);
+        close(epfd);
+        jobs_.clear();
+        return ok;
     }
 
-    if (libssh2_userauth_password(session, USERNAME, PASSWORD)) {
-        std::cerr << "% Authentication failed\n";
-        return false;
+private:
+    struct Job {
+        enum State { PENDING, OPENING, EXEC, READING, CLOSING, DONE };
+        State state = PENDING;
+        std::string command;
+        Callback done;
+        LIBSSH2_CHANNEL* channel = nullptr;
+        std::string output;
+        uint64_t phase_start = 0;   // When the current phase began (latency statistics)
+    };
+
+    // Records the phase that just ended and starts timing the next one
+    static void end_phase(Job& job, LatencyHist* stat) {
+        uint64_t now = hist_now_us();
+        hist_record(stat, now - job.phase_start);
+        job.phase_start = now;
     }
 
-    return true;
-}
+    // Advances one job as far as it goes without blocking.
+    // Returns 1 if it made progress, 0 if it is waiting on the socket, -1 on error.
+    int step(LIBSSH2_SESSION* session, Job& job) {
+        int progressed = 0;
+        while (true) {
+            switch (job.state) {
+                case Job::OPENING:
+                    job.channel = libssh2_channel_open_session(session);
+                    if (!job.channel) {
+                        return libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN ? progressed : -1;
+                    }
+                    end_phase(job, &stat_channel_open);
+                    job.state = Job::EXEC;
+                    progressed = 1;
+                    break;
 
-void cleanup_ssh() {
-    if (mock_mode) return;
-    if (session) {
-        libssh2_session_disconnect(session, "Client disconnecting");
-        libssh2_session_free(session);
+                case Job::EXEC: {
+                    int rc = libssh2_channel_exec(job.channel, job.command.c_str());
+                    if (rc == LIBSSH2_ERROR_EAGAIN) return progressed;
+                    if (rc != 0) return -1;
+                    end_phase(job, &stat_exec);
+                    job.state = Job::READING;
+                    progressed = 1;
+                    break;
+                }
+
+                case Job::READING: {
+                    char buffer[4096];
+                    ssize_t n = libssh2_channel_read(job.channel, buffer, sizeof(buffer));
+                    if (n > 0) {
+                        job.output.append(buffer, n);
+                        progressed = 1;
+                        continue;
+                    }
+                    // Drain stderr so a chatty command cannot stall its window
+                    ssize_t e = libssh2_channel_read_stderr(job.channel, buffer, sizeof(buffer));
+                    if (e > 0) {
+                        progressed = 1;
+                        continue;
+                    }
+                    if (n == LIBSSH2_ERROR_EAGAIN || e == LIBSSH2_ERROR_EAGAIN) {
+                        if (!libssh2_channel_eof(job.channel)) return progressed;
+                    } else if (n < 0) {
+                        return -1;
+                    }
+                    if (!libssh2_channel_eof(job.channel)) return progressed;
+                    end_phase(job, &stat_read);
+                    job.state = Job::CLOSING;
+                    progressed = 1;
+                    break;
+                }
+
+                case Job::CLOSING: {
+                    int rc = libssh2_channel_close(job.channel);
+                    if (rc == 0) rc = libssh2_channel_wait_closed(job.channel);
+                    if (rc == LIBSSH2_ERROR_EAGAIN) return progressed;
+                    finish(job, libssh2_channel_get_exit_status(job.channel));
+                    return 1;
+                }
+
+                case Job::PENDING:
+                case Job::DONE:
+                    return progressed;
+            }
+        }
+    }
+
+    void finish(Job& job, int exit_status) {
+        if (job.channel) {
+            // Channel is closed (or the session is unusable); free cannot block for long
+            libssh2_channel_free(job.channel);
+            job.channel = nullptr;
+        }
+        job.state = Job::DONE;
+        job.done(job.command, exit_status, job.output);
     }
-    if (sock != -1) {
-        close(sock);
+
+    void fail_remaining() {
+        for (auto& job : jobs_) {
+            if (job.state == Job::DONE) continue;
+            job.channel = nullptr;   // Freed together with the broken session
+            job.state = Job::DONE;
+            job.done(job.command, -1, job.output);
+        }
     }
-    libssh2_exit();
-}
 
-// --- CLI Helper Functions ---
+    SshSessionPool::Lease& lease_;
+    std::vector<Job> jobs_;
+};
 
-void print_prompt() {
-    std::string prompt_char = (current_mode == MODE_USER) ? ">" : "#";
-    std::string mode_str = "";
-    
-    if (current_mode == MODE_CONFIG) mode_str = "(config)";
-    else if (current_mode == MODE_INTERFACE) mode_str = "(config-if)";
+// --- Apply Planner ---
+//
+// Config edits append raw commands to pending_commands, so a long session
+// piles up superseded `uci set`s, a `uci commit` per edit and a service
+// reload per edit. Before apply, the queue is parsed into typed operations
+// and reduced to the smallest equivalent plan:
+//   * a later `uci set` of the same option replaces the earlier one;
+//   * `ip route add` of the same destination keeps only the latest gateway;
+//   * per interface only the last address and the last up/down survive
+//     (an address assignment already brings the interface up);
+//   * commits are merged to one per package, and each service is reloaded
+//     once, after all commits;
+//   * `wifi reload` restarts every radio and drops every client, so it is
+//     narrowed to `wifi up <radio>` for each radio whose wifi-device or
+//     wifi-iface sections the run changes (once per radio).
+// Commands the planner does not recognise are barriers: everything queued
+// before them (including pending commits and reloads) is emitted first, so
+// their relative order is never changed.
 
-    std::cout << hostname << mode_str << prompt_char << " ";
-}
+struct PlannedOp {
+    enum Kind { UCI_SET, UCI_COMMIT, RELOAD, ROUTE_ADD, IFACE_ADDRESS, IFACE_STATE, OTHER };
+    Kind kind;
+    std::string key;       // Option, package, service, route destination or interface
+    std::string command;
+};
 
-std::vector<std::string> split_command(const std::string& line) {
-    std::vector<std::string> tokens;
-    std::stringstream ss(line);
-    std::string token;
-    while (ss >> token) {
-        tokens.push_back(token);
-    }
-    return tokens;
+bool starts_with(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
 }
 
-// --- Mode Handlers ---
+// The radio a wireless section belongs to, or "" if unknown (defined with the
+// wireless handlers, which know the synced config)
+std::string wifi_radio_of(const std::string& section);
+std::string uci_unquote(std::string_view v);
 
-void handle_user_mode(const std::vector<std::string>& tokens) {
-    if (tokens[0] == "enable") {
-        // Simulating simple auth or no auth for now as per shell scripts
-        current_mode = MODE_PRIVILEGED;
-        std::cout << "% Entered privileged mode\n";
-    } else if (tokens[0] == "exit") {
-        std::cout << "Bye!\n";
-        cleanup_ssh();
-        exit(0);
-    } else {
-        std::cout << "% Unknown command\n";
+PlannedOp classify_pending(const std::string& cmd) {
+    std::istringstream in(cmd);
+    std::vector<std::string> w;
+    std::string word;
+    while (in >> word) w.push_back(word);
+
+    // The value is quoted and may contain spaces (an SSID)
+    if (w.size() >= 3 && w[0] == "uci" && w[1] == "set" && w[2].find('=') != std::string::npos) {
+        return {PlannedOp::UCI_SET, w[2].substr(0, w[2].find('=')), cmd};
+    }
+    if (w.size() == 3 && w[0] == "uci" && w[1] == "commit") {
+        return {PlannedOp::UCI_COMMIT, w[2], cmd};
+    }
+    if (w.size() == 2 && starts_with(w[0], "/etc/init.d/") && (w[1] == "reload" || w[1] == "restart")) {
+        return {PlannedOp::RELOAD, cmd, cmd};
     }
+    if (w.size() >= 1 && w[0] == "wifi" && (w.size() == 1 || w[1] == "reload")) {
+        return {PlannedOp::RELOAD, "wifi reload", cmd};
+    }
+    if (w.size() == 3 && w[0] == "wifi" && w[1] == "up") {
+        return {PlannedOp::RELOAD, "wifi up " + w[2], cmd};
+    }
+    if (w.size() == 6 && w[0] == "ip" && w[1] == "route" && w[2] == "add" && w[4] == "via") {
+        return {PlannedOp::ROUTE_ADD, w[3], cmd};
+    }
+    // Interface names are shell-quoted
+    if (w.size() == 6 && w[0] == "ifconfig" && w[3] == "netmask" && w[5] == "up") {
+        return {PlannedOp::IFACE_ADDRESS, uci_unquote(w[1]), cmd};
+    }
+    if (w.size() == 3 && w[0] == "ifconfig" && (w[2] == "up" || w[2] == "down")) {
+        return {PlannedOp::IFACE_STATE, uci_unquote(w[1]), cmd};
+    }
+    return {PlannedOp::OTHER, "", cmd};
 }
 
-void handle_privileged_mode(const std::vector<std::string>& tokens) {
-    if (tokens[0] == "disable") {
-        current_mode = MODE_USER;
-        std::cout << "% Returned to user mode\n";
-    } else if (tokens[0] == "configure" || tokens[0] == "conf") {
-        if (tokens.size() > 1 && (tokens[1] == "terminal" || tokens[1] == "t")) {
-            current_mode = MODE_CONFIG;
-            std::cout << "% Entered config mode\n";
-        } else {
-            std::cout << "% Invalid command\n";
+// The radios whose sections `ops` change, or {""} if any of them is unknown.
+// Moving a wifi-iface to another radio (`.device=`) touches both.
+std::vector<std::string> changed_radios(const std::vector<PlannedOp>& ops) {
+    std::vector<std::string> radios;
+    auto add = [&](const std::string& radio) {
+        if (std::find(radios.begin(), radios.end(), radio) == radios.end()) radios.push_back(radio);
+    };
+    for (const auto& op : ops) {
+        if (op.kind != PlannedOp::UCI_SET || !starts_with(op.key, "wireless.")) continue;
+        std::string section = op.key.substr(9, op.key.rfind('.') - 9);
+        add(wifi_radio_of(section));
+        if (op.key.compare(op.key.size() - 7, 7, ".device") == 0) {
+            add(uci_unquote(op.command.substr(op.command.find('=') + 1)));
         }
-    } else if (tokens[0] == "show") {
-        if (tokens.size() > 1 && tokens[1] == "running-config") {
-            // In a real scenario, we might dump local state or fetch from router
-            std::cout << "! Pending commands:\n";
-            for (const auto& cmd : pending_commands) {
-                std::cout << cmd << "\n";
+    }
+    if (std::find(radios.begin(), radios.end(), "") != radios.end()) return {""};
+    return radios;
+}
+
+// Replaces `wifi reload` with per-radio reloads when every changed radio is known
+void narrow_wifi_reload(const std::vector<PlannedOp>& ops, std::vector<std::string>& reloads) {
+    auto global = std::find(reloads.begin(), reloads.end(), "wifi reload");
+    if (global == reloads.end()) return;
+    std::vector<std::string> radios = changed_radios(ops);
+    bool narrow = !radios.empty() && radios[0] != "";
+
+    std::vector<std::string> out;
+    for (const auto& cmd : reloads) {
+        if (cmd == "wifi reload") {
+            if (!narrow) out.push_back(cmd);
+            else for (const auto& r : radios) out.push_back("wifi up " + r);
+        } else if (starts_with(cmd, "wifi up ")) {
+            if (narrow && std::find(radios.begin(), radios.end(), cmd.substr(8)) == radios.end()) {
+                out.push_back(cmd);   // Neither covered by nor covering the narrowed reload
             }
-        } else if (tokens.size() >= 3 && tokens[1] == "ip" && tokens[2] == "route") {
-             execute_remote_command("ip route show");
-        } else {
-            std::cout << "% Invalid command\n";
-        }
-    } else if (tokens[0] == "apply") {
-        if (pending_commands.empty()) {
-            std::cout << "% No changes to apply\n";
         } else {
-            std::cout << "Applying " << pending_commands.size() << " commands...\n";
-            for (const auto& cmd : pending_commands) {
-                execute_remote_command(cmd.c_str());
-            }
-            pending_commands.clear();
+            out.push_back(cmd);
         }
-    } else if (tokens[0] == "exit") {
-        current_mode = MODE_USER;
-    } else {
-        std::cout << "% Unknown command\n";
-    }
-}
-
-void handle_config_mode(const std::vector<std::string>& tokens) {
-    if (tokens[0] == "hostname" && tokens.size() > 1) {
-        hostname = tokens[1];
-        // OpenWrt: uci set system.@system[0].hostname='hostname'; uci commit
-        pending_commands.push_back("uci set system.@system[0].hostname='" + hostname + "'");
-        pending_commands.push_back("uci commit system");
-        pending_commands.push_back("/etc/init.d/system reload"); // Apply hostname
-    } else if (tokens[0] == "interface" && tokens.size() > 1) {
-        current_interface = tokens[1];
-        current_mode = MODE_INTERFACE;
-    } else if (tokens[0] == "ip" && tokens.size() >= 4 && tokens[1] == "route") {
-        // ip route <net> <mask?> <gateway> -- simplifying to: ip route add <net> via <gateway>
-        // Simple mapping: keys off tokens. 
-        // Example: ip route 192.168.2.0 255.255.255.0 192.168.1.1
-        // Linux: ip route add 192.168.2.0/24 via 192.168.1.1
-        // For simplicity, passing raw tokens or doing basic translation
-        std::string route_cmd = "ip route add " + tokens[2] + " via " + tokens[4]; 
-        pending_commands.push_back(route_cmd);
-    } else if (tokens[0] == "exit") {
-        current_mode = MODE_PRIVILEGED;
-    } else {
-        std::cout << "% Unknown command\n";
-    }
-}
-
-void handle_interface_mode(const std::vector<std::string>& tokens) {
-    if (tokens[0] == "ip" && tokens.size() >= 4 && tokens[1] == "address") {
-        // ip address <ip> <mask>
-        // Linux: ifconfig <iface> <ip> netmask <mask> up
-        std::string cmd = "ifconfig " + current_interface + " " + tokens[2] + " netmask " + tokens[3] + " up";
-        pending_commands.push_back(cmd);
-    } else if (tokens[0] == "shutdown") {
-        pending_commands.push_back("ifconfig " + current_interface + " down");
-    } else if (tokens[0] == "no" && tokens.size() > 1 && tokens[1] == "shutdown") {
-        pending_commands.push_back("ifconfig " + current_interface + " up");
-    } else if (tokens[0] == "exit") {
-        current_mode = MODE_CONFIG;
-        current_interface = "";
-    } else {
-        std::cout << "% Unknown command\n";
+    }
+    reloads.clear();
+    for (const auto& cmd : out) {
+        if (std::find(reloads.begin(), reloads.end(), cmd) == reloads.end()) reloads.push_back(cmd);
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc > 1 && std::string(argv[1]) == "--mock") {
-        mock_mode = true;
-        std::cout << "[INFO] Running in MOCK mode. No real SSH connection.\n";
+// Reduces one barrier-free run of operations and appends it to `plan`
+void plan_segment(const std::vector<PlannedOp>& ops, std::vector<std::string>& plan) {
+    // Index of the surviving op for each (kind, key); superseded ones are skipped
+    std::map<std::pair<int, std::string>, size_t> last;
+    for (size_t i = 0; i < ops.size(); i++) {
+        last[{ops[i].kind, ops[i].key}] = i;
     }
 
-    if (!connect_ssh()) {
-        if (!mock_mode) {
-             std::cerr << "Fatal: Could not connect to router. Use --mock for testing.\n";
-             return 1;
+    std::vector<std::string> commits, reloads;
+    for (size_t i = 0; i < ops.size(); i++) {
+        const PlannedOp& op = ops[i];
+        if (last[{op.kind, op.key}] != i) continue;
+
+        switch (op.kind) {
+            case PlannedOp::UCI_COMMIT:
+                commits.push_back(op.command);
+                break;
+            case PlannedOp::RELOAD:
+                reloads.push_back(op.command);
+                break;
+            case PlannedOp::IFACE_STATE: {
+                // `ifconfig X up` after the final address assignment is a no-op;
+                // anything before that assignment is overridden by it
+                auto addr = last.find({PlannedOp::IFACE_ADDRESS, op.key});
+                if (addr != last.end() && (addr->second > i || op.command.back() == 'p')) break;
+                plan.push_back(op.command);
+                break;
+            }
+            default:
+                plan.push_back(op.command);
+                break;
         }
     }
 
-    std::string line;
-    while (true) {
-        print_prompt();
-        if (!std::getline(std::cin, line)) break;
-        if (line.empty()) continue;
-
-        auto tokens = split_command(line);
-        if (tokens.empty()) continue;
+    // Commits and reloads are kept in first-seen order
+    auto first_seen = [&](std::vector<std::string>& cmds) {
+        std::vector<std::string> ordered;
+        for (const auto& op : ops) {
+            for (const auto& c : cmds) {
+                if (c == op.command && std::find(ordered.begin(), ordered.end(), c) == ordered.end()) {
+                    ordered.push_back(c);
+                }
+            }
+        }
+        cmds = ordered;
+    };
+    first_seen(commits);
+    first_seen(reloads);
+    narrow_wifi_reload(ops, reloads);
+    plan.insert(plan.end(), commits.begin(), commits.end());
+    plan.insert(plan.end(), reloads.begin(), reloads.end());
+}
 
-        switch (current_mode) {
-            case MODE_USER: handle_user_mode(tokens); break;
-            case MODE_PRIVILEGED: handle_privileged_mode(tokens); break;
-            case MODE_CONFIG: handle_config_mode(tokens); break;
-            case MODE_INTERFACE: handle_interface_mode(tokens); break;
+std::vector<std::string> plan_apply(const std::vector<std::string>& pending) {
+    std::vector<std::string> plan;
+    std::vector<PlannedOp> segment;
+    for (const auto& cmd : pending) {
+        PlannedOp op = classify_pending(cmd);
+        if (op.kind == PlannedOp::OTHER) {
+            plan_segment(segment, plan);
+            segment.clear();
+            plan.push_back(cmd);
+        } else {
+            segment.push_back(op);
         }
     }
+    plan_segment(segment, plan);
+    return plan;
+}
+
+// --- Apply Engine ---
+//
+// `apply` used to open one channel per pending command, so a hostname change
+// alone cost three round trips. Instead the whole queue is turned into one
+// shell script, streamed to `sh -s` over a single channel. Every command is
+// wrapped in marker lines carrying its index and exit status so the output
+// can be split back up per command, and the script exits at the first failure.
+//
+// The apply is transactional. The script starts by snapshotting, on the
+// router, what the plan touches: `uci export` of each package, the routing
+// table, and `ifconfig` of each interface. If a command fails, the same
+// script restores all of it in one pass before exiting. A failed push costs
+// no extra round trip and leaves the router as it was.
+
+struct CommandResult {
+    std::string command;
+    int exit_status = -1;   // -1: never ran (an earlier command failed)
+    std::string output;
+};
+
+// Shell-quotes a string with single quotes ('it'\''s').
+std::string shell_quote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') out += "'\\''";
+        else out += c;
+    }
+    out += "'";
+    return out;
+}
+
+struct ApplyRollback {
+    bool attempted = false;
+    int failed_steps = 0;   // Restore steps that failed (0: fully restored)
+    std::string output;
+};
+
+#define APPLY_SNAPSHOT_DIR "/tmp/router_cli.$$"   // On the router; removed when the script ends
+
+// What the snapshot must cover to undo `commands`, from the planner's view of them
+struct RollbackPlan {
+    std::vector<std::string> uci_packages;
+    std::vector<std::string> routes;       // Destinations as `ip route show` prints them
+    std::vector<std::string> interfaces;
+    std::vector<size_t> reloads;           // Indexes of service reloads, re-run after a restore
+    std::vector<size_t> unrecoverable;     // Indexes of commands with no snapshot
+};
+
+RollbackPlan plan_rollback(const std::vector<std::string>& commands) {
+    RollbackPlan rb;
+    auto add_unique = [](std::vector<std::string>& v, const std::string& item) {
+        if (std::find(v.begin(), v.end(), item) == v.end()) v.push_back(item);
+    };
+    for (size_t i = 0; i < commands.size(); i++) {
+        PlannedOp op = classify_pending(commands[i]);
+        switch (op.kind) {
+            case PlannedOp::UCI_SET:
+                add_unique(rb.uci_packages, op.key.substr(0, op.key.find('.')));
+                break;
+            case PlannedOp::UCI_COMMIT:
+                add_unique(rb.uci_packages, op.key);
+                break;
+            case PlannedOp::RELOAD:
+                rb.reloads.push_back(i);
+                break;
+            case PlannedOp::ROUTE_ADD: {
+                // The kernel prints host routes without /32 and 0/0 as "default"
+                std::string dest = op.key;
+                if (dest == "0.0.0.0/0") dest = "default";
+                else if (dest.size() > 3 && dest.compare(dest.size() - 3, 3, "/32") == 0) dest.resize(dest.size() - 3);
+                add_unique(rb.routes, dest);
+                break;
+            }
+            case PlannedOp::IFACE_ADDRESS:
+            case PlannedOp::IFACE_STATE:
+                add_unique(rb.interfaces, op.key);
+                break;
+            case PlannedOp::OTHER:
+                rb.unrecoverable.push_back(i);
+                break;
+        }
+    }
+    return rb;
+}
+
+// Snapshot commands and the rollback() shell function for the apply script.
+// rollback N restores the snapshot after command N failed; the output of the
+// restore goes between ROLLBACK markers and END carries the failed step count.
+std::string build_rollback_script(const std::vector<std::string>& commands) {
+    RollbackPlan rb = plan_rollback(commands);
+    std::string snap = "S=" APPLY_SNAPSHOT_DIR "\nmkdir -p \"$S\"\n";
+    std::string undo;
+    auto step = [&](const std::string& cmd) { undo += "  " + cmd + " || rb=$((rb+1))\n"; };
+
+    for (const auto& pkg : rb.uci_packages) {
+        std::string file = "\"$S/uci." + pkg + "\"";
+        std::string created = "\"$S/new." + pkg + "\"";
+        std::string config = "/etc/config/" + shell_quote(pkg);
+        snap += "uci export " + shell_quote(pkg) + " > " + file + " 2>/dev/null\n";
+        // An empty export cannot undo a package the apply created: delete it instead
+        snap += "[ -e " + config + " ] || : > " + created + "\n";
+        step("uci revert " + shell_quote(pkg));
+        step("[ ! -e " + created + " ] || rm -f " + config);
+        step("[ ! -s " + file + " ] || uci import " + shell_quote(pkg) + " < " + file);
+        step("[ -e " + created + " ] || uci commit " + shell_quote(pkg));
+    }
+    if (!rb.routes.empty()) {
+        snap += "ip route show > \"$S/routes\" 2>/dev/null\n";
+        for (const auto& dest : rb.routes) {
+            undo += "  ip route del " + dest + " 2>/dev/null\n";
+            undo += "  while read -r r; do case \"$r\" in " + shell_quote(dest + " ") +
+                    "*) ip route add $r || rb=$((rb+1)) ;; esac; done < \"$S/routes\"\n";
+        }
+    }
+    if (!rb.interfaces.empty()) {
+        // busybox ifconfig: "inet addr:A  Bcast:B  Mask:M" and a "UP ..." flags line
+        undo += "  restore_if() {\n"
+                "    f=\"$S/if.$1\"; [ -s \"$f\" ] || return 0\n"
+                "    a=$(sed -n 's/.*inet addr:\\([0-9.]*\\).*/\\1/p' \"$f\")\n"
+                "    m=$(sed -n 's/.*Mask:\\([0-9.]*\\).*/\\1/p' \"$f\")\n"
+                "    ifconfig \"$1\" \"${a:-0.0.0.0}\" netmask \"${m:-255.255.255.0}\" || return 1\n"
+                "    if grep -q '^ *UP ' \"$f\"; then ifconfig \"$1\" up; else ifconfig \"$1\" down; fi\n"
+                "  }\n";
+        for (const auto& iface : rb.interfaces) {
+            snap += "ifconfig " + shell_quote(iface) + " > \"$S/if.\"" + shell_quote(iface) + " 2>/dev/null\n";
+            step("restore_if " + shell_quote(iface));
+        }
+    }
+    // Reloads that already ran picked up the new config; run them again on the old one
+    for (size_t i : rb.reloads) {
+        step("[ $1 -le " + std::to_string(i) + " ] || " + commands[i]);
+    }
+
+    return snap +
+           "rollback() {\n"
+           "  printf '\\n%s ROLLBACK BEGIN\\n' \"$T\"\n"
+           "  rb=0\n" + undo +
+           "  printf '\\n%s ROLLBACK END %d\\n' \"$T\" $rb\n"
+           "  rm -rf \"$S\"\n"
+           "} </dev/null 2>&1\n";
+}
+
+std::string build_apply_script(const std::vector<std::string>& commands, const std::string& tag) {
+    std::string script = "T=" + shell_quote(tag) + "\n" + build_rollback_script(commands);
+    for (size_t i = 0; i < commands.size(); i++) {
+        std::string idx = std::to_string(i);
+        script += "printf '%s BEGIN %d\\n' \"$T\" " + idx + "\n";
+        // stdin is the script itself, so commands must not be able to read it
+        script += "{\n" + commands[i] + "\n} </dev/null 2>&1\n";
+        script += "rc=$?\n";
+        // Leading newline guarantees the marker starts a line even if the
+        // command's output did not end with one; the parser drops it again.
+        script += "printf '\\n%s END %d %d\\n' \"$T\" " + idx + " $rc\n";
+        script += "[ $rc -eq 0 ] || { rollback " + idx + "; exit $rc; }\n";
+    }
+    script += "rm -rf \"$S\"\nexit 0\n";
+    return script;
+}
+
+// Splits the script's combined output back into per-command results.
+void parse_apply_output(const std::string& raw, const std::string& tag, std::vector<CommandResult>& results) {
+    const std::string begin_marker = tag + " BEGIN ";
+    const std::string end_marker = "\n" + tag + " END ";
+
+    size_t pos = 0;
+    while ((pos = raw.find(begin_marker, pos)) != std::string::npos) {
+        size_t idx_start = pos + begin_marker.size();
+        size_t line_end = raw.find('\n', idx_start);
+        if (line_end == std::string::npos) break;
+        size_t idx = std::stoul(raw.substr(idx_start, line_end - idx_start));
+
+        size_t end = raw.find(end_marker, line_end + 1);
+        if (idx >= results.size()) break;
+        if (end == std::string::npos) {
+            // Connection dropped mid-command: keep what we got
+            results[idx].output = raw.substr(line_end + 1);
+            break;
+        }
+        results[idx].output = raw.substr(line_end + 1, end - line_end - 1);
+
+        size_t status_start = end + end_marker.size();
+        size_t status_end = raw.find('\n', status_start);
+        std::istringstream fields(raw.substr(status_start, status_end - status_start));
+        size_t end_idx;
+        int status;
+        if (fields >> end_idx >> status && end_idx == idx) {
+            results[idx].exit_status = status;
+        }
+        pos = (status_end == std::string::npos) ? raw.size() : status_end;
+    }
+}
+
+// Picks the rollback report out of the script output, if there is one
+void parse_rollback_output(const std::string& raw, const std::string& tag, ApplyRollback& rollback) {
+    const std::string begin_marker = "\n" + tag + " ROLLBACK BEGIN\n";
+    const std::string end_marker = "\n" + tag + " ROLLBACK END ";
+    size_t begin = raw.find(begin_marker);
+    if (begin == std::string::npos) return;
+    rollback.attempted = true;
+
+    size_t body = begin + begin_marker.size();
+    size_t end = raw.find(end_marker, body);
+    if (end == std::string::npos) {
+        // Connection dropped during the restore: assume the worst
+        rollback.output = raw.substr(body);
+        rollback.failed_steps = -1;
+        return;
+    }
+    rollback.output = raw.substr(body, end - body);
+    rollback.failed_steps = std::atoi(raw.c_str() + end + end_marker.size());
+}
+
+// Runs all commands as one transaction-script over a single channel of `pool`.
+// Stops at the first failing command and restores the snapshot (reported in
+// `rollback`); commands after it keep exit_status -1.
+std::vector<CommandResult> apply_commands(SshSessionPool* pool, const std::vector<std::string>& commands,
+                                          ApplyRollback* rollback = nullptr) {
+    std::vector<CommandResult> results(commands.size());
+    for (size_t i = 0; i < commands.size(); i++) {
+        results[i].command = commands[i];
+    }
+
+    if (mock_mode) {
+        for (auto& r : results) {
+            std::cout << "[SSH MOCK] Executing: " << r.command << std::endl;
+            r.exit_status = 0;
+        }
+        return results;
+    }
+
+    uint64_t start = hist_now_us();
+    std::string tag = "@@APPLY-" + std::to_string(getpid()) + "-" + std::to_string(time(nullptr)) + "@@";
+    std::string raw;
+    run_remote_captured(pool, "sh -s", build_apply_script(commands, tag), raw);
+    parse_apply_output(raw, tag, results);
+    if (rollback) parse_rollback_output(raw, tag, *rollback);
+    hist_record_since(&stat_apply, start);
+    return results;
+}
+
+// One log line per command that ran, e.g. "apply r1: [2/3] uci commit -> exit 0"
+void log_apply_results(const std::string& router, const std::vector<CommandResult>& results,
+                       const ApplyRollback& rollback) {
+    for (size_t i = 0; i < results.size() && results[i].exit_status != -1; i++) {
+        cli_log("apply %s: [%zu/%zu] %s -> exit %d", router.c_str(), i + 1, results.size(),
+                results[i].command.c_str(), results[i].exit_status);
+    }
+    if (rollback.attempted) {
+        cli_log("apply %s: rolled back, %d restore step(s) failed", router.c_str(), rollback.failed_steps);
+    }
+}
+
+void print_apply_report(const std::vector<CommandResult>& results) {
+    size_t ok = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        if (r.exit_status == -1) break;
+
+        std::cout << "[" << (i + 1) << "/" << results.size() << "] " << r.command;
+        if (r.exit_status == 0) {
+            std::cout << " ... OK\n";
+            ok++;
+        } else {
+            std::cout << " ... FAILED (exit " << r.exit_status << ")\n";
+        }
+        if (!mock_mode) {
+            std::istringstream lines(r.output);
+            std::string line;
+            while (std::getline(lines, line)) {
+                std::cout << "    " << line << "\n";
+            }
+        }
+    }
+
+    if (ok == results.size()) {
+        std::cout << "% Applied " << ok << " commands\n";
+    } else {
+        std::cout << "% Apply stopped after " << ok << " of " << results.size()
+                  << " commands; remaining commands were not run\n";
+    }
+}
+
+void print_rollback_report(const ApplyRollback& rollback, const std::vector<CommandResult>& results) {
+    if (!rollback.attempted) return;
+    if (rollback.failed_steps == 0) {
+        std::cout << "% Rolled back: the router is back to its state before apply\n";
+    } else {
+        std::cout << "% Rollback incomplete (" << (rollback.failed_steps < 0 ? std::string("connection lost")
+                                                    : std::to_string(rollback.failed_steps) + " step(s) failed")
+                  << "); check the router\n";
+        std::istringstream lines(rollback.output);
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (!line.empty()) std::cout << "    " << line << "\n";
+        }
+    }
+
+    // Commands the snapshot does not cover stay applied
+    std::vector<std::string> commands;
+    for (const auto& r : results) commands.push_back(r.command);
+    for (size_t i : plan_rollback(commands).unrecoverable) {
+        if (results[i].exit_status == 0) std::cout << "% Not undone: " << results[i].command << "\n";
+    }
+}
+
+// --- Monitor Control Socket ---
+//
+// When router_monitor is running it already holds a warm SSH session and the
+// last fetched interface state. The CLI asks it over the control socket
+// (c_helpers/monitor_ctl.h) instead of doing its own round trip.
+
+// Sends one request; on success stores the payload in `reply`.
+// Returns false if the monitor is not running or answered with an error.
+bool monitor_call(const std::string& request, std::string& reply) {
+    if (mock_mode || fleet_mode) return false;
+
+    uint64_t start = hist_now_us();
+    char* payload = nullptr;
+    size_t len = 0;
+    int status = monitor_request(request.c_str(), &payload, &len);
+    if (payload) {
+        reply.assign(payload, len);
+        free(payload);
+    }
+    if (status == 0) hist_record_since(&stat_monitor_call, start);
+    return status == 0;
+}
+
+// Points the monitor at the router this CLI is managing
+void monitor_sync_target() {
+    auto field = [](const char* key, const std::string& value) {
+        std::vector<char> encoded(3 * value.size() + 1);
+        monitor_encode_value(value.c_str(), encoded.data(), encoded.size());
+        return std::string(" ") + key + "=" + encoded.data();
+    };
+    std::string reply;
+    bool ok = monitor_call(std::string(MONITOR_REQ_CONFIG) +
+                           field("router_ip", router_target.host) +
+                           field("router_port", std::to_string(router_target.port)) +
+                           field("username", router_target.username) +
+                           field("password", router_target.password), reply);
+    // An empty reply means no monitor is running, which is fine
+    if (!ok && !reply.empty()) {
+        std::cout << "% Monitor kept its old router settings: " << reply << "\n";
+    }
+}
+
+// --- Show Result Cache ---
+//
+// Output of remote show commands is cached per remote command for
+// show_cache_ttl seconds, so scripts that hammer `show` do not load the
+// router's CPU. Every entry is tagged with the subsystems it reports on.
+// When apply runs a command that touches one of those subsystems, the
+// matching entries are dropped. `show ... fresh` always goes to the router.
+
+enum Subsystem {
+    SUBSYS_ROUTES = 1 << 0,
+    SUBSYS_INTERFACES = 1 << 1,
+    SUBSYS_WIRELESS = 1 << 2,
+    SUBSYS_SYSTEM = 1 << 3,
+    SUBSYS_ALL = SUBSYS_ROUTES | SUBSYS_INTERFACES | SUBSYS_WIRELESS | SUBSYS_SYSTEM
+};
+
+struct CachedShow {
+    std::string output;
+    int subsystems;
+    std::chrono::steady_clock::time_point fetched;
+};
+
+std::map<std::string, CachedShow> show_cache;
+int show_cache_ttl = SHOW_CACHE_TTL;
+
+// Which subsystems a remote command reads or modifies
+int command_subsystems(const std::string& cmd) {
+    auto has = [&](const char* needle) { return cmd.find(needle) != std::string::npos; };
+
+    if (has("wireless") || has("wifi")) return SUBSYS_WIRELESS;
+    if (has("ip route") || has("route ")) return SUBSYS_ROUTES;
+    // Addresses and link state add and remove connected routes
+    if (has("ifconfig") || has("ip address") || has("ip addr") || has("ip link")) return SUBSYS_INTERFACES | SUBSYS_ROUTES;
+    // Network config changes can move both addresses and routes
+    if (has("uci") && has("network")) return SUBSYS_INTERFACES | SUBSYS_ROUTES;
+    if (has("/etc/init.d/network")) return SUBSYS_INTERFACES | SUBSYS_ROUTES;
+    if (has("network.interface") || has("network.device")) return SUBSYS_INTERFACES;
+    if (has("system")) return SUBSYS_SYSTEM;
+    // Unknown commands could change anything
+    return SUBSYS_ALL;
+}
+
+void show_cache_invalidate(int subsystems) {
+    for (auto it = show_cache.begin(); it != show_cache.end(); ) {
+        if (it->second.subsystems & subsystems) it = show_cache.erase(it);
+        else ++it;
+    }
+}
+
+// Drops cache entries for everything an apply run touched
+void show_cache_invalidate_applied(const std::vector<CommandResult>& results) {
+    for (const auto& r : results) {
+        // Even a failed command may have changed state before failing
+        if (r.exit_status != -1) show_cache_invalidate(command_subsystems(r.command));
+    }
+}
+
+// Returns the cached output of `remote_cmd` if it is younger than the TTL
+const CachedShow* show_cache_lookup(const std::string& remote_cmd) {
+    auto it = show_cache.find(remote_cmd);
+    if (it == show_cache.end()) return nullptr;
+    auto age = std::chrono::steady_clock::now() - it->second.fetched;
+    if (age >= std::chrono::seconds(show_cache_ttl)) {
+        show_cache.erase(it);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void show_cache_store(const std::string& remote_cmd, const std::string& output) {
+    if (show_cache_ttl <= 0) return;
+    show_cache[remote_cmd] = {output, command_subsystems(remote_cmd), std::chrono::steady_clock::now()};
+}
+
+// Prints the result of a remote show command, from the cache when possible.
+// With `monitor_request` set, the monitor's last fetch is tried before SSH.
+void show_remote(const std::string& remote_cmd, bool fresh, const char* monitor_req = nullptr) {
+    if (mock_mode) {
+        execute_remote_command(remote_cmd.c_str());
+        return;
+    }
+
+    if (!fresh) {
+        if (const CachedShow* hit = show_cache_lookup(remote_cmd)) {
+            std::cout << hit->output;
+            return;
+        }
+    }
+
+    uint64_t start = hist_now_us();
+    std::string output;
+    if (!fresh && monitor_req && monitor_call(monitor_req, output)) {
+        // Already served from the monitor's warm session
+        hist_record_since(&stat_show, start);
+        std::cout << output;
+        show_cache_store(remote_cmd, output);
+        return;
+    }
+
+    // Streamed as it arrives; a copy is kept for the cache while it is small
+    bool cacheable = show_cache_ttl > 0;
+    output.clear();
+    int status = run_remote_streamed(ssh_pool, remote_cmd.c_str(), "", [&](const char* data, size_t len) {
+        std::cout.write(data, len);
+        std::cout.flush();
+        if (cacheable && output.size() + len > SHOW_CACHE_MAX_BYTES) {
+            cacheable = false;
+            std::string().swap(output);
+        } else if (cacheable) {
+            output.append(data, len);
+        }
+        return output_wanted();
+    });
+    if (status != 0 || !output_wanted()) return;   // Never cache failures or output cut short
+    hist_record_since(&stat_show, start);
+    if (cacheable) show_cache_store(remote_cmd, output);
+}
+
+// Runs each (title, command) section concurrently and prints the outputs in
+// the order given. Sections with a valid cache entry are not refetched.
+void execute_remote_parallel(const std::vector<std::pair<std::string, std::string>>& sections, bool fresh) {
+    std::vector<std::string> outputs(sections.size());
+    std::vector<int> statuses(sections.size(), 0);
+    std::vector<size_t> to_fetch;
+    for (size_t i = 0; i < sections.size(); i++) {
+        const CachedShow* hit = (fresh || mock_mode) ? nullptr : show_cache_lookup(sections[i].second);
+        if (hit) outputs[i] = hit->output;
+        else to_fetch.push_back(i);
+    }
+
+    if (!to_fetch.empty()) {
+        auto lease = (ssh_pool && !mock_mode) ? ssh_pool->acquire() : SshSessionPool::Lease();
+        if (!mock_mode && !lease) {
+            std::cerr << "% Not connected to router (SSH session null)\n";
+            return;
+        }
+
+        ChannelExecutor executor(lease);
+        for (size_t i : to_fetch) {
+            executor.submit(sections[i].second, [&, i](const std::string& cmd, int status, const std::string& out) {
+                statuses[i] = status;
+                outputs[i] = out;
+                if (status == 0 && !mock_mode) show_cache_store(cmd, out);
+            });
+        }
+        executor.run();
+    }
+
+    for (size_t i = 0; i < sections.size(); i++) {
+        std::cout << "--- " << sections[i].first << " ---\n" << outputs[i];
+        if (statuses[i] != 0 && !mock_mode) {
+            std::cout << "% " << sections[i].second << " failed (exit " << statuses[i] << ")\n";
+        }
+    }
+}
+
+// --- Fleet Mode ---
+//
+// With --fleet <inventory>, `apply` pushes the pending queue to every router
+// in the inventory. A bounded set of worker threads pulls targets from a
+// shared list; each worker owns a private session pool for the router it is
+// configuring, so sessions are never shared between threads. At most
+// FLEET_PER_HOST_LIMIT workers talk to the same address at once.
+
+struct FleetResult {
+    RouterTarget target;
+    bool reachable = false;
+    std::vector<CommandResult> results;
+    ApplyRollback rollback;
+    double seconds = 0;
+};
+
+// Inventory format (state/inventory.conf): name,ip[,port[,username[,password]]]
+// Missing fields fall back to the single-router defaults.
+bool load_inventory(const std::string& path, std::vector<RouterTarget>& targets) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ',')) {
+            size_t b = field.find_first_not_of(" \t\r");
+            size_t e = field.find_last_not_of(" \t\r");
+            fields.push_back(b == std::string::npos ? "" : field.substr(b, e - b + 1));
+        }
+        if (fields.size() < 2 || fields[1].empty()) {
+            std::cerr << "% Skipping malformed inventory line: " << line << "\n";
+            continue;
+        }
+
+        RouterTarget t;
+        t.name = fields[0];
+        t.host = fields[1];
+        if (fields.size() > 2 && !fields[2].empty()) t.port = std::atoi(fields[2].c_str());
+        if (fields.size() > 3 && !fields[3].empty()) t.username = fields[3];
+        if (fields.size() > 4 && !fields[4].empty()) t.password = fields[4];
+        targets.push_back(t);
+    }
+    return true;
+}
+
+FleetResult apply_to_target(const RouterTarget& target, const std::vector<std::string>& commands) {
+    FleetResult r;
+    r.target = target;
+    auto started = std::chrono::steady_clock::now();
+
+    if (mock_mode) {
+        r.reachable = true;
+        for (const auto& cmd : commands) {
+            CommandResult c;
+            c.command = cmd;
+            c.exit_status = 0;
+            r.results.push_back(c);
+        }
+    } else {
+        SshSessionPool pool(target.host, target.port, target.username, target.password);
+        if (pool.acquire()) {
+            r.reachable = true;
+            r.results = apply_commands(&pool, commands, &r.rollback);
+        }
+        pool.shutdown();
+    }
+
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (r.reachable) log_apply_results(target.name, r.results, r.rollback);
+    else cli_log("apply %s: unreachable (%s:%d)", target.name.c_str(), target.host.c_str(), target.port);
+    return r;
+}
+
+std::vector<FleetResult> apply_to_fleet(const std::vector<RouterTarget>& targets, const std::vector<std::string>& commands) {
+    std::vector<FleetResult> results(targets.size());
+    std::vector<bool> claimed(targets.size(), false);
+    std::map<std::string, int> active_per_host;
+    std::mutex mutex;
+    std::condition_variable host_free;
+    size_t remaining = targets.size();
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining > 0) {
+            // Next unclaimed target whose address is under its limit
+            size_t pick = targets.size();
+            for (size_t i = 0; i < targets.size(); i++) {
+                if (!claimed[i] && active_per_host[targets[i].host] < FLEET_PER_HOST_LIMIT) {
+                    pick = i;
+                    break;
+                }
+            }
+            if (pick == targets.size()) {
+                host_free.wait(lock);
+                continue;
+            }
+
+            claimed[pick] = true;
+            remaining--;
+            active_per_host[targets[pick].host]++;
+            lock.unlock();
+
+            results[pick] = apply_to_target(targets[pick], commands);
+
+            lock.lock();
+            active_per_host[targets[pick].host]--;
+            host_free.notify_all();
+        }
+    };
+
+    size_t worker_count = std::min<size_t>(FLEET_WORKERS, targets.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& w : workers) w.join();
+    return results;
+}
+
+void print_fleet_report(const std::vector<FleetResult>& results) {
+    size_t succeeded = 0, failed = 0, unreachable = 0;
+    std::ostringstream out;
+    for (const auto& r : results) {
+        std::string address = r.target.host + ":" + std::to_string(r.target.port);
+        out << "  " << std::left << std::setw(16) << r.target.name << std::setw(22) << address;
+
+        if (!r.reachable) {
+            out << std::setw(12) << "UNREACHABLE";
+            unreachable++;
+        } else {
+            size_t ok = 0;
+            const CommandResult* failure = nullptr;
+            for (const auto& c : r.results) {
+                if (c.exit_status == 0) ok++;
+                else if (!failure) failure = &c;
+            }
+            std::string counts = std::to_string(ok) + "/" + std::to_string(r.results.size());
+            if (ok == r.results.size()) {
+                out << std::setw(12) << "OK" << std::setw(8) << counts;
+                succeeded++;
+            } else {
+                bool restored = r.rollback.attempted && r.rollback.failed_steps == 0;
+                out << std::setw(12) << (restored ? "ROLLED BACK" : "FAILED") << std::setw(8) << counts;
+                failed++;
+            }
+            if (failure) {
+                out << failure->command << " (exit " << failure->exit_status << ") ";
+            }
+        }
+        out << std::fixed << std::setprecision(2) << r.seconds << "s\n";
+    }
+    out << "% Fleet apply: " << succeeded << " succeeded, " << failed << " failed, "
+        << unreachable << " unreachable\n";
+    std::cout << out.str();
+}
+
+bool connect_ssh() {
+    if (mock_mode) return true;
+    if (fleet_mode) {
+        // Workers connect per target during apply
+        libssh2_init(0);
+        return true;
+    }
+
+    libssh2_init(0);
+    ssh_pool = new SshSessionPool(router_target.host, router_target.port,
+                                  router_target.username, router_target.password);
+
+    // Connect the first session up front so a bad address fails at startup
+    if (!ssh_pool->acquire()) {
+        cli_log("connect %s:%d failed", router_target.host.c_str(), router_target.port);
+        return false;
+    }
+    cli_log("connected to %s@%s:%d", router_target.username.c_str(), router_target.host.c_str(), router_target.port);
+
+    ssh_pool->start_keepalive();
+    monitor_sync_target();
+    return true;
+}
+
+void cleanup_ssh() {
+    if (mock_mode) return;
+    if (ssh_pool) {
+        ssh_pool->shutdown();
+        delete ssh_pool;
+        ssh_pool = nullptr;
+    }
+    libssh2_exit();
+}
+
+// --- CLI Helper Functions ---
+
+void print_prompt() {
+    std::string prompt_char = (current_mode == MODE_USER) ? ">" : "#";
+    std::string mode_str = "";
+    
+    if (current_mode == MODE_CONFIG) mode_str = "(config)";
+    else if (current_mode == MODE_INTERFACE) mode_str = "(config-if)";
+    else if (current_mode == MODE_WIRELESS) mode_str = "(config-wifi)";
+
+    std::cout << hostname << mode_str << prompt_char << " ";
+}
+
+// --- Command Parser ---
+//
+// Lines are split into std::string_view tokens over the line buffer (no
+// allocation per line), then matched against a per-mode trie of command
+// keywords. The tries are built at compile time from command_table below, so
+// adding a command is one table row plus its handler. Every keyword may be
+// abbreviated to any unambiguous prefix (`conf t`, `sh ip ro`).
+
+#define MAX_TOKENS 32               // Words per command line
+#define MAX_TRIE_NODES 32           // Keyword nodes per mode (checked at compile time)
+
+struct Tokens {
+    std::string_view items[MAX_TOKENS];
+    size_t count = 0;
+    bool overflow = false;           // Line had more than MAX_TOKENS words
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::string_view operator[](size_t i) const { return items[i]; }
+};
+
+// The arguments following a command's keywords
+struct Args {
+    const std::string_view* items;
+    size_t count;
+
+    size_t size() const { return count; }
+    std::string_view operator[](size_t i) const { return items[i]; }
+    std::string str(size_t i) const { return std::string(items[i]); }
+    // Words i to the end as typed, spacing included (an SSID with spaces)
+    std::string rest(size_t i) const {
+        return std::string(items[i].data(), items[count - 1].data() + items[count - 1].size() - items[i].data());
+    }
+};
+
+Tokens tokenize(std::string_view line) {
+    Tokens tokens;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) i++;
+        size_t start = i;
+        while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') i++;
+        if (i == start) break;
+        if (tokens.count == MAX_TOKENS) {
+            tokens.overflow = true;
+            break;
+        }
+        tokens.items[tokens.count++] = line.substr(start, i - start);
+    }
+    return tokens;
+}
+
+// True if `word` is a non-empty prefix of `keyword`
+constexpr bool abbreviates(std::string_view word, std::string_view keyword) {
+    return !word.empty() && word.size() <= keyword.size() && keyword.substr(0, word.size()) == word;
+}
+
+// --- Routing Table ---
+//
+// Local model of the router's IPv4 routing table: the kernel table (`ip route
+// show`), the static routes saved in the state store and the routes still
+// queued for apply. Prefixes live in a path-compressed binary trie whose
+// nodes sit in one vector with 32-bit links, so a longest-prefix match visits
+// at most 33 nodes and a 100k-route table takes a few MB. `ip route` checks
+// new routes against it and `show ip route <address>` is answered from it
+// without a round trip. It is rebuilt after apply and on `show ip route fresh`.
+
+enum class RouteSource : uint8_t { KERNEL, SAVED, PENDING };
+
+struct Route {
+    uint32_t network;                // Host byte order, host bits zero
+    uint32_t gateway;                // 0: directly connected
+    uint16_t device;                 // Index into the table's device names (0: none)
+    uint8_t prefix_len;
+    RouteSource source;
+};
+
+uint32_t prefix_mask(int len) {
+    return len == 0 ? 0 : ~0u << (32 - len);
+}
+
+// Bit `pos` of `addr`, counting from the most significant bit (pos < 32)
+int bit_at(uint32_t addr, int pos) {
+    return (addr >> (31 - pos)) & 1;
+}
+
+// Dotted-quad IPv4 to host byte order, without allocating
+bool parse_ipv4(std::string_view s, uint32_t& out) {
+    uint32_t addr = 0;
+    int octets = 0;
+    size_t i = 0;
+    while (octets < 4) {
+        size_t start = i;
+        uint32_t value = 0;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9' && i - start < 3) {
+            value = value * 10 + (s[i++] - '0');
+        }
+        if (i == start || value > 255) return false;
+        addr = (addr << 8) | value;
+        if (++octets < 4) {
+            if (i >= s.size() || s[i] != '.') return false;
+            i++;
+        }
+    }
+    if (i != s.size()) return false;
+    out = addr;
+    return true;
+}
+
+std::string format_ipv4(uint32_t addr) {
+    return std::to_string(addr >> 24) + "." + std::to_string((addr >> 16) & 0xff) + "." +
+           std::to_string((addr >> 8) & 0xff) + "." + std::to_string(addr & 0xff);
+}
+
+std::string format_prefix(uint32_t network, int len) {
+    return format_ipv4(network) + "/" + std::to_string(len);
+}
+
+// "10.0.0.0/8", "10.1.2.3" (a host route) or "default"
+bool parse_prefix(std::string_view s, uint32_t& network, int& len) {
+    if (s == "default") {
+        network = 0;
+        len = 0;
+        return true;
+    }
+    size_t slash = s.find('/');
+    len = 32;
+    if (slash != std::string_view::npos) {
+        std::string_view bits = s.substr(slash + 1);
+        if (bits.empty() || bits.size() > 2) return false;
+        len = 0;
+        for (char c : bits) {
+            if (c < '0' || c > '9') return false;
+            len = len * 10 + (c - '0');
+        }
+        if (len > 32) return false;
+        s = s.substr(0, slash);
+    }
+    if (!parse_ipv4(s, network)) return false;
+    network &= prefix_mask(len);
+    return true;
+}
+
+class RoutingTable {
+public:
+    RoutingTable() { clear(); }
+
+    void clear() {
+        nodes.assign(1, Node{0, {-1, -1}, -1, 0});
+        routes.clear();
+        devices.assign(1, "");
+        device_ids.clear();
+    }
+
+    size_t size() const { return routes.size(); }
+
+    // Adds the route, replacing any route for the same prefix
+    void insert(Route route) {
+        route.network &= prefix_mask(route.prefix_len);
+        int32_t n = node_for(route.network, route.prefix_len);
+        if (nodes[n].route >= 0) {
+            routes[nodes[n].route] = route;
+        } else {
+            nodes[n].route = (int32_t)routes.size();
+            routes.push_back(route);
+        }
+    }
+
+    // The route for exactly this prefix, or nullptr
+    const Route* find(uint32_t network, int len) const {
+        int32_t n = 0;
+        while (n >= 0) {
+            const Node& node = nodes[n];
+            if (node.len > len || (network & prefix_mask(node.len)) != node.key) return nullptr;
+            if (node.len == len) return node.route >= 0 ? &routes[node.route] : nullptr;
+            n = node.child[bit_at(network, node.len)];
+        }
+        return nullptr;
+    }
+
+    // Longest-prefix match for a destination address
+    const Route* lookup(uint32_t address) const {
+        return best_match(address, 32);
+    }
+
+    // The most specific route strictly wider than network/len, if any
+    const Route* covering(uint32_t network, int len) const {
+        return len == 0 ? nullptr : best_match(network, len - 1);
+    }
+
+    // Number of routes strictly inside network/len
+    size_t count_within(uint32_t network, int len) const {
+        int32_t n = 0;
+        while (n >= 0 && nodes[n].len < len) {
+            if ((network & prefix_mask(nodes[n].len)) != nodes[n].key) return 0;
+            n = nodes[n].child[bit_at(network, nodes[n].len)];
+        }
+        if (n < 0 || (nodes[n].key & prefix_mask(len)) != network) return 0;
+
+        size_t count = 0;
+        std::vector<int32_t> stack = {n};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.route >= 0 && node.len > len) count++;
+            for (int32_t c : node.child) {
+                if (c >= 0) stack.push_back(c);
+            }
+        }
+        return count;
+    }
+
+    uint16_t device_id(std::string_view name) {
+        if (name.empty()) return 0;
+        auto it = device_ids.find(name);
+        if (it != device_ids.end()) return it->second;
+        if (devices.size() > UINT16_MAX) return 0;
+        uint16_t id = (uint16_t)devices.size();
+        devices.emplace_back(name);
+        device_ids.emplace(devices.back(), id);
+        return id;
+    }
+
+    const std::string& device_name(uint16_t id) const { return devices[id]; }
+
+private:
+    // A prefix of the trie. Children differ from it at bit `len`.
+    struct Node {
+        uint32_t key;
+        int32_t child[2];
+        int32_t route;               // Index into routes, or -1 for a branch-only node
+        uint8_t len;
+    };
+
+    std::vector<Node> nodes;         // nodes[0] is the root, 0.0.0.0/0
+    std::vector<Route> routes;
+    std::vector<std::string> devices;
+    std::map<std::string, uint16_t, std::less<>> device_ids;
+
+    int32_t new_node(uint32_t key, int len) {
+        nodes.push_back(Node{key, {-1, -1}, -1, (uint8_t)len});
+        return (int32_t)nodes.size() - 1;
+    }
+
+    // Finds or creates the node for key/len, splitting an edge if needed
+    int32_t node_for(uint32_t key, int len) {
+        int32_t n = 0;
+        while (nodes[n].len != len) {
+            int bit = bit_at(key, nodes[n].len);
+            int32_t c = nodes[n].child[bit];
+            if (c < 0) {
+                int32_t leaf = new_node(key, len);
+                nodes[n].child[bit] = leaf;
+                return leaf;
+            }
+
+            int common = std::min<int>(len, nodes[c].len);
+            uint32_t diff = key ^ nodes[c].key;
+            if (diff) common = std::min(common, __builtin_clz(diff));
+            if (common == nodes[c].len) {
+                n = c;
+                continue;
+            }
+
+            // key/len and the child share only `common` bits: insert a node there
+            int32_t mid = new_node(key & prefix_mask(common), common);
+            nodes[mid].child[bit_at(nodes[c].key, common)] = c;
+            nodes[n].child[bit] = mid;
+            if (common == len) return mid;
+            int32_t leaf = new_node(key, len);
+            nodes[mid].child[bit_at(key, common)] = leaf;
+            return leaf;
+        }
+        return n;
+    }
+
+    const Route* best_match(uint32_t address, int max_len) const {
+        const Route* best = nullptr;
+        int32_t n = 0;
+        while (n >= 0) {
+            const Node& node = nodes[n];
+            if (node.len > max_len || (address & prefix_mask(node.len)) != node.key) break;
+            if (node.route >= 0) best = &routes[node.route];
+            if (node.len == 32) break;
+            n = node.child[bit_at(address, node.len)];
+        }
+        return best;
+    }
+};
+
+RoutingTable routing_table;
+bool routing_table_loaded = false;   // Cleared by apply and `show ip route fresh`
+
+// Route types that carry no next hop but still take part in lookups
+bool is_route_type(std::string_view word) {
+    return word == "unreachable" || word == "blackhole" || word == "prohibit" || word == "throw";
+}
+
+const char* route_source_name(RouteSource source) {
+    switch (source) {
+        case RouteSource::KERNEL: return "kernel";
+        case RouteSource::SAVED: return "saved";
+        case RouteSource::PENDING: return "pending";
+    }
+    return "";
+}
+
+std::string describe_route(const Route& r) {
+    std::string text = format_prefix(r.network, r.prefix_len);
+    const std::string& device = routing_table.device_name(r.device);
+    if (r.gateway) text += " via " + format_ipv4(r.gateway) + (r.device ? " dev " + device : "");
+    else if (is_route_type(device)) text += " " + device;
+    else if (r.device) text += " directly connected, " + device;
+    return text + " [" + route_source_name(r.source) + "]";
+}
+
+// Parses `<prefix> [via <gw>] [dev <name>] ...` starting at tokens[first]
+// (the form of both `ip route show` lines and queued `ip route add`s)
+bool parse_route_tokens(const Tokens& tokens, size_t first, RouteSource source, Route& route) {
+    // `unreachable 10.0.0.0/8`: the type stands in for the device
+    std::string_view type;
+    if (first < tokens.size() && is_route_type(tokens[first])) {
+        type = tokens[first++];
+    } else if (first < tokens.size() && tokens[first] == "unicast") {
+        first++;
+    }
+
+    int len;
+    if (first >= tokens.size() || !parse_prefix(tokens[first], route.network, len)) return false;
+    route.prefix_len = (uint8_t)len;
+    route.gateway = 0;
+    route.device = routing_table.device_id(type);
+    route.source = source;
+    for (size_t i = first + 1; i + 1 < tokens.size(); i++) {
+        if (tokens[i] == "via" && !parse_ipv4(tokens[i + 1], route.gateway)) return false;
+        if (tokens[i] == "dev") route.device = routing_table.device_id(tokens[i + 1]);
+    }
+    return true;
+}
+
+// Adds every route in `ip route show` output; returns the number of lines
+// that could not be parsed (multipath next hops, IPv6, ...)
+size_t load_kernel_routes(std::string_view text) {
+    size_t skipped = 0;
+    while (!text.empty()) {
+        size_t eol = text.find('\n');
+        std::string_view line = text.substr(0, eol);
+        text = eol == std::string_view::npos ? std::string_view() : text.substr(eol + 1);
+
+        Tokens tokens = tokenize(line);
+        if (tokens.empty() || tokens[0] == "nexthop") continue;
+        Route route;
+        if (parse_route_tokens(tokens, 0, RouteSource::KERNEL, route)) routing_table.insert(route);
+        else skipped++;
+    }
+    return skipped;
+}
+
+// Adds the static routes saved in the state store (state_store.h) that the
+// kernel table does not already have a route for; returns the number of
+// records with a non-contiguous mask
+size_t load_saved_routes() {
+    StateStore store;
+    if (!state_open(&store, STATE_DB_PATH)) return 0;
+    size_t skipped = 0;
+    const StateRoute* saved = STATE_ROUTES(store.hdr);
+    for (uint32_t i = 0; i < store.hdr->route_count; i++) {
+        uint32_t mask = saved[i].mask;
+        if ((mask & (~mask >> 1)) != 0) {
+            skipped++;
+            continue;
+        }
+        int len = __builtin_popcount(mask);
+        if (!routing_table.find(saved[i].dest & mask, len)) {
+            routing_table.insert({saved[i].dest & mask, saved[i].gateway, 0, (uint8_t)len, RouteSource::SAVED});
+        }
+    }
+    state_close(&store);
+    return skipped;
+}
+
+// Rebuilds the table unless it is current. The kernel table comes from the
+// show cache when possible; without a connection (mock, fleet and batch
+// validation) only the saved and queued routes are known.
+void load_routing_table(bool fresh) {
+    if (routing_table_loaded && !fresh) return;
+    routing_table.clear();
+    size_t skipped = 0;
+    bool complete = mock_mode || fleet_mode;
+
+    if (!mock_mode && !fleet_mode && ssh_pool) {
+        const std::string remote_cmd = "ip route show";
+        const CachedShow* hit = fresh ? nullptr : show_cache_lookup(remote_cmd);
+        if (hit) {
+            skipped += load_kernel_routes(hit->output);
+            complete = true;
+        } else {
+            std::string output;
+            if (run_remote_captured(ssh_pool, remote_cmd.c_str(), "", output) == 0) {
+                skipped += load_kernel_routes(output);
+                show_cache_store(remote_cmd, output);
+                complete = true;
+            }
+        }
+    }
+    skipped += load_saved_routes();
+
+    for (const auto& cmd : pending_commands) {
+        Tokens tokens = tokenize(cmd);
+        Route route;
+        if (tokens.size() > 3 && tokens[0] == "ip" && tokens[1] == "route" && tokens[2] == "add" &&
+            parse_route_tokens(tokens, 3, RouteSource::PENDING, route)) {
+            routing_table.insert(route);
+        }
+    }
+
+    if (skipped) std::cout << "% Routing table: skipped " << skipped << " unrecognised routes\n";
+    routing_table_loaded = complete;
+}
+
+// --- JSON ---
+//
+// `ip -j` output is tokenized in place, jsmn-style: one pass produces a flat
+// array of tokens pointing into the text. Nothing is copied or unescaped
+// until a string value is asked for, and `next` skips a whole subtree.
+
+struct JsonToken {
+    enum Type : uint8_t { OBJECT, ARRAY, STRING, PRIMITIVE };
+    Type type;
+    uint32_t start;   // Span in the text; strings exclude the quotes
+    uint32_t end;
+    uint32_t size;    // Members (object) or items (array)
+    uint32_t next;    // Index of the first token after this subtree
+};
+
+#define JSON_MAX_DEPTH 64
+
+class JsonDoc {
+public:
+    // Returns false on a syntax error. `text` must outlive the document.
+    bool parse(std::string_view text) {
+        text_ = text;
+        tokens_.clear();
+        pos_ = 0;
+        skip_ws();
+        if (!parse_value(0)) return false;
+        skip_ws();
+        return pos_ == text_.size();
+    }
+
+    size_t size() const { return tokens_.size(); }
+    const JsonToken& operator[](size_t i) const { return tokens_[i]; }
+
+    std::string_view view(long i) const {
+        if (i < 0) return {};
+        return text_.substr(tokens_[i].start, tokens_[i].end - tokens_[i].start);
+    }
+
+    // Items of an array (or keys of an object): the first is i + 1, each
+    // following one is next_sibling() of the previous. A member's value is
+    // the token right after its key.
+    size_t first_child(size_t i) const { return i + 1; }
+    size_t next_sibling(size_t i) const { return tokens_[i].next; }
+
+    // Value token of `key` in object `obj`, or -1
+    long member(long obj, std::string_view key) const {
+        if (obj < 0 || tokens_[obj].type != JsonToken::OBJECT) return -1;
+        size_t k = obj + 1;
+        for (uint32_t m = 0; m < tokens_[obj].size; m++) {
+            if (view(k) == key) return (long)k + 1;
+            k = tokens_[k + 1].next;
+        }
+        return -1;
+    }
+
+    // String value with escapes resolved ("" for a missing token)
+    std::string str(long i) const {
+        std::string_view raw = view(i);
+        if (raw.find('\\') == std::string_view::npos) return std::string(raw);
+        std::string out;
+        for (size_t p = 0; p < raw.size(); p++) {
+            if (raw[p] != '\\' || p + 1 >= raw.size()) {
+                out += raw[p];
+                continue;
+            }
+            char e = raw[++p];
+            switch (e) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp = 0;
+                    if (p + 4 >= raw.size()) break;
+                    std::from_chars(raw.data() + p + 1, raw.data() + p + 5, cp, 16);
+                    p += 4;
+                    // Surrogate pair
+                    if (cp >= 0xD800 && cp < 0xDC00 && p + 6 < raw.size() && raw[p + 1] == '\\' && raw[p + 2] == 'u') {
+                        unsigned lo = 0;
+                        std::from_chars(raw.data() + p + 3, raw.data() + p + 7, lo, 16);
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        p += 6;
+                    }
+                    if (cp < 0x80) {
+                        out += (char)cp;
+                    } else if (cp < 0x800) {
+                        out += (char)(0xC0 | (cp >> 6));
+                        out += (char)(0x80 | (cp & 0x3F));
+                    } else if (cp < 0x10000) {
+                        out += (char)(0xE0 | (cp >> 12));
+                        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                        out += (char)(0x80 | (cp & 0x3F));
+                    } else {
+                        out += (char)(0xF0 | (cp >> 18));
+                        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+                        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                        out += (char)(0x80 | (cp & 0x3F));
+                    }
+                    break;
+                }
+                default: out += e; break;   // \" \\ \/
+            }
+        }
+        return out;
+    }
+
+    long num(long i, long fallback) const {
+        std::string_view raw = view(i);
+        long value;
+        auto res = std::from_chars(raw.data(), raw.data() + raw.size(), value);
+        return (i >= 0 && res.ec == std::errc()) ? value : fallback;
+    }
+
+private:
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    void skip_ws() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                       text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    bool parse_string() {
+        uint32_t start = (uint32_t)++pos_;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if ((unsigned char)text_[pos_] < 0x20) return false;
+            pos_ += text_[pos_] == '\\' ? 2 : 1;
+        }
+        if (pos_ >= text_.size()) return false;
+        uint32_t next = (uint32_t)tokens_.size() + 1;
+        tokens_.push_back({JsonToken::STRING, start, (uint32_t)pos_++, 0, next});
+        return true;
+    }
+
+    bool parse_value(int depth) {
+        char c = peek();
+        if (c == '"') return parse_string();
+
+        size_t self = tokens_.size();
+        JsonToken t = {JsonToken::PRIMITIVE, (uint32_t)pos_, 0, 0, 0};
+        tokens_.push_back(t);
+        if (c == '{' || c == '[') {
+            if (depth >= JSON_MAX_DEPTH) return false;
+            bool object = c == '{';
+            char close = object ? '}' : ']';
+            t.type = object ? JsonToken::OBJECT : JsonToken::ARRAY;
+            pos_++;
+            skip_ws();
+            if (peek() == close) {
+                pos_++;
+            } else {
+                for (;;) {
+                    if (object) {
+                        if (peek() != '"' || !parse_string()) return false;
+                        skip_ws();
+                        if (peek() != ':') return false;
+                        pos_++;
+                        skip_ws();
+                    }
+                    if (!parse_value(depth + 1)) return false;
+                    t.size++;
+                    skip_ws();
+                    if (peek() == ',') {
+                        pos_++;
+                        skip_ws();
+                    } else if (peek() == close) {
+                        pos_++;
+                        break;
+                    } else {
+                        return false;
+                    }
+                }
+            }
+        } else {
+            // true, false, null or a number; validated only by its characters
+            while (pos_ < text_.size() && (std::isalnum((unsigned char)text_[pos_]) ||
+                                           text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.')) {
+                pos_++;
+            }
+            if (pos_ == t.start) return false;
+        }
+        t.end = (uint32_t)pos_;
+        t.next = (uint32_t)tokens_.size();
+        tokens_[self] = t;
+        return true;
+    }
+
+    std::string_view text_;
+    std::vector<JsonToken> tokens_;
+    size_t pos_ = 0;
+};
+
+// --- Config Sync ---
+//
+// The CLI keeps a local copy of the router's configuration (config_tree):
+// every UCI package as `uci export` prints it, plus the live interfaces and
+// routes from `ip -j`. A sync is one exec. The router checksums each part and
+// sends only the parts whose checksum the CLI does not already hold, gzipped.
+// So an unchanged router costs a few hundred bytes. `show running-config`,
+// `show startup-config` and the pending diff are rendered from the tree.
+
+#define SYNC_ADDR_PART "@addr"      // Parts that are not UCI packages start with '@'
+#define SYNC_ROUTE_PART "@route"
+
+struct UciOption {
+    std::string name;
+    std::string value;
+    bool list = false;
+};
+
+struct UciSection {
+    std::string type;
+    std::string name;               // "@type[n]" for anonymous sections, as `uci show` names them
+    std::vector<UciOption> options;
+};
+
+struct UciPackage {
+    std::string text;               // As exported
+    std::vector<UciSection> sections;
+};
+
+struct LiveInterface {
+    std::string name;
+    std::string mac;
+    bool up = false;
+    long mtu = 0;
+    std::vector<std::string> addrs; // "10.0.0.2/24"
+};
+
+struct LiveRoute {
+    std::string dst;                // "default", "10.0.0.0/24", "10.1.2.3"
+    std::string gateway;
+    std::string dev;
+    std::string protocol;
+};
+
+struct ConfigTree {
+    std::map<std::string, UciPackage> packages;
+    std::map<std::string, std::string> checksums;   // Every part, packages and '@' parts
+    std::vector<LiveInterface> interfaces;
+    std::vector<LiveRoute> routes;
+    bool valid = false;
+    bool stale = false;             // Set by apply: the next view resyncs
+    std::chrono::steady_clock::time_point synced;
+    time_t synced_at = 0;
+
+    // Last sync
+    std::vector<std::string> changed;   // Parts that differed from the previous sync
+    size_t wire_bytes = 0;
+    size_t raw_bytes = 0;
+};
+
+ConfigTree config_tree;
+
+// 'it'\''s' -> it's
+std::string uci_unquote(std::string_view v) {
+    std::string out;
+    bool quoted = false;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i] == '\'') quoted = !quoted;
+        else if (v[i] == '\\' && !quoted && i + 1 < v.size()) out += v[++i];
+        else out += v[i];
+    }
+    return out;
+}
+
+void parse_uci_export(UciPackage& pkg) {
+    pkg.sections.clear();
+    std::map<std::string, int> anonymous;
+    std::istringstream lines(pkg.text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t b = line.find_first_not_of(" \t");
+        if (b == std::string::npos) continue;
+        std::string_view l(line);
+        l.remove_prefix(b);
+
+        size_t sp = l.find(' ');
+        if (sp == std::string_view::npos) continue;
+        std::string_view keyword = l.substr(0, sp);
+        std::string_view rest = l.substr(sp + 1);
+        size_t sp2 = rest.find(' ');
+        std::string_view first = rest.substr(0, sp2);
+        std::string_view second = sp2 == std::string_view::npos ? std::string_view() : rest.substr(sp2 + 1);
+
+        if (keyword == "config") {
+            UciSection s;
+            s.type = uci_unquote(first);
+            if (second.empty()) s.name = "@" + s.type + "[" + std::to_string(anonymous[s.type]++) + "]";
+            else s.name = uci_unquote(second);
+            pkg.sections.push_back(s);
+        } else if ((keyword == "option" || keyword == "list") && !pkg.sections.empty()) {
+            pkg.sections.back().options.push_back({uci_unquote(first), uci_unquote(second), keyword == "list"});
+        }
+    }
+}
+
+// "pkg.section.option" in the tree, or nullptr
+const UciOption* uci_lookup(const std::string& path) {
+    size_t d1 = path.find('.');
+    size_t d2 = d1 == std::string::npos ? d1 : path.find('.', d1 + 1);
+    if (d2 == std::string::npos) return nullptr;
+    auto pkg = config_tree.packages.find(path.substr(0, d1));
+    if (pkg == config_tree.packages.end()) return nullptr;
+    std::string section = path.substr(d1 + 1, d2 - d1 - 1);
+    std::string option = path.substr(d2 + 1);
+    for (const auto& s : pkg->second.sections) {
+        if (s.name != section) continue;
+        for (const auto& o : s.options) {
+            if (o.name == option) return &o;
+        }
+    }
+    return nullptr;
+}
+
+bool parse_ip_addr_json(std::string_view json, std::vector<LiveInterface>& out) {
+    JsonDoc doc;
+    if (!doc.parse(json) || doc[0].type != JsonToken::ARRAY) return false;
+    out.clear();
+    size_t i = doc.first_child(0);
+    for (uint32_t n = 0; n < doc[0].size; n++, i = doc.next_sibling(i)) {
+        LiveInterface f;
+        f.name = doc.str(doc.member(i, "ifname"));
+        f.mac = doc.str(doc.member(i, "address"));
+        f.mtu = doc.num(doc.member(i, "mtu"), 0);
+        long flags = doc.member(i, "flags");
+        if (flags >= 0 && doc[flags].type == JsonToken::ARRAY) {
+            size_t fl = doc.first_child(flags);
+            for (uint32_t k = 0; k < doc[flags].size; k++, fl = doc.next_sibling(fl)) {
+                if (doc.view(fl) == "UP") f.up = true;
+            }
+        }
+        long info = doc.member(i, "addr_info");
+        if (info >= 0 && doc[info].type == JsonToken::ARRAY) {
+            size_t a = doc.first_child(info);
+            for (uint32_t k = 0; k < doc[info].size; k++, a = doc.next_sibling(a)) {
+                long local = doc.member(a, "local");
+                if (local >= 0) f.addrs.push_back(doc.str(local) + "/" + std::to_string(doc.num(doc.member(a, "prefixlen"), 32)));
+            }
+        }
+        out.push_back(f);
+    }
+    return true;
+}
+
+bool parse_ip_route_json(std::string_view json, std::vector<LiveRoute>& out) {
+    JsonDoc doc;
+    if (!doc.parse(json) || doc[0].type != JsonToken::ARRAY) return false;
+    out.clear();
+    size_t i = doc.first_child(0);
+    for (uint32_t n = 0; n < doc[0].size; n++, i = doc.next_sibling(i)) {
+        out.push_back({doc.str(doc.member(i, "dst")), doc.str(doc.member(i, "gateway")),
+                       doc.str(doc.member(i, "dev")), doc.str(doc.member(i, "protocol"))});
+    }
+    return true;
+}
+
+// Inflates a gzip stream (what busybox `gzip -c` writes)
+bool gunzip(const std::string& in, std::string& out) {
+    z_stream z = {};
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) return false;
+    z.next_in = (Bytef*)in.data();
+    z.avail_in = (uInt)in.size();
+    char buffer[16384];
+    int rc;
+    do {
+        z.next_out = (Bytef*)buffer;
+        z.avail_out = sizeof(buffer);
+        rc = inflate(&z, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) break;
+        out.append(buffer, sizeof(buffer) - z.avail_out);
+    } while (rc != Z_STREAM_END && (z.avail_in > 0 || z.avail_out == 0));
+    inflateEnd(&z);
+    return rc == Z_STREAM_END;
+}
+
+// The router side of a sync. Each part is framed as "= NAME SUM" (unchanged,
+// not sent) or "+ NAME SUM LEN" followed by LEN bytes.
+std::string build_sync_script(const ConfigTree& tree) {
+    std::string known = " ";
+    for (const auto& [name, sum] : tree.checksums) known += name + "=" + sum + " ";
+    return "K=" + shell_quote(known) + "\n"
+           "F=/tmp/router_cli_sync.$$\n"
+           "part() {\n"
+           "  n=$1; shift\n"
+           "  \"$@\" > \"$F\" 2>/dev/null\n"
+           "  s=$(md5sum < \"$F\" | cut -c1-32)\n"
+           "  case \"$K\" in\n"
+           "    *\" $n=$s \"*) echo \"= $n $s\" ;;\n"
+           "    *) echo \"+ $n $s $(wc -c < \"$F\")\"; cat \"$F\" ;;\n"
+           "  esac\n"
+           "}\n"
+           "if command -v gzip >/dev/null 2>&1; then Z='gzip -c'; else Z=cat; fi\n"
+           "{\n"
+           "  for p in $(uci show 2>/dev/null | sed -n 's/^\\([^.=]*\\)[.=].*/\\1/p' | sort -u); do\n"
+           "    part \"$p\" uci export \"$p\"\n"
+           "  done\n"
+           "  part " SYNC_ADDR_PART " ip -j address show\n"
+           "  part " SYNC_ROUTE_PART " ip -j route show\n"
+           "} | $Z\n"
+           "rm -f \"$F\"\n";
+}
+
+// Merges a sync reply into the tree. Parts the reply does not mention no
+// longer exist on the router. Returns false if the reply is unusable.
+bool apply_sync_output(const std::string& wire, ConfigTree& tree) {
+    std::string raw;
+    bool compressed = wire.size() >= 2 && (unsigned char)wire[0] == 0x1f && (unsigned char)wire[1] == 0x8b;
+    if (compressed && !gunzip(wire, raw)) return false;
+    if (!compressed) raw = wire;
+
+    ConfigTree next;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        size_t eol = raw.find('\n', pos);
+        if (eol == std::string::npos) return false;
+        std::istringstream header(raw.substr(pos, eol - pos));
+        pos = eol + 1;
+        std::string kind, name, sum;
+        size_t len = 0;
+        if (!(header >> kind >> name >> sum)) return false;
+
+        std::string body;
+        if (kind == "+") {
+            if (!(header >> len) || pos + len > raw.size()) return false;
+            body = raw.substr(pos, len);
+            pos += len;
+            if (tree.valid && (tree.checksums.count(name) == 0 || tree.checksums.at(name) != sum)) {
+                next.changed.push_back(name);
+            }
+        } else if (kind != "=" || tree.checksums.count(name) == 0) {
+            return false;   // Unchanged part we do not hold: resync from scratch
+        }
+        next.checksums[name] = sum;
+
+        if (name == SYNC_ADDR_PART) {
+            if (kind == "=") next.interfaces = tree.interfaces;
+            else if (!parse_ip_addr_json(body, next.interfaces)) return false;
+        } else if (name == SYNC_ROUTE_PART) {
+            if (kind == "=") next.routes = tree.routes;
+            else if (!parse_ip_route_json(body, next.routes)) return false;
+        } else if (kind == "=") {
+            next.packages[name] = tree.packages.at(name);
+        } else {
+            UciPackage& pkg = next.packages[name];
+            pkg.text = body;
+            parse_uci_export(pkg);
+        }
+    }
+    for (const auto& [name, sum] : tree.checksums) {
+        if (next.checksums.count(name) == 0) next.changed.push_back(name);
+    }
+
+    next.valid = true;
+    next.synced = std::chrono::steady_clock::now();
+    next.synced_at = time(nullptr);
+    next.wire_bytes = wire.size();
+    next.raw_bytes = raw.size();
+    tree = std::move(next);
+    return true;
+}
+
+// Brings config_tree up to date. Within the show cache TTL the tree is
+// reused unless `fresh` or an apply made it stale.
+bool sync_config(bool fresh) {
+    if (mock_mode || fleet_mode) {
+        std::cout << "% Router configuration is not synced in " << (mock_mode ? "mock" : "fleet") << " mode\n";
+        return false;
+    }
+    auto age = std::chrono::steady_clock::now() - config_tree.synced;
+    if (config_tree.valid && !fresh && !config_tree.stale && age < std::chrono::seconds(show_cache_ttl)) {
+        return true;
+    }
+
+    uint64_t start = hist_now_us();
+    for (int attempt = 0; attempt < 2; attempt++) {
+        std::string wire;
+        if (run_remote_captured(ssh_pool, "sh -s", build_sync_script(config_tree), wire) != 0) {
+            std::cout << "% Config sync failed\n";
+            return false;
+        }
+        if (apply_sync_output(wire, config_tree)) {
+            hist_record_since(&stat_sync, start);
+            return true;
+        }
+        // A garbled or inconsistent reply: drop what we hold and fetch everything
+        config_tree = ConfigTree();
+    }
+    std::cout << "% Config sync failed: unreadable reply from router\n";
+    return false;
+}
+
+void print_sync_header(const char* what) {
+    char when[16];
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&config_tree.synced_at));
+    std::cout << "! " << what << " of " << router_target.host << ", synced " << when << " ("
+              << config_tree.wire_bytes << " bytes transferred, " << config_tree.raw_bytes << " uncompressed)\n";
+    if (!config_tree.changed.empty()) {
+        std::cout << "! Changed since the previous sync:";
+        for (const auto& name : config_tree.changed) {
+            if (name == SYNC_ADDR_PART) std::cout << " interfaces";
+            else if (name == SYNC_ROUTE_PART) std::cout << " routes";
+            else std::cout << " " << name;
+        }
+        std::cout << "\n";
+    }
+    std::cout << "!\n";
+}
+
+void print_uci_packages() {
+    for (const auto& [name, pkg] : config_tree.packages) {
+        std::cout << pkg.text;
+        if (!pkg.text.empty() && pkg.text.back() != '\n') std::cout << "\n";
+        std::cout << "!\n";
+    }
+}
+
+void print_pending_commands() {
+    std::cout << "! Pending commands:\n";
+    for (const auto& cmd : pending_commands) {
+        std::cout << cmd << "\n";
+    }
+}
+
+// Running config: the UCI packages plus what the kernel is running now
+void print_running_config() {
+    print_sync_header("Running configuration");
+    print_uci_packages();
+    for (const auto& f : config_tree.interfaces) {
+        std::cout << "interface " << f.name << "\n";
+        for (const auto& a : f.addrs) std::cout << " ip address " << a << "\n";
+        if (f.mtu) std::cout << " mtu " << f.mtu << "\n";
+        if (!f.mac.empty()) std::cout << " mac-address " << f.mac << "\n";
+        std::cout << (f.up ? " no shutdown\n" : " shutdown\n") << "!\n";
+    }
+    for (const auto& r : config_tree.routes) {
+        std::cout << "ip route " << r.dst;
+        if (!r.gateway.empty()) std::cout << " via " << r.gateway;
+        if (!r.dev.empty()) std::cout << " dev " << r.dev;
+        if (!r.protocol.empty()) std::cout << " ! " << r.protocol;
+        std::cout << "\n";
+    }
+    std::cout << "!\n";
+    print_pending_commands();
+}
+
+const LiveInterface* live_interface(const std::string& name) {
+    for (const auto& f : config_tree.interfaces) {
+        if (f.name == name) return &f;
+    }
+    return nullptr;
+}
+
+// What the planned pending queue would change, as -/+ lines against the tree
+void print_pending_diff() {
+    print_sync_header("Pending changes against the running configuration");
+    auto plan = plan_apply(pending_commands);
+    size_t changes = 0;
+    for (const auto& cmd : plan) {
+        PlannedOp op = classify_pending(cmd);
+        std::vector<std::string> words;
+        std::istringstream in(cmd);
+        for (std::string w; in >> w; ) words.push_back(w);
+
+        switch (op.kind) {
+            case PlannedOp::UCI_SET: {
+                std::string value = uci_unquote(cmd.substr(cmd.find('=') + 1));
+                const UciOption* old = uci_lookup(op.key);
+                if (old && old->value == value) continue;
+                if (old) std::cout << "- " << op.key << "='" << old->value << "'\n";
+                std::cout << "+ " << op.key << "='" << value << "'\n";
+                break;
+            }
+            case PlannedOp::ROUTE_ADD: {
+                for (const auto& r : config_tree.routes) {
+                    if (r.dst == op.key || r.dst + "/32" == op.key || (r.dst == "default" && op.key == "0.0.0.0/0")) {
+                        std::cout << "- ip route " << r.dst << (r.gateway.empty() ? "" : " via " + r.gateway) << "\n";
+                    }
+                }
+                std::cout << "+ ip route " << op.key << " via " << words[5] << "\n";
+                break;
+            }
+            case PlannedOp::IFACE_ADDRESS: {
+                uint32_t mask = 0;
+                parse_ipv4(words[4], mask);
+                std::string addr = words[2] + "/" + std::to_string(__builtin_popcount(mask));
+                const LiveInterface* f = live_interface(op.key);
+                if (f && f->up && std::find(f->addrs.begin(), f->addrs.end(), addr) != f->addrs.end()) continue;
+                if (f) {
+                    for (const auto& a : f->addrs) std::cout << "- interface " << op.key << " ip address " << a << "\n";
+                    if (!f->up) std::cout << "- interface " << op.key << " shutdown\n";
+                }
+                std::cout << "+ interface " << op.key << " ip address " << addr << "\n";
+                break;
+            }
+            case PlannedOp::IFACE_STATE: {
+                bool up = words[2] == "up";
+                const LiveInterface* f = live_interface(op.key);
+                if (f && f->up == up) continue;
+                if (f) std::cout << "- interface " << op.key << (f->up ? " no shutdown" : " shutdown") << "\n";
+                std::cout << "+ interface " << op.key << (up ? " no shutdown" : " shutdown") << "\n";
+                break;
+            }
+            case PlannedOp::UCI_COMMIT:
+            case PlannedOp::RELOAD:
+                continue;
+            case PlannedOp::OTHER:
+                std::cout << "? " << cmd << "\n";
+                break;
+        }
+        changes++;
+    }
+    if (changes == 0) std::cout << "! No changes: the pending commands match the router\n";
+}
+
+// True unless nothing ran or everything that ran was cleanly rolled back
+bool apply_left_changes(const std::vector<CommandResult>& results, const ApplyRollback& rollback) {
+    bool ran = std::any_of(results.begin(), results.end(), [](const CommandResult& r) { return r.exit_status != -1; });
+    return ran && !(rollback.attempted && rollback.failed_steps == 0);
+}
+
+// --- Transports ---
+//
+// Applies and `show ip interface` go through a Transport. ShellTransport is
+// the SSH path above: the plan runs as one `sh -s` script and the router
+// forks a process for every command. UbusTransport (--transport ubus) calls
+// rpcd and netifd directly through OpenWrt's JSON-RPC endpoint
+// (http://<router>/ubus) over one keep-alive connection. Each planned
+// command becomes one ubus call, nothing is forked on the router, and the
+// replies are JSON that JsonDoc parses in place. Config sync, the other
+// show commands, copy and fleet mode always use SSH.
+
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual const char* name() const = 0;
+    // Runs a planned apply. On failure the router is restored (see ApplyRollback).
+    virtual std::vector<CommandResult> apply(const std::vector<std::string>& plan, ApplyRollback* rollback) = 0;
+    virtual void show_interfaces(bool fresh) = 0;
+};
+
+class ShellTransport : public Transport {
+public:
+    const char* name() const override { return "shell"; }
+
+    std::vector<CommandResult> apply(const std::vector<std::string>& plan, ApplyRollback* rollback) override {
+        return apply_commands(ssh_pool, plan, rollback);
+    }
+
+    void show_interfaces(bool fresh) override {
+        show_remote("ip address show", fresh, MONITOR_REQ_INTERFACES);
+    }
+};
+
+#define UBUS_PORT 80                // uhttpd (--ubus-port N)
+#define UBUS_PATH "/ubus"
+#define UBUS_NULL_SESSION "00000000000000000000000000000000"   // Only session.login works with it
+#define UBUS_CONFIRM_TIMEOUT 30     // rpcd rolls `uci apply` back if it is not confirmed in time
+#define UBUS_ACCESS_DENIED -32002   // JSON-RPC error for an expired or unknown session
+#define UBUS_CALL_FAILED 255        // Exit status for a call that never got a ubus status
+
+std::string json_quote(std::string_view s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out += esc;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// HTTP/1.1 client for one endpoint, just enough for JSON-RPC: POST with
+// Content-Length, replies with Content-Length or chunked bodies. The
+// connection is kept open between requests.
+class HttpConnection {
+public:
+    HttpConnection(std::string host, int port) : host_(std::move(host)), port_(port) {}
+    ~HttpConnection() { disconnect(); }
+
+    // POSTs a JSON body. Returns the HTTP status with the response body in
+    // `out`, or -1 if the router could not be reached.
+    int post(const char* path, const std::string& body, std::string& out) {
+        // A kept-alive connection the server has closed fails on first use,
+        // before any reply: retry once on a new one. Once part of a reply
+        // has arrived the call ran, and sending it again could run it twice.
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool reused = fd_ >= 0;
+            if (!reused && !connect()) return -1;
+            int status = exchange(path, body, out);
+            if (status >= 0) return status;
+            bool replied = !in_.empty();
+            disconnect();
+            if (!reused || replied) return -1;
+        }
+        return -1;
+    }
+
+    void disconnect() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        in_.clear();
+        pos_ = 0;
+    }
+
+private:
+    bool connect() {
+        fd_ = tcp_connect(host_, port_);
+        if (fd_ < 0) return false;
+        timeval tv{SSH_TIMEOUT_MS / 1000, (SSH_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        return true;
+    }
+
+    bool send_all(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // Makes sure in_ holds at least `want` bytes past pos_
+    bool fill(size_t want) {
+        char buffer[16384];
+        while (in_.size() - pos_ < want) {
+            ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+            if (n <= 0) return false;
+            in_.append(buffer, n);
+        }
+        return true;
+    }
+
+    // Reads up to and including the next CRLF; returns the line without it
+    bool read_line(std::string_view& line) {
+        size_t eol;
+        while ((eol = in_.find("\r\n", pos_)) == std::string::npos) {
+            if (!fill(in_.size() - pos_ + 1)) return false;
+        }
+        line = std::string_view(in_).substr(pos_, eol - pos_);
+        pos_ = eol + 2;
+        return true;
+    }
+
+    int exchange(const char* path, const std::string& body, std::string& out) {
+        std::string request = std::string("POST ") + path + " HTTP/1.1\r\n"
+                              "Host: " + host_ + "\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                              "Connection: keep-alive\r\n\r\n" + body;
+        if (!send_all(request)) return -1;
+
+        std::string_view line;
+        if (!read_line(line) || line.substr(0, 5) != "HTTP/" || line.size() < 12) return -1;
+        int status = 0;
+        std::from_chars(line.data() + 9, line.data() + 12, status);
+
+        long length = -1;
+        bool chunked = false, keep_alive = true;
+        while (read_line(line) && !line.empty()) {
+            std::string header(line.substr(0, line.find(':')));
+            std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+            std::string_view value = line.substr(std::min(line.size(), header.size() + 1));
+            while (!value.empty() && value[0] == ' ') value.remove_prefix(1);
+            if (header == "content-length") std::from_chars(value.data(), value.data() + value.size(), length);
+            else if (header == "transfer-encoding" && value.find("chunked") != std::string_view::npos) chunked = true;
+            else if (header == "connection" && value.find("close") != std::string_view::npos) keep_alive = false;
+        }
+        if (!line.empty()) return -1;
+
+        out.clear();
+        if (chunked) {
+            while (true) {
+                if (!read_line(line)) return -1;
+                size_t size = 0;
+                std::from_chars(line.data(), line.data() + line.size(), size, 16);
+                if (size == 0) break;
+                if (!fill(size + 2)) return -1;
+                out.append(in_, pos_, size);
+                pos_ += size + 2;
+            }
+            while (read_line(line) && !line.empty()) {}   // Trailers
+        } else if (length >= 0) {
+            if (!fill(length)) return -1;
+            out.append(in_, pos_, length);
+            pos_ += length;
+        } else {
+            // Body runs to the end of the connection
+            while (fill(in_.size() - pos_ + 1)) {}
+            out.append(in_, pos_, std::string::npos);
+            pos_ = in_.size();
+            keep_alive = false;
+        }
+
+        in_.erase(0, pos_);
+        pos_ = 0;
+        if (!keep_alive) disconnect();
+        return status;
+    }
+
+    std::string host_;
+    int port_;
+    int fd_ = -1;
+    std::string in_;                // Received, not yet consumed
+    size_t pos_ = 0;
+};
+
+// One ubus call of the apply plan
+struct UbusCall {
+    std::string object, method, args;
+};
+
+class UbusTransport : public Transport {
+public:
+    UbusTransport(const RouterTarget& target, int port)
+        : http_(target.host, port), username_(target.username), password_(target.password) {}
+
+    const char* name() const override { return "ubus"; }
+
+    // Opens an rpcd session. Returns false (with the reason printed) if the
+    // router has no reachable /ubus endpoint or refuses the login.
+    bool login() {
+        session_ = UBUS_NULL_SESSION;
+        int status = call("session", "login",
+                          "{\"username\":" + json_quote(username_) + ",\"password\":" + json_quote(password_) + "}");
+        long sid = doc_.member(data_, "ubus_rpc_session");
+        if (status != 0 || sid < 0) {
+            std::cout << "% ubus login to " << UBUS_PATH << " failed: " << (status == 0 ? "no session" : error_) << "\n";
+            return false;
+        }
+        session_ = doc_.str(sid);
+        return true;
+    }
+
+    // Calls object.method with `args` (a JSON object). Returns the ubus
+    // status (0: success), with the reply's data object in data_ (-1 if it
+    // has none), or UBUS_CALL_FAILED with the reason in error_.
+    int call(const char* object, const char* method, const std::string& args) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            uint64_t start = hist_now_us();
+            std::string body = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(++id_) +
+                               ",\"method\":\"call\",\"params\":[" + json_quote(session_) + "," +
+                               json_quote(object) + "," + json_quote(method) + "," + args + "]}";
+            data_ = -1;
+            int http = http_.post(UBUS_PATH, body, reply_);
+            if (http < 0) return fail("no connection to the router's " UBUS_PATH);
+            if (http != 200) return fail("HTTP " + std::to_string(http));
+            if (!doc_.parse(reply_) || doc_[0].type != JsonToken::OBJECT) return fail("malformed reply");
+
+            long error = doc_.member(0, "error");
+            if (error >= 0) {
+                // Sessions expire after rpcd's timeout: log in again once
+                if (doc_.num(doc_.member(error, "code"), 0) == UBUS_ACCESS_DENIED && attempt == 0 &&
+                    session_ != UBUS_NULL_SESSION && login()) {
+                    continue;
+                }
+                return fail(doc_.str(doc_.member(error, "message")));
+            }
+            long result = doc_.member(0, "result");
+            if (result < 0 || doc_[result].type != JsonToken::ARRAY || doc_[result].size == 0) {
+                return fail("malformed reply");
+            }
+            hist_record_since(&stat_ubus_call, start);
+            size_t code = doc_.first_child(result);
+            if (doc_[result].size > 1) data_ = (long)doc_.next_sibling(code);
+            int status = (int)doc_.num(code, UBUS_CALL_FAILED);
+            if (status != 0) error_ = status_text(status);
+            return status;
+        }
+        return fail("access denied");
+    }
+
+    std::vector<CommandResult> apply(const std::vector<std::string>& plan, ApplyRollback* rollback) override;
+    void show_interfaces(bool fresh) override;
+
+private:
+    int fail(const std::string& why) {
+        error_ = why;
+        return UBUS_CALL_FAILED;
+    }
+
+    static std::string status_text(int status) {
+        static const char* names[] = {
+            "ok", "invalid command", "invalid argument", "method not found", "not found",
+            "no data", "permission denied", "timeout", "not supported", "unknown error",
+            "connection failed",
+        };
+        return status > 0 && status < (int)(sizeof(names) / sizeof(names[0]))
+            ? names[status] : "ubus status " + std::to_string(status);
+    }
+
+    HttpConnection http_;
+    std::string username_, password_;
+    std::string session_ = UBUS_NULL_SESSION;
+    uint64_t id_ = 0;
+    std::string reply_;             // Last reply; doc_'s tokens point into it
+    JsonDoc doc_;
+    long data_ = -1;
+    std::string error_;
+};
+
+// The ubus call for a planned command, or false if ubus has no method for
+// it (routes, ifconfig and anything the planner does not recognise).
+// Commits are not mapped here: apply() turns them into one `uci apply`.
+bool ubus_call_for(const std::string& cmd, UbusCall& call) {
+    PlannedOp op = classify_pending(cmd);
+    if (op.kind == PlannedOp::UCI_SET) {
+        size_t d1 = op.key.find('.');
+        size_t d2 = op.key.rfind('.');
+        if (d1 == d2) return false;
+        call = {"uci", "set",
+                "{\"config\":" + json_quote(op.key.substr(0, d1)) +
+                ",\"section\":" + json_quote(op.key.substr(d1 + 1, d2 - d1 - 1)) +
+                ",\"values\":{" + json_quote(op.key.substr(d2 + 1)) + ":" +
+                json_quote(uci_unquote(cmd.substr(cmd.find('=') + 1))) + "}}"};
+        return true;
+    }
+    if (op.kind != PlannedOp::RELOAD) return false;
+    if (op.key == "wifi reload") {
+        call = {"network", "reload", "{}"};
+    } else if (starts_with(op.key, "wifi up ")) {
+        call = {"network.wireless", "up", "{\"device\":" + json_quote(op.key.substr(8)) + "}"};
+    } else {
+        // /etc/init.d/<name> reload|restart
+        std::istringstream words(cmd);
+        std::string script, action;
+        words >> script >> action;
+        call = {"rc", "init", "{\"name\":" + json_quote(script.substr(12)) + ",\"action\":" + json_quote(action) + "}"};
+    }
+    return true;
+}
+
+// The sets are staged in the rpcd session. The first commit of the plan
+// becomes one `uci apply` with rollback armed, which commits every staged
+// package together. Reloads follow, and `uci confirm` disarms the rollback.
+// A failure before the apply reverts the staged packages. A failure after it
+// calls `uci rollback`, and rpcd restores the packages as they were.
+std::vector<CommandResult> UbusTransport::apply(const std::vector<std::string>& plan, ApplyRollback* rollback) {
+    std::vector<UbusCall> calls(plan.size());
+    for (size_t i = 0; i < plan.size(); i++) {
+        if (classify_pending(plan[i]).kind == PlannedOp::UCI_COMMIT) continue;
+        if (!ubus_call_for(plan[i], calls[i])) {
+            // Splitting the plan would lose the all-or-nothing apply
+            std::cout << "% ubus has no method for '" << plan[i] << "'; applying over SSH\n";
+            return ShellTransport().apply(plan, rollback);
+        }
+    }
+
+    uint64_t start = hist_now_us();
+    std::vector<CommandResult> results(plan.size());
+    for (size_t i = 0; i < plan.size(); i++) results[i].command = plan[i];
+    std::vector<std::string> packages;
+    bool applied = false, failed = false;
+    bool maybe_applied = false;   // `uci apply` was sent but its reply was lost
+    for (size_t i = 0; i < plan.size() && !failed; i++) {
+        CommandResult& r = results[i];
+        PlannedOp op = classify_pending(plan[i]);
+        if (op.kind == PlannedOp::UCI_COMMIT) {
+            if (!applied) {
+                r.exit_status = call("uci", "apply",
+                                     "{\"rollback\":true,\"timeout\":" + std::to_string(UBUS_CONFIRM_TIMEOUT) + "}");
+                applied = r.exit_status == 0;
+                maybe_applied = r.exit_status == UBUS_CALL_FAILED;
+            } else {
+                r.exit_status = 0;   // Committed by the `uci apply` above
+            }
+        } else {
+            r.exit_status = call(calls[i].object.c_str(), calls[i].method.c_str(), calls[i].args);
+            if (op.kind == PlannedOp::UCI_SET) {
+                std::string package = op.key.substr(0, op.key.find('.'));
+                if (std::find(packages.begin(), packages.end(), package) == packages.end()) packages.push_back(package);
+            }
+        }
+        if (r.exit_status != 0) {
+            r.output = error_ + "\n";
+            failed = true;
+        }
+    }
+
+    if (failed && rollback) {
+        rollback->attempted = true;
+        // If the lost apply did run, rollback undoes it; if not, rpcd has
+        // nothing to roll back and the staged changes are reverted instead
+        int restored = applied || maybe_applied ? call("uci", "rollback", "{}") : UBUS_CALL_FAILED;
+        if (applied) {
+            if (restored != 0) {
+                rollback->failed_steps++;
+                rollback->output += "uci rollback: " + error_ + "\n";
+            }
+        } else if (restored != 0) {
+            for (const auto& package : packages) {
+                if (call("uci", "revert", "{\"config\":" + json_quote(package) + "}") != 0) {
+                    rollback->failed_steps++;
+                    rollback->output += "uci revert " + package + ": " + error_ + "\n";
+                }
+            }
+        }
+    } else if (applied && call("uci", "confirm", "{}") != 0) {
+        std::cout << "% uci confirm failed (" << error_ << "); rpcd will roll the changes back in "
+                  << UBUS_CONFIRM_TIMEOUT << " s\n";
+    }
+    if (!failed) hist_record_since(&stat_apply, start);
+    return results;
+}
+
+// `network.interface dump` (logical interfaces, their device and
+// addresses) joined with `network.device status` (MAC, MTU, carrier).
+// Cached like the shell transport's `ip address show`.
+void UbusTransport::show_interfaces(bool fresh) {
+    const std::string cache_key = "ubus network.interface dump";
+    if (!fresh) {
+        if (const CachedShow* hit = show_cache_lookup(cache_key)) {
+            std::cout << hit->output;
+            return;
+        }
+    }
+
+    struct Row {
+        std::string name, device, proto, addrs, mac, mtu;
+        bool up = false, carrier = false;
+    };
+    std::vector<Row> rows;
+    uint64_t start = hist_now_us();
+    if (call("network.interface", "dump", "{}") != 0) {
+        std::cout << "% network.interface dump failed: " << error_ << "\n";
+        return;
+    }
+    long list = doc_.member(data_, "interface");
+    size_t i = doc_.first_child(list);
+    for (uint32_t n = 0; list >= 0 && n < doc_[list].size; n++, i = doc_.next_sibling(i)) {
+        Row row;
+        row.name = doc_.str(doc_.member(i, "interface"));
+        row.device = doc_.str(doc_.member(i, "l3_device"));
+        if (row.device.empty()) row.device = doc_.str(doc_.member(i, "device"));
+        row.proto = doc_.str(doc_.member(i, "proto"));
+        row.up = doc_.view(doc_.member(i, "up")) == "true";
+        for (const char* family : {"ipv4-address", "ipv6-address"}) {
+            long addrs = doc_.member(i, family);
+            size_t a = doc_.first_child(addrs);
+            for (uint32_t k = 0; addrs >= 0 && k < doc_[addrs].size; k++, a = doc_.next_sibling(a)) {
+                if (!row.addrs.empty()) row.addrs += " ";
+                row.addrs += doc_.str(doc_.member(a, "address")) + "/" + std::to_string(doc_.num(doc_.member(a, "mask"), 0));
+            }
+        }
+        rows.push_back(row);
+    }
+
+    // All devices in one call
+    if (call("network.device", "status", "{}") == 0) {
+        for (auto& row : rows) {
+            long dev = doc_.member(data_, row.device);
+            if (dev < 0) continue;
+            row.mac = doc_.str(doc_.member(dev, "macaddr"));
+            row.mtu = std::string(doc_.view(doc_.member(dev, "mtu")));
+            row.carrier = doc_.view(doc_.member(dev, "carrier")) == "true";
+        }
+    }
+    hist_record_since(&stat_show, start);
+
+    std::ostringstream out;
+    out << std::left << std::setw(12) << "Interface" << std::setw(12) << "Device" << std::setw(8) << "Proto"
+        << std::setw(10) << "State" << std::setw(19) << "MAC" << std::setw(7) << "MTU" << "Addresses\n";
+    for (const auto& row : rows) {
+        out << std::setw(12) << row.name << std::setw(12) << (row.device.empty() ? "-" : row.device)
+            << std::setw(8) << row.proto
+            << std::setw(10) << (!row.up ? "down" : row.carrier || row.mac.empty() ? "up" : "no-carrier")
+            << std::setw(19) << (row.mac.empty() ? "-" : row.mac) << std::setw(7) << (row.mtu.empty() ? "-" : row.mtu)
+            << (row.addrs.empty() ? "-" : row.addrs) << "\n";
+    }
+    std::cout << out.str();
+    show_cache_store(cache_key, out.str());
+}
+
+ShellTransport shell_transport;
+std::unique_ptr<UbusTransport> ubus_transport;
+Transport* transport = &shell_transport;
+
+// Plans and applies pending_commands (to the fleet in fleet mode). The queue
+// is cleared unless the apply failed and left every router unchanged, so it
+// can be fixed and retried. Returns true if every command succeeded everywhere.
+bool apply_pending() {
+    if (pending_commands.empty()) {
+        std::cout << "% No changes to apply\n";
+        return true;
+    }
+
+    auto plan = plan_apply(pending_commands);
+    cli_log("apply: %zu queued, %zu planned%s", pending_commands.size(), plan.size(),
+            fleet_mode ? ", fleet" : "");
+    if (plan.size() < pending_commands.size()) {
+        std::cout << "% Planner reduced " << pending_commands.size() << " queued commands to "
+                  << plan.size() << "\n";
+    }
+
+    bool ok = true;
+    bool changed = false;   // Some router kept (part of) the changes
+    if (fleet_mode) {
+        std::cout << "Applying " << plan.size() << " commands to "
+                  << fleet.size() << " routers...\n";
+        auto fleet_results = apply_to_fleet(fleet, plan);
+        print_fleet_report(fleet_results);
+        for (const auto& r : fleet_results) {
+            bool router_ok = r.reachable;
+            for (const auto& c : r.results) {
+                if (c.exit_status != 0) router_ok = false;
+            }
+            if (!router_ok) ok = false;
+            if (r.reachable && apply_left_changes(r.results, r.rollback)) changed = true;
+        }
+    } else {
+        std::cout << "Applying " << plan.size() << " commands...\n";
+        ApplyRollback rollback;
+        auto results = transport->apply(plan, &rollback);
+        log_apply_results(router_target.name, results, rollback);
+        print_apply_report(results);
+        print_rollback_report(rollback, results);
+        show_cache_invalidate_applied(results);
+        for (const auto& r : results) {
+            if (r.exit_status != 0) ok = false;
+        }
+        changed = apply_left_changes(results, rollback);
+
+        std::string refresh;
+        if (monitor_call(MONITOR_REQ_REFRESH, refresh)) {
+            std::cout << "% Monitor refreshed (" << refresh.substr(0, refresh.find('\n')) << ")\n";
+        }
+    }
+    routing_table_loaded = false;
+    config_tree.stale = true;
+
+    // After a clean rollback everywhere the queue is still valid to retry
+    // (fix it with more edits, or drop it with `clear pending`)
+    if (!ok && !changed) {
+        std::cout << "% " << pending_commands.size() << " commands kept pending\n";
+        return ok;
+    }
+    pending_commands.clear();
+    return ok;
+}
+
+// --- Bulk Config Push ---
+//
+// `copy <file | directory> startup-config [reload]` replaces whole UCI
+// packages in /etc/config at once instead of one `uci set` exec per option.
+// One exec reads the router's md5sums; unchanged files are skipped. A
+// changed file is sent as an rsync-style delta against the copy this CLI
+// pushed last time (PUSH_CACHE_DIR/<host>/<name>), if the router still has
+// exactly that copy: blocks that are still in the old file are copied on the
+// router with dd and only the rest is sent. All new bytes go up as one blob
+// over SFTP on the compressed session (exec + cat if the router has no SFTP
+// server). One script then rebuilds every file next to its target, checks
+// each md5sum and renames them all into place only if every one matches.
+
+#define PUSH_REMOTE_DIR "/etc/config"
+#define PUSH_CACHE_DIR "state/push_cache"
+#define PUSH_BLOB_PATH "/tmp/.router_cli_push"
+#define PUSH_MIN_BLOCK 256          // Delta block size is about sqrt(file size), within these
+#define PUSH_MAX_BLOCK 8192
+
+// rsync's rolling checksum over a window: the byte sum and the
+// position-weighted sum, 16 bits each. Sliding the window by one byte is
+// O(1), so every offset of the new file can be looked up.
+struct RollingSum {
+    uint32_t a = 0, b = 0;
+
+    void init(const unsigned char* p, size_t len) {
+        a = b = 0;
+        for (size_t i = 0; i < len; i++) {
+            a += p[i];
+            b += (uint32_t)(len - i) * p[i];
+        }
+    }
+    void roll(unsigned char out, unsigned char in, size_t len) {
+        a += in - out;
+        b += a - (uint32_t)len * out;
+    }
+    uint32_t digest() const { return (a & 0xffff) | (b << 16); }
+};
+
+// Rebuilds one file on the router: copied base blocks and literal bytes from the blob
+struct DeltaOp {
+    bool copy;                      // Base blocks [start, start + count) ...
+    size_t start, count;            // ... or blob bytes [start, start + count)
+};
+
+struct PushFile {
+    std::string name;               // UCI package
+    std::string data;
+    std::string md5;
+    size_t block = 0;               // 0: sent whole
+    std::vector<DeltaOp> ops;
+    size_t literal = 0;             // Bytes of it in the blob
+};
+
+size_t delta_block_size(size_t len) {
+    size_t block = PUSH_MIN_BLOCK;
+    while (block < PUSH_MAX_BLOCK && block * block < len) block *= 2;
+    return block;
+}
+
+void add_literal(PushFile& f, std::string& blob, size_t from, size_t to) {
+    if (from == to) return;
+    f.ops.push_back({false, blob.size(), to - from});
+    blob.append(f.data, from, to - from);
+    f.literal += to - from;
+}
+
+// Fills f.ops with a delta of f.data against `base`; the literal bytes are appended to `blob`
+void compute_delta(PushFile& f, const std::string& base, std::string& blob) {
+    const size_t block = f.block = delta_block_size(base.size());
+    const auto* old_bytes = reinterpret_cast<const unsigned char*>(base.data());
+    const auto* bytes = reinterpret_cast<const unsigned char*>(f.data.data());
+    const size_t size = f.data.size();
+
+    std::unordered_multimap<uint32_t, size_t> blocks;   // Checksum -> base block
+    RollingSum sum;
+    for (size_t i = 0; (i + 1) * block <= base.size(); i++) {
+        sum.init(old_bytes + i * block, block);
+        blocks.emplace(sum.digest(), i);
+    }
+
+    size_t pos = 0, literal_from = 0;
+    if (size >= block) sum.init(bytes, block);
+    while (pos + block <= size) {
+        auto range = blocks.equal_range(sum.digest());
+        auto hit = std::find_if(range.first, range.second, [&](const auto& entry) {
+            return memcmp(old_bytes + entry.second * block, bytes + pos, block) == 0;
+        });
+        if (hit == range.second) {
+            if (pos + block < size) sum.roll(bytes[pos], bytes[pos + block], block);
+            pos++;
+            continue;
+        }
+        add_literal(f, blob, literal_from, pos);
+        if (!f.ops.empty() && f.ops.back().copy && f.ops.back().start + f.ops.back().count == hit->second) {
+            f.ops.back().count++;
+        } else {
+            f.ops.push_back({true, hit->second, 1});
+        }
+        pos += block;
+        literal_from = pos;
+        if (pos + block <= size) sum.init(bytes + pos, block);
+    }
+    add_literal(f, blob, literal_from, size);
+}
+
+// The script that rebuilds, checks and renames the files (see the section comment)
+std::string build_push_script(const std::vector<PushFile>& files, const std::string& blob_path, bool reload) {
+    std::ostringstream s;
+    s << "B=" << shell_quote(blob_path) << "\n"
+      << "p() { tail -c +$(($1 + 1)) \"$B\" | head -c $2; }\n"
+      << "c() { dd if=\"$1\" bs=$2 skip=$3 count=$4 2>/dev/null; }\n"
+      << "ok=1\n";
+    for (const auto& f : files) {
+        std::string dst = PUSH_REMOTE_DIR "/" + f.name;
+        std::string tmp = PUSH_REMOTE_DIR "/." + f.name + ".push";
+        s << "{ :";
+        for (const auto& op : f.ops) {
+            if (op.copy) s << "; c " << dst << " " << f.block << " " << op.start << " " << op.count;
+            else s << "; p " << op.start << " " << op.count;
+        }
+        s << "; } > " << tmp << "\n"
+          << "s=$(md5sum < " << tmp << "); [ \"${s%% *}\" = " << f.md5 << " ] || { echo \"bad " << f.name << "\"; ok=0; }\n";
+    }
+    s << "if [ $ok = 1 ]; then\n";
+    for (const auto& f : files) {
+        s << "  mv -f " << PUSH_REMOTE_DIR "/." << f.name << ".push " << PUSH_REMOTE_DIR "/" << f.name << " || ok=0\n";
+    }
+    s << "  [ $ok = 1 ] && echo committed\n";
+    if (reload) s << "  reload_config && echo reloaded\n";
+    s << "fi\n"
+      << "rm -f \"$B\" " PUSH_REMOTE_DIR "/.*.push\n";
+    return s.str();
+}
+
+// Writes `data` to `path` on the router over SFTP. Returns false if the
+// router has no SFTP server or the write failed.
+bool sftp_upload(SshSessionPool* pool, const std::string& path, const std::string& data) {
+    auto lease = pool ? pool->acquire() : SshSessionPool::Lease();
+    if (!lease) return false;
+    LIBSSH2_SFTP* sftp = libssh2_sftp_init(lease.session());
+    if (!sftp) return false;
+    LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(sftp, path.c_str(),
+        LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC, 0600);
+    bool ok = file != nullptr;
+    size_t written = 0;
+    while (ok && written < data.size()) {
+        ssize_t n = libssh2_sftp_write(file, data.data() + written, data.size() - written);
+        if (n <= 0) ok = false;
+        else written += n;
+    }
+    if (file && libssh2_sftp_close(file) != 0) ok = false;
+    libssh2_sftp_shutdown(sftp);
+    return ok;
+}
+
+bool valid_package_name(const std::string& name) {
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+        return isalnum((unsigned char)c) || c == '_' || c == '-';
+    });
+}
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+// The files to push: `path` itself, or the regular files in it
+bool load_push_files(const std::string& path, std::vector<PushFile>& files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        std::cout << "% Cannot read " << path << "\n";
+        return false;
+    }
+    std::vector<std::pair<std::string, std::string>> found;   // (package, file)
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            std::cout << "% Cannot read " << path << "\n";
+            return false;
+        }
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            std::string file = path + "/" + name;
+            if (name[0] == '.' || stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+            found.emplace_back(name, file);
+        }
+        closedir(dir);
+        std::sort(found.begin(), found.end());
+    } else {
+        found.emplace_back(path.substr(path.rfind('/') + 1), path);
+    }
+
+    for (const auto& [name, file] : found) {
+        if (!valid_package_name(name)) {
+            std::cout << "% '" << name << "' is not a UCI package name\n";
+            return false;
+        }
+        PushFile f;
+        f.name = name;
+        if (!read_file(file, f.data)) {
+            std::cout << "% Cannot read " << file << "\n";
+            return false;
+        }
+        char md5[33];
+        md5_hex(f.data.data(), f.data.size(), md5);
+        f.md5 = md5;
+        files.push_back(std::move(f));
+    }
+    if (files.empty()) std::cout << "% No files in " << path << "\n";
+    return !files.empty();
+}
+
+std::string push_cache_path(const std::string& name) {
+    std::string host = router_target.host;
+    std::replace(host.begin(), host.end(), '/', '_');
+    return PUSH_CACHE_DIR "/" + host + "/" + name;
+}
+
+void push_cache_store(const PushFile& f) {
+    std::string path = push_cache_path(f.name);
+    mkdir(PUSH_CACHE_DIR, 0700);
+    mkdir(path.substr(0, path.rfind('/')).c_str(), 0700);
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(f.data.data(), f.data.size());
+    out.close();
+    if (out) rename(tmp.c_str(), path.c_str());
+    else unlink(tmp.c_str());
+}
+
+void push_startup_config(const std::string& path, bool reload) {
+    if (mock_mode || fleet_mode) {
+        std::cout << "% copy is not available in " << (mock_mode ? "mock" : "fleet") << " mode\n";
+        return;
+    }
+    std::vector<PushFile> files;
+    if (!load_push_files(path, files)) return;
+
+    // 1. What the router has now
+    std::string query = "cd " PUSH_REMOTE_DIR " && md5sum";
+    for (const auto& f : files) query += " " + f.name;
+    query += " 2>/dev/null; true";
+    std::string listing;
+    if (run_remote_captured(ssh_pool, query.c_str(), "", listing) != 0) {
+        std::cout << "% Cannot read " PUSH_REMOTE_DIR " on the router\n";
+        return;
+    }
+    std::map<std::string, std::string> remote_md5;
+    std::istringstream lines(listing);
+    std::string sum, name;
+    while (lines >> sum >> name) remote_md5[name] = sum;
+
+    // 2. Deltas against the cached copies the router still has
+    std::vector<PushFile> changed;
+    std::string blob;
+    size_t total = 0;
+    for (auto& f : files) {
+        auto it = remote_md5.find(f.name);
+        if (it != remote_md5.end() && it->second == f.md5) {
+            push_cache_store(f);   // Known to be on the router: a base for next time
+            continue;
+        }
+        std::string base;
+        char base_md5[33] = "";
+        if (it != remote_md5.end() && read_file(push_cache_path(f.name), base)) {
+            md5_hex(base.data(), base.size(), base_md5);
+        }
+        if (it != remote_md5.end() && it->second == base_md5) compute_delta(f, base, blob);
+        else add_literal(f, blob, 0, f.data.size());
+        total += f.data.size();
+        changed.push_back(std::move(f));
+    }
+    if (changed.empty()) {
+        std::cout << "% startup-config already matches (" << files.size() << " files)\n";
+        return;
+    }
+
+    // 3. The new bytes in one upload, then rebuild + check + rename
+    std::string blob_path = PUSH_BLOB_PATH "." + std::to_string(getpid());
+    if (!blob.empty() && !sftp_upload(ssh_pool, blob_path, blob)) {
+        std::string out;
+        if (run_remote_captured(ssh_pool, ("cat > " + blob_path).c_str(), blob, out) != 0) {
+            std::cout << "% Upload to the router failed; nothing was changed\n";
+            return;
+        }
+        std::cout << "% No SFTP on the router; sent over exec\n";
+    }
+    std::string output;
+    run_remote_captured(ssh_pool, "sh -s", build_push_script(changed, blob_path, reload), output);
+    routing_table_loaded = false;
+    config_tree.stale = true;
+
+    bool committed = output.find("committed") != std::string::npos;
+    for (const auto& f : changed) {
+        bool bad = output.find("bad " + f.name + "\n") != std::string::npos;
+        std::cout << "  " << std::left << std::setw(16) << f.name << std::right << std::setw(8) << f.data.size()
+                  << " bytes, sent " << std::setw(8) << f.literal
+                  << (f.block ? " (delta)" : " (whole)") << (bad ? "  CHECKSUM MISMATCH" : "") << "\n";
+        if (committed) push_cache_store(f);
+    }
+    if (!committed) {
+        std::cout << "% Push failed; the router's files were left unchanged\n";
+        return;
+    }
+    show_cache_invalidate(SUBSYS_ALL);
+    cli_log("copy: %zu of %zu files pushed, %zu of %zu bytes sent", changed.size(), files.size(), blob.size(), total);
+    std::cout << "% " << changed.size() << " of " << files.size() << " files replaced, "
+              << blob.size() << " of " << total << " bytes sent"
+              << (reload ? (output.find("reloaded") != std::string::npos ? ", services reloaded" : ", reload_config failed") : "")
+              << "\n";
+}
+
+// --- Interface Rates ---
+//
+// The monitor samples every interface's counters each few seconds into a
+// fixed ring per interface (see router_monitor.c, Interface Telemetry).
+// `show interfaces rate` asks it for the recent samples (TELEMETRY) and
+// prints current rates with a sparkline; with an interface name it prints
+// the whole history.
+
+#define RATE_SUMMARY_SAMPLES 30     // Sparkline width in the summary table
+#define RATE_DETAIL_WIDTH 60        // Sparkline width for one interface
+
+struct RateSample {
+    uint32_t time;
+    uint32_t rx_bytes, tx_bytes;    // Per second
+    uint32_t rx_packets, tx_packets;
+    uint32_t errors;                // During the interval
+    int signal;                     // dBm, 0: not a radio
+    int stations;
+};
+
+struct RateSeries {
+    std::string name;
+    std::vector<RateSample> samples;   // Oldest first
+};
+
+// Parses a TELEMETRY reply. Returns false if it is malformed.
+bool parse_telemetry_reply(const std::string& text, int& interval, std::vector<RateSeries>& out) {
+    std::istringstream in(text);
+    std::string word;
+    if (!(in >> word >> interval) || word != "interval") return false;
+    std::string name;
+    size_t count;
+    while (in >> word >> name >> count) {
+        if (word != "iface") return false;
+        RateSeries series{name, {}};
+        series.samples.resize(count);
+        for (auto& s : series.samples) {
+            std::string signal, stations;
+            if (!(in >> s.time >> s.rx_bytes >> s.tx_bytes >> s.rx_packets >> s.tx_packets >> s.errors >> signal >> stations)) {
+                return false;
+            }
+            s.signal = signal == "-" ? 0 : std::atoi(signal.c_str());
+            s.stations = stations == "-" ? 0 : std::atoi(stations.c_str());
+        }
+        out.push_back(std::move(series));
+    }
+    return in.eof();
+}
+
+// "12.3M" style rate, in bits per second when `bits` is set
+std::string format_rate(uint64_t per_second, bool bits) {
+    double v = bits ? per_second * 8.0 : per_second;
+    static const char* units[] = {"", "k", "M", "G", "T"};
+    int u = 0;
+    while (v >= 1000 && u < 4) {
+        v /= 1000;
+        u++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), u == 0 ? "%.0f%s" : "%.1f%s", v, units[u]);
+    return buf;
+}
+
+// `values` drawn as `width` block characters, each the peak of its share of
+// the values, scaled to the overall peak
+std::string sparkline(const std::vector<uint64_t>& values, size_t width) {
+    static const char* const blocks[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    if (values.empty()) return "";
+    width = std::min(width, values.size());
+    std::vector<uint64_t> columns(width, 0);
+    for (size_t i = 0; i < values.size(); i++) {
+        size_t c = i * width / values.size();
+        columns[c] = std::max(columns[c], values[i]);
+    }
+    uint64_t peak = *std::max_element(columns.begin(), columns.end());
+    std::string line;
+    for (uint64_t v : columns) line += blocks[peak ? v * 7 / peak : 0];
+    return line;
+}
+
+// Fetches the monitor's samples. Prints why on failure.
+bool fetch_rates(const std::string& args, int& interval, std::vector<RateSeries>& series) {
+    std::string reply;
+    if (!monitor_call(std::string(MONITOR_REQ_TELEMETRY) + args, reply)) {
+        std::cout << "% Interface rates come from router_monitor, which is not running"
+                  << (reply.empty() ? "" : " (" + reply + ")") << "\n";
+        return false;
+    }
+    if (!parse_telemetry_reply(reply, interval, series)) {
+        std::cout << "% Unexpected reply from router_monitor\n";
+        return false;
+    }
+    return true;
+}
+
+void print_rate_summary() {
+    int interval = 0;
+    std::vector<RateSeries> series;
+    if (!fetch_rates(" samples=" + std::to_string(RATE_SUMMARY_SAMPLES), interval, series)) return;
+    if (interval == 0) std::cout << "% Sampling is off in the monitor (--telemetry-interval 0)\n";
+
+    std::cout << std::left << std::setw(12) << "Interface" << std::right << std::setw(10) << "RX bit/s"
+              << std::setw(10) << "TX bit/s" << std::setw(8) << "Errors" << std::setw(8) << "Signal"
+              << std::setw(6) << "Sta" << "  Last " << RATE_SUMMARY_SAMPLES * interval << " s (RX+TX)\n";
+    for (const auto& s : series) {
+        std::cout << std::left << std::setw(12) << s.name << std::right;
+        if (s.samples.empty()) {
+            std::cout << std::setw(10) << "-" << std::setw(10) << "-" << "\n";
+            continue;
+        }
+        const RateSample& now = s.samples.back();
+        uint64_t errors = 0;
+        std::vector<uint64_t> total;
+        for (const auto& x : s.samples) {
+            errors += x.errors;
+            total.push_back((uint64_t)x.rx_bytes + x.tx_bytes);
+        }
+        std::cout << std::setw(10) << format_rate(now.rx_bytes, true) << std::setw(10) << format_rate(now.tx_bytes, true)
+                  << std::setw(8) << errors
+                  << std::setw(8) << (now.signal ? std::to_string(now.signal) : "-")
+                  << std::setw(6) << (now.signal ? std::to_string(now.stations) : "-")
+                  << "  " << sparkline(total, RATE_SUMMARY_SAMPLES) << "\n";
+    }
+}
+
+void print_rate_detail(const std::string& name) {
+    int interval = 0;
+    std::vector<RateSeries> series;
+    if (!fetch_rates(" iface=" + name, interval, series)) return;
+    if (series.empty() || series[0].samples.empty()) {
+        std::cout << "% No samples for " << name << "\n";
+        return;
+    }
+    const auto& samples = series[0].samples;
+    std::cout << name << ": " << samples.size() << " samples, " << interval << " s apart (last "
+              << (samples.back().time - samples.front().time + interval) / 60 << " min)\n";
+
+    struct Column {
+        const char* label;
+        uint32_t RateSample::*field;
+        bool bits;
+    };
+    static const Column columns[] = {
+        {"RX bit/s", &RateSample::rx_bytes, true},
+        {"TX bit/s", &RateSample::tx_bytes, true},
+        {"RX pkt/s", &RateSample::rx_packets, false},
+        {"TX pkt/s", &RateSample::tx_packets, false},
+    };
+    std::cout << std::left << std::setw(10) << "" << std::right << std::setw(9) << "now" << std::setw(9) << "avg"
+              << std::setw(9) << "peak" << "\n";
+    for (const auto& col : columns) {
+        std::vector<uint64_t> values;
+        uint64_t sum = 0;
+        for (const auto& s : samples) {
+            values.push_back(s.*col.field);
+            sum += s.*col.field;
+        }
+        std::cout << std::left << std::setw(10) << col.label << std::right
+                  << std::setw(9) << format_rate(values.back(), col.bits)
+                  << std::setw(9) << format_rate(sum / values.size(), col.bits)
+                  << std::setw(9) << format_rate(*std::max_element(values.begin(), values.end()), col.bits)
+                  << "  " << sparkline(values, RATE_DETAIL_WIDTH) << "\n";
+    }
+
+    uint64_t errors = 0;
+    for (const auto& s : samples) errors += s.errors;
+    std::cout << "Errors and drops: " << errors << "\n";
+    if (samples.back().signal) {
+        int weakest = 0;
+        for (const auto& s : samples) weakest = std::min(weakest, s.signal);
+        std::cout << "Signal: " << samples.back().signal << " dBm (weakest " << weakest << " dBm), "
+                  << samples.back().stations << " stations\n";
+    }
+}
+
+// --- Command Handlers ---
+
+// Set by a handler that refuses its command (batch mode stops on it)
+bool command_rejected = false;
+
+bool is_ipv4(std::string_view s) {
+    uint32_t addr;
+    return parse_ipv4(s, addr);
+}
+
+bool is_netmask(std::string_view s) {
+    uint32_t bits;
+    if (!parse_ipv4(s, bits)) return false;
+    return (bits & (~bits >> 1)) == 0;   // Contiguous ones, then zeros
+}
+
+// `fresh` as the optional last argument of a show command
+bool wants_fresh(const Args& args) {
+    return args.size() == 1 && abbreviates(args[0], "fresh");
+}
+
+void cmd_enable(const Args&) {
+    // Simulating simple auth or no auth for now as per shell scripts
+    std::cout << "% Entered privileged mode\n";
+}
+
+void cmd_user_exit(const Args&) {
+    std::cout << "Bye!\n";
+    cleanup_ssh();
+    exit(0);
+}
+
+void cmd_disable(const Args&) {
+    std::cout << "% Returned to user mode\n";
+}
+
+void cmd_configure(const Args&) {
+    std::cout << "% Entered config mode\n";
+}
+
+// `show running-config [fresh | diff]`: the router's config from the local
+// tree (see Config Sync), then the pending queue
+void cmd_show_running_config(const Args& args) {
+    bool diff = args.size() == 1 && abbreviates(args[0], "diff");
+    if (!sync_config(wants_fresh(args))) {
+        print_pending_commands();
+        return;
+    }
+    if (diff) print_pending_diff();
+    else print_running_config();
+}
+
+// `show startup-config [fresh]`: the UCI packages, i.e. what the router boots with
+void cmd_show_startup_config(const Args& args) {
+    if (!sync_config(wants_fresh(args))) return;
+    print_sync_header("Startup configuration");
+    print_uci_packages();
+}
+
+void cmd_show_statistics(const Args&) {
+    std::cout << "router_cli SSH latency:\n";
+    // Through std::cout, so output modifiers apply to the table
+    char* table = nullptr;
+    size_t table_len = 0;
+    if (FILE* mem = open_memstream(&table, &table_len)) {
+        hist_write_table(mem, all_stats, sizeof(all_stats) / sizeof(all_stats[0]));
+        fclose(mem);
+        std::cout.write(table, table_len);
+        free(table);
+    }
+    std::string monitor_stats;
+    if (monitor_call(MONITOR_REQ_STATS, monitor_stats)) {
+        std::cout << "\nrouter_monitor SSH latency:\n" << monitor_stats;
+    }
+}
+
+void cmd_show_fleet(const Args&) {
+    if (!fleet_mode) {
+        std::cout << "% Not in fleet mode (start with --fleet <inventory>)\n";
+        return;
+    }
+    for (const auto& t : fleet) {
+        std::cout << "  " << std::left << std::setw(16) << t.name
+                  << t.host << ":" << t.port << " (" << t.username << ")\n";
+    }
+}
+
+bool remote_show_allowed() {
+    if (fleet_mode) {
+        std::cout << "% Remote show commands are not available in fleet mode\n";
+        return false;
+    }
+    return true;
+}
+
+void cmd_show_ip_route(const Args& args) {
+    uint32_t address;
+    if (args.size() == 1 && parse_ipv4(args[0], address)) {
+        // Longest-prefix match against the local table
+        load_routing_table(false);
+        auto start = std::chrono::steady_clock::now();
+        const Route* route = routing_table.lookup(address);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (route) std::cout << "Routing entry for " << describe_route(*route) << "\n";
+        else std::cout << "% Network not in table\n";
+        std::cout << "% Looked up in " << ns << " ns (" << routing_table.size() << " routes)\n";
+        return;
+    }
+    if (!remote_show_allowed()) return;
+    if (wants_fresh(args)) routing_table_loaded = false;
+    show_remote("ip route show", wants_fresh(args));
+}
+
+void cmd_show_ip_interface(const Args& args) {
+    if (remote_show_allowed()) transport->show_interfaces(wants_fresh(args));
+}
+
+// `show logging [<lines>]`: the router's system log. Streamed and never
+// cached; it changes all the time and can run to megabytes.
+void cmd_show_logging(const Args& args) {
+    if (!remote_show_allowed()) return;
+    std::string cmd = "logread";
+    if (args.size() == 1) cmd += " | tail -n " + args.str(0);
+    show_remote(cmd, true);
+}
+
+// `show interfaces rate [<name>]`: interface throughput from the monitor
+void cmd_show_interfaces_rate(const Args& args) {
+    if (!remote_show_allowed()) return;
+    if (args.size() == 1) print_rate_detail(args.str(0));
+    else print_rate_summary();
+}
+
+void cmd_show_tech_support(const Args& args) {
+    if (!remote_show_allowed()) return;
+    // Every table at once over parallel channels
+    execute_remote_parallel({
+        {"System", "uci show system"},
+        {"Interfaces", "ip address show"},
+        {"Routes", "ip route show"},
+    }, wants_fresh(args));
+}
+
+// `terminal length <lines>`: pager height, 0 turns paging off
+void cmd_terminal_length(const Args& args) {
+    terminal_length = std::atoi(args.str(0).c_str());
+}
+
+// `copy <file | directory> startup-config [reload]`
+void cmd_copy(const Args& args) {
+    push_startup_config(args.str(0), args.size() == 3);
+}
+
+void cmd_apply(const Args&) {
+    apply_pending();
+}
+
+void cmd_clear_pending(const Args&) {
+    std::cout << "% Discarded " << pending_commands.size() << " pending commands\n";
+    pending_commands.clear();
+    routing_table_loaded = false;
+}
+
+void cmd_hostname(const Args& args) {
+    hostname = args.str(0);
+    // OpenWrt: uci set system.@system[0].hostname='hostname'; uci commit
+    pending_commands.push_back("uci set system.@system[0].hostname=" + shell_quote(hostname));
+    pending_commands.push_back("uci commit system");
+    pending_commands.push_back("/etc/init.d/system reload"); // Apply hostname
+}
+
+void cmd_interface(const Args& args) {
+    current_interface = args.str(0);
+}
+
+void cmd_ip_route(const Args& args) {
+    // ip route <net> <mask> <gateway> -> ip route add <net>/<len> via <gateway>
+    // Example: ip route 192.168.2.0 255.255.255.0 192.168.1.1
+    uint32_t network = 0, mask = 0, gateway = 0;
+    parse_ipv4(args[0], network);
+    parse_ipv4(args[1], mask);
+    parse_ipv4(args[2], gateway);
+    int len = __builtin_popcount(mask);
+    std::string prefix = format_prefix(network, len);
+
+    load_routing_table(false);
+    if (const Route* existing = routing_table.find(network, len)) {
+        if (existing->source != RouteSource::PENDING) {
+            std::cout << "% " << (existing->gateway == gateway ? "Route already exists: " : "Conflicts with ")
+                      << describe_route(*existing) << "\n";
+            command_rejected = true;
+            return;
+        }
+        if (existing->gateway == gateway) {
+            std::cout << "% Route to " << prefix << " via " << args.str(2) << " is already queued\n";
+            return;
+        }
+        std::cout << "% Replaces queued route " << describe_route(*existing) << "\n";
+    }
+
+    // Overlaps are legal, but worth pointing out
+    const Route* wider = routing_table.covering(network, len);
+    if (wider && wider->prefix_len > 0 && wider->gateway != gateway) {
+        std::cout << "% Note: takes " << prefix << " away from " << describe_route(*wider) << "\n";
+    }
+    size_t inner = len == 0 ? 0 : routing_table.count_within(network, len);
+    if (inner) {
+        std::cout << "% Note: " << inner << " more specific route(s) inside " << prefix
+                  << " keep their own next hop\n";
+    }
+
+    routing_table.insert({network, gateway, 0, (uint8_t)len, RouteSource::PENDING});
+    pending_commands.push_back("ip route add " + prefix + " via " + args.str(2));
+}
+
+void cmd_ip_address(const Args& args) {
+    // ip address <ip> <mask> -> ifconfig <iface> <ip> netmask <mask> up
+    pending_commands.push_back("ifconfig " + shell_quote(current_interface) + " " + args.str(0) + " netmask " + args.str(1) + " up");
+}
+
+void cmd_shutdown(const Args&) {
+    pending_commands.push_back("ifconfig " + shell_quote(current_interface) + " down");
+}
+
+void cmd_no_shutdown(const Args&) {
+    pending_commands.push_back("ifconfig " + shell_quote(current_interface) + " up");
+}
+
+void cmd_interface_exit(const Args&) {
+    current_interface = "";
+}
+
+// Wireless mode edits one radio and the first wifi-iface on it. Each edit
+// queues `uci set` + `uci commit wireless` + `wifi reload` like the Bash
+// CLI; the planner turns the reload into `wifi up <radio>` for the radios
+// that actually changed, so the other bands keep their clients.
+
+std::string wifi_radio_of(const std::string& section) {
+    auto pkg = config_tree.valid ? config_tree.packages.find("wireless") : config_tree.packages.end();
+    if (pkg != config_tree.packages.end()) {
+        for (const auto& s : pkg->second.sections) {
+            if (s.name != section) continue;
+            if (s.type == "wifi-device") return s.name;
+            for (const auto& o : s.options) {
+                if (o.name == "device") return o.value;
+            }
+            return "";
+        }
+    }
+    // Not synced (mock/fleet) or a new section: OpenWrt's default names
+    if (starts_with(section, "radio")) return section;
+    if (starts_with(section, "default_radio")) return section.substr(8);
+    return "";
+}
+
+// False (and the command rejected) after a `wireless` that was rejected, so
+// nothing is queued against "wireless..<option>"
+bool wifi_selected() {
+    if (!current_radio.empty() && !current_wifi_iface.empty()) return true;
+    std::cout << "% No radio selected\n";
+    command_rejected = true;
+    return false;
+}
+
+void queue_wifi_set(const std::string& section, const std::string& option, const std::string& value) {
+    if (!wifi_selected()) return;
+    pending_commands.push_back("uci set wireless." + section + "." + option + "=" + shell_quote(value));
+    pending_commands.push_back("uci commit wireless");
+    pending_commands.push_back("wifi reload");
+}
+
+// `wireless [<radio>]`, radio0 by default
+void cmd_wireless(const Args& args) {
+    std::string radio = args.size() ? args.str(0) : "radio0";
+    std::string iface = "default_" + radio;
+    // A rejection must not leave the previous radio selected
+    current_radio = "";
+    current_wifi_iface = "";
+    if (!mock_mode && !fleet_mode) {
+        if (!sync_config(false)) {
+            command_rejected = true;
+            return;
+        }
+        bool found = false;
+        iface.clear();
+        auto pkg = config_tree.packages.find("wireless");
+        if (pkg != config_tree.packages.end()) {
+            for (const auto& s : pkg->second.sections) {
+                if (s.type == "wifi-device" && s.name == radio) found = true;
+                if (s.type == "wifi-iface" && iface.empty() && wifi_radio_of(s.name) == radio) iface = s.name;
+            }
+        }
+        if (!found || iface.empty()) {
+            std::cout << "% " << (found ? radio + " has no wireless network" : "No radio named " + radio) << "\n";
+            command_rejected = true;
+            return;
+        }
+    }
+    current_radio = radio;
+    current_wifi_iface = iface;
+}
+
+void cmd_ssid(const Args& args) {
+    queue_wifi_set(current_wifi_iface, "ssid", args.rest(0));
+}
+
+void cmd_wifi_password(const Args& args) {
+    if (!wifi_selected()) return;
+    pending_commands.push_back("uci set wireless." + current_wifi_iface + ".encryption='psk2'");
+    queue_wifi_set(current_wifi_iface, "key", args.str(0));
+}
+
+void cmd_hidden(const Args& args) {
+    queue_wifi_set(current_wifi_iface, "hidden", abbreviates(args[0], "yes") ? "1" : "0");
+}
+
+void cmd_channel(const Args& args) {
+    queue_wifi_set(current_radio, "channel", args.str(0));
+}
+
+void cmd_wireless_exit(const Args&) {
+    current_radio = "";
+    current_wifi_iface = "";
+}
+
+void cmd_nothing(const Args&) {}
+
+// Argument checks: return an error message, or "" if the arguments are valid
+
+std::string check_fresh(const Args& args) {
+    return args.size() == 0 || wants_fresh(args) ? "" : "expected 'fresh' or nothing";
+}
+
+std::string check_show_config(const Args& args) {
+    return args.size() == 0 || wants_fresh(args) || abbreviates(args[0], "diff") ? "" : "expected 'fresh', 'diff' or nothing";
+}
+
+std::string check_show_route(const Args& args) {
+    return args.size() == 0 || wants_fresh(args) || is_ipv4(args[0]) ? "" : "expected 'fresh', an address or nothing";
+}
+
+// A line count of at most `max` (0 allowed when `max` permits)
+std::string check_line_count(std::string_view arg, int min, int max) {
+    int value = 0;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if (ec != std::errc() || end != arg.data() + arg.size() || value < min || value > max) {
+        return "expected a line count from " + std::to_string(min) + " to " + std::to_string(max);
+    }
+    return "";
+}
+
+std::string check_logging(const Args& args) {
+    return args.size() == 0 ? "" : check_line_count(args[0], 1, 1000000);
+}
+
+std::string check_terminal_length(const Args& args) {
+    return check_line_count(args[0], 0, 512);
+}
+
+// Names that end up in shell commands and UCI keys: [A-Za-z0-9._-]+
+bool is_plain_name(std::string_view s, size_t max_len) {
+    return !s.empty() && s.size() <= max_len && std::all_of(s.begin(), s.end(), [](char c) {
+        return isalnum((unsigned char)c) || c == '.' || c == '_' || c == '-';
+    });
+}
+
+std::string check_hostname(const Args& args) {
+    return is_plain_name(args[0], 63) ? "" : "a hostname is up to 63 letters, digits, '.', '_' or '-'";
+}
+
+std::string check_ifname(const Args& args) {
+    return is_plain_name(args[0], 15) ? "" : "an interface name is up to 15 letters, digits, '.', '_' or '-'";
+}
+
+std::string check_radio(const Args& args) {
+    return args.size() == 0 || is_plain_name(args[0], 32) ? "" : "a radio name is letters, digits, '.', '_' or '-'";
+}
+
+std::string check_copy(const Args& args) {
+    if (!abbreviates(args[1], "startup-config")) return "expected 'startup-config' as the destination";
+    return args.size() == 2 || abbreviates(args[2], "reload") ? "" : "expected 'reload' or nothing";
+}
+
+std::string check_ssid(const Args& args) {
+    return args.rest(0).size() <= 32 ? "" : "SSIDs are at most 32 characters";
+}
+
+std::string check_wifi_password(const Args& args) {
+    return args[0].size() >= 8 && args[0].size() <= 63 ? "" : "WPA2 keys are 8 to 63 characters";
+}
+
+std::string check_hidden(const Args& args) {
+    return abbreviates(args[0], "yes") || abbreviates(args[0], "no") ? "" : "expected 'yes' or 'no'";
+}
+
+std::string check_channel(const Args& args) {
+    if (args[0] == "auto") return "";
+    int channel = 0;
+    auto [end, ec] = std::from_chars(args[0].data(), args[0].data() + args[0].size(), channel);
+    return ec == std::errc() && end == args[0].data() + args[0].size() && channel >= 1 && channel <= 233
+        ? "" : "expected a channel number (1-233) or 'auto'";
+}
+
+std::string check_route(const Args& args) {
+    uint32_t network, mask;
+    if (!parse_ipv4(args[0], network)) return "invalid network address '" + args.str(0) + "'";
+    if (!is_netmask(args[1])) return "invalid netmask '" + args.str(1) + "'";
+    if (!is_ipv4(args[2])) return "invalid gateway '" + args.str(2) + "'";
+    parse_ipv4(args[1], mask);
+    if (network & ~mask) {
+        return "network " + args.str(0) + " has host bits set for mask " + args.str(1) +
+               " (did you mean " + format_ipv4(network & mask) + "?)";
+    }
+    return "";
+}
+
+std::string check_address(const Args& args) {
+    if (!is_ipv4(args[0])) return "invalid address '" + args.str(0) + "'";
+    if (!is_netmask(args[1])) return "invalid netmask '" + args.str(1) + "'";
+    return "";
+}
+
+// --- Command Table ---
+
+// How a command behaves inside a --batch script (see Batch Mode)
+enum class BatchUse { RUN, SKIP, END, REJECT };
+
+#define MODE_STAY (-1)
+
+struct CommandSpec {
+    Mode mode;
+    std::string_view keywords;       // Space-separated, each abbreviable
+    std::string_view params;         // Usage text for the arguments
+    uint8_t min_args;
+    uint8_t max_args;
+    void (*handler)(const Args&);
+    std::string (*check)(const Args&);  // nullptr: any arguments
+    int next_mode;                   // Mode after the command, or MODE_STAY
+    BatchUse batch;
+};
+
+constexpr CommandSpec command_table[] = {
+    {MODE_USER, "enable", "", 0, 0, cmd_enable, nullptr, MODE_PRIVILEGED, BatchUse::RUN},
+    {MODE_USER, "terminal length", "<lines>", 1, 1, cmd_terminal_length, check_terminal_length, MODE_STAY, BatchUse::SKIP},
+    {MODE_USER, "exit", "", 0, 0, cmd_user_exit, nullptr, MODE_STAY, BatchUse::END},
+
+    {MODE_PRIVILEGED, "disable", "", 0, 0, cmd_disable, nullptr, MODE_USER, BatchUse::RUN},
+    {MODE_PRIVILEGED, "configure terminal", "", 0, 0, cmd_configure, nullptr, MODE_CONFIG, BatchUse::RUN},
+    {MODE_PRIVILEGED, "show running-config", "[fresh | diff]", 0, 1, cmd_show_running_config, check_show_config, MODE_STAY, BatchUse::RUN},
+    {MODE_PRIVILEGED, "show startup-config", "[fresh]", 0, 1, cmd_show_startup_config, check_fresh, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show statistics", "", 0, 0, cmd_show_statistics, nullptr, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show fleet", "", 0, 0, cmd_show_fleet, nullptr, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show ip route", "[fresh | <address>]", 0, 1, cmd_show_ip_route, check_show_route, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show ip interface", "[fresh]", 0, 1, cmd_show_ip_interface, check_fresh, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show interfaces rate", "[<name>]", 0, 1, cmd_show_interfaces_rate, nullptr, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show logging", "[<lines>]", 0, 1, cmd_show_logging, check_logging, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "show tech-support", "[fresh]", 0, 1, cmd_show_tech_support, check_fresh, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "apply", "", 0, 0, cmd_apply, nullptr, MODE_STAY, BatchUse::SKIP},
+    {MODE_PRIVILEGED, "copy", "<file | directory> startup-config [reload]", 2, 3, cmd_copy, check_copy, MODE_STAY, BatchUse::REJECT},
+    {MODE_PRIVILEGED, "terminal length", "<lines>", 1, 1, cmd_terminal_length, check_terminal_length, MODE_STAY, BatchUse::SKIP},
+    {MODE_PRIVILEGED, "clear pending", "", 0, 0, cmd_clear_pending, nullptr, MODE_STAY, BatchUse::RUN},
+    {MODE_PRIVILEGED, "exit", "", 0, 0, cmd_nothing, nullptr, MODE_USER, BatchUse::RUN},
+
+    {MODE_CONFIG, "hostname", "<name>", 1, 1, cmd_hostname, check_hostname, MODE_STAY, BatchUse::RUN},
+    {MODE_CONFIG, "interface", "<name>", 1, 1, cmd_interface, check_ifname, MODE_INTERFACE, BatchUse::RUN},
+    {MODE_CONFIG, "ip route", "<network> <mask> <gateway>", 3, 3, cmd_ip_route, check_route, MODE_STAY, BatchUse::RUN},
+    {MODE_CONFIG, "wireless", "[<radio>]", 0, 1, cmd_wireless, check_radio, MODE_WIRELESS, BatchUse::RUN},
+    {MODE_CONFIG, "exit", "", 0, 0, cmd_nothing, nullptr, MODE_PRIVILEGED, BatchUse::RUN},
+
+    {MODE_INTERFACE, "ip address", "<address> <mask>", 2, 2, cmd_ip_address, check_address, MODE_STAY, BatchUse::RUN},
+    {MODE_INTERFACE, "shutdown", "", 0, 0, cmd_shutdown, nullptr, MODE_STAY, BatchUse::RUN},
+    {MODE_INTERFACE, "no shutdown", "", 0, 0, cmd_no_shutdown, nullptr, MODE_STAY, BatchUse::RUN},
+    {MODE_INTERFACE, "exit", "", 0, 0, cmd_interface_exit, nullptr, MODE_CONFIG, BatchUse::RUN},
+
+    {MODE_WIRELESS, "ssid", "<name>", 1, MAX_TOKENS, cmd_ssid, check_ssid, MODE_STAY, BatchUse::RUN},
+    {MODE_WIRELESS, "password", "<key>", 1, 1, cmd_wifi_password, check_wifi_password, MODE_STAY, BatchUse::RUN},
+    {MODE_WIRELESS, "hidden", "<yes | no>", 1, 1, cmd_hidden, check_hidden, MODE_STAY, BatchUse::RUN},
+    {MODE_WIRELESS, "channel", "<number | auto>", 1, 1, cmd_channel, check_channel, MODE_STAY, BatchUse::RUN},
+    {MODE_WIRELESS, "exit", "", 0, 0, cmd_wireless_exit, nullptr, MODE_CONFIG, BatchUse::RUN},
+};
+
+constexpr size_t COMMAND_COUNT = sizeof(command_table) / sizeof(command_table[0]);
+
+// Keyword trie for one mode. Node 0 is the root; children are a linked list
+// (first_child / next_sibling) in table order.
+struct CommandTrie {
+    struct Node {
+        std::string_view word;
+        int first_child = -1;
+        int next_sibling = -1;
+        int command = -1;            // Index into command_table, or -1
+    };
+    Node nodes[MAX_TRIE_NODES] = {};
+    int count = 1;
+};
+
+constexpr CommandTrie build_trie(Mode mode) {
+    CommandTrie trie;
+    for (size_t c = 0; c < COMMAND_COUNT; c++) {
+        if (command_table[c].mode != mode) continue;
+        std::string_view rest = command_table[c].keywords;
+        int node = 0;
+        while (!rest.empty()) {
+            size_t space = rest.find(' ');
+            std::string_view word = rest.substr(0, space);
+            rest = space == std::string_view::npos ? std::string_view() : rest.substr(space + 1);
+
+            int child = trie.nodes[node].first_child;
+            int last = -1;
+            while (child >= 0 && trie.nodes[child].word != word) {
+                last = child;
+                child = trie.nodes[child].next_sibling;
+            }
+            if (child < 0) {
+                if (trie.count == MAX_TRIE_NODES) throw "MAX_TRIE_NODES too small";
+                child = trie.count++;
+                trie.nodes[child].word = word;
+                if (last < 0) trie.nodes[node].first_child = child;
+                else trie.nodes[last].next_sibling = child;
+            }
+            node = child;
+        }
+        trie.nodes[node].command = (int)c;
+    }
+    return trie;
+}
+
+constexpr CommandTrie mode_tries[] = {
+    build_trie(MODE_USER),
+    build_trie(MODE_PRIVILEGED),
+    build_trie(MODE_CONFIG),
+    build_trie(MODE_INTERFACE),
+    build_trie(MODE_WIRELESS),
+};
+
+struct CommandMatch {
+    const CommandSpec* spec = nullptr;
+    Args args{nullptr, 0};
+    std::string error;               // Set when spec is null or the arguments are wrong
+};
+
+std::string usage_of(const CommandSpec& spec) {
+    std::string usage(spec.keywords);
+    if (!spec.params.empty()) usage += " " + std::string(spec.params);
+    return usage;
+}
+
+// Walks the mode's trie with the line's keywords, then checks the arguments
+CommandMatch match_command(Mode mode, const Tokens& tokens) {
+    CommandMatch m;
+    if (tokens.overflow) {
+        m.error = "Too many words on the line";
+        return m;
+    }
+
+    const CommandTrie& trie = mode_tries[mode];
+    int node = 0;
+    size_t consumed = 0;
+    while (consumed < tokens.size()) {
+        std::string_view word = tokens[consumed];
+        int found = -1;
+        int candidates = 0;
+        for (int child = trie.nodes[node].first_child; child >= 0; child = trie.nodes[child].next_sibling) {
+            if (trie.nodes[child].word == word) {
+                found = child;
+                candidates = 1;
+                break;
+            }
+            if (abbreviates(word, trie.nodes[child].word)) {
+                found = child;
+                candidates++;
+            }
+        }
+        if (candidates > 1) {
+            m.error = "Ambiguous command: \"" + std::string(word) + "\"";
+            return m;
+        }
+        if (found < 0) break;
+        node = found;
+        consumed++;
+    }
+
+    if (trie.nodes[node].command < 0) {
+        m.error = consumed == 0 ? "Unknown command" : "Incomplete command";
+        return m;
+    }
+
+    const CommandSpec& spec = command_table[trie.nodes[node].command];
+    m.args = Args{tokens.items + consumed, tokens.size() - consumed};
+    if (m.args.size() < spec.min_args || m.args.size() > spec.max_args) {
+        m.error = "Usage: " + usage_of(spec);
+        return m;
+    }
+    if (spec.check) {
+        m.error = spec.check(m.args);
+        if (!m.error.empty()) return m;
+    }
+    m.spec = &spec;
+    return m;
+}
+
+void print_mode_help(Mode mode) {
+    for (const auto& spec : command_table) {
+        if (spec.mode == mode) std::cout << "  " << usage_of(spec) << "\n";
+    }
+}
+
+void run_command(const CommandMatch& m) {
+    command_rejected = false;
+    m.spec->handler(m.args);
+    if (m.spec->next_mode != MODE_STAY && !command_rejected) current_mode = static_cast<Mode>(m.spec->next_mode);
+}
+
+// Cuts `| include|exclude|begin <pattern>` modifiers (any number, applied
+// left to right) off the end of `tokens`. Returns an error message, or "".
+std::string split_output_modifiers(Tokens& tokens, std::vector<OutputModifier>& modifiers) {
+    size_t i = 0;
+    while (i < tokens.size() && tokens[i] != "|") i++;
+    size_t command_end = i;
+    while (i < tokens.size()) {
+        // tokens[i] is "|"
+        if (++i == tokens.size()) return "Expected include, exclude or begin after '|'";
+        std::string_view word = tokens[i++];
+        LineFilter::Kind kind;
+        if (abbreviates(word, "include")) kind = LineFilter::INCLUDE;
+        else if (abbreviates(word, "exclude")) kind = LineFilter::EXCLUDE;
+        else if (abbreviates(word, "begin")) kind = LineFilter::BEGIN;
+        else return "Unknown output modifier \"" + std::string(word) + "\"";
+
+        std::string pattern;
+        while (i < tokens.size() && tokens[i] != "|") {
+            if (!pattern.empty()) pattern += ' ';
+            pattern += tokens[i++];
+        }
+        if (pattern.empty()) return "Expected a pattern after '" + std::string(word) + "'";
+        try {
+            LineFilter check(kind, pattern, nullptr);
+        } catch (const std::regex_error&) {
+            return "Invalid regular expression \"" + pattern + "\"";
+        }
+        modifiers.push_back({kind, pattern});
+    }
+    tokens.count = command_end;
+    return "";
+}
+
+// Runs one line in the current mode. Show commands print through the
+// output pipeline.
+void dispatch(const Tokens& line) {
+    if (line.size() == 1 && line[0] == "?") {
+        print_mode_help(current_mode);
+        return;
+    }
+    Tokens tokens = line;
+    std::vector<OutputModifier> modifiers;
+    std::string error = split_output_modifiers(tokens, modifiers);
+    if (!error.empty()) {
+        std::cout << "% " << error << "\n";
+        return;
+    }
+    CommandMatch m = match_command(current_mode, tokens);
+    if (!m.spec) {
+        std::cout << "% " << m.error << "\n";
+        return;
+    }
+    if (m.spec->keywords.substr(0, 5) != "show ") {
+        if (!modifiers.empty()) {
+            std::cout << "% Output modifiers only apply to show commands\n";
+            return;
+        }
+        run_command(m);
+        return;
+    }
+    OutputCapture capture(modifiers, pager_lines());
+    run_command(m);
+}
+
+// --- Batch Mode ---
+//
+// `--batch FILE` (or `-` for stdin) runs a whole script without prompts. The
+// script is read and checked against the command table first, starting in
+// user mode exactly like an interactive session, so a saved transcript
+// replays as-is. Nothing touches the router until every line is valid. The
+// script's config commands then queue up as usual (a route that conflicts
+// with the router's table rejects the whole script), any `apply` lines are
+// folded into a single planned apply at the end, and the exit status tells
+// automation whether every command succeeded.
+
+// Checks one line against `mode` and advances `mode` the way dispatch()
+// would. Returns an error message, or "" if the line is valid. `done` is set
+// when the line ends the session.
+std::string check_batch_line(Mode& mode, const Tokens& tokens, bool& done) {
+    CommandMatch m = match_command(mode, tokens);
+    if (!m.spec) return m.error;
+    if (m.spec->batch == BatchUse::REJECT) {
+        return "'" + std::string(m.spec->keywords) + "' is not allowed in a batch script (nothing is applied until the end)";
+    }
+    if (m.spec->batch == BatchUse::END) done = true;
+    if (m.spec->next_mode != MODE_STAY) mode = static_cast<Mode>(m.spec->next_mode);
+    return "";
+}
+
+// Runs a batch script; returns the process exit status
+int run_batch(const std::string& path) {
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            std::cerr << "Fatal: Could not read batch script " << path << "\n";
+            return 1;
+        }
+    }
+    std::istream& in = (path == "-") ? std::cin : file;
+    const std::string label = (path == "-") ? "<stdin>" : path;
+
+    // 1. Read and validate everything before connecting
+    std::vector<std::pair<size_t, std::string>> script;
+    std::string line;
+    size_t number = 0;
+    Mode mode = MODE_USER;
+    bool done = false;
+    int errors = 0;
+    while (std::getline(in, line)) {
+        number++;
+        Tokens tokens = tokenize(line);
+        if (tokens.empty() || tokens[0][0] == '!' || tokens[0][0] == '#') continue;
+        if (done) {
+            std::cerr << label << ":" << number << ": command after 'exit' ends the session\n";
+            errors++;
+            continue;
+        }
+        std::string error = check_batch_line(mode, tokens, done);
+        if (!error.empty()) {
+            std::cerr << label << ":" << number << ": " << error << ": " << line << "\n";
+            errors++;
+            continue;
+        }
+        script.emplace_back(number, line);
+    }
+    if (errors) {
+        std::cerr << "% " << errors << " error(s); nothing was sent to the router\n";
+        return 1;
+    }
+
+    // 2. Queue the configuration through the normal handlers. Connected
+    // first, so routes are checked against the router's table.
+    if (!connect_ssh() && !mock_mode) {
+        std::cerr << "Fatal: Could not connect to router.\n";
+        return 1;
+    }
+    for (const auto& [at, text] : script) {
+        Tokens tokens = tokenize(text);
+        CommandMatch m = match_command(current_mode, tokens);
+        if (!m.spec) {
+            // Only reachable if the session's mode drifted from the check's
+            std::cerr << label << ":" << at << ": " << m.error << ": " << text << "\n";
+            errors++;
+            break;
+        }
+        if (m.spec->batch == BatchUse::END) break;
+        if (m.spec->batch == BatchUse::SKIP) continue;
+        run_command(m);
+        if (command_rejected) {
+            std::cerr << label << ":" << at << ": rejected: " << text << "\n";
+            errors++;
+            // The rest of the script was checked in a mode the session never entered
+            if (m.spec->next_mode != MODE_STAY) break;
+        }
+    }
+    if (errors) {
+        std::cerr << "% " << errors << " command(s) rejected; nothing was applied\n";
+        cleanup_ssh();
+        return 1;
+    }
+
+    // 3. One planned apply for the whole script
+    if (pending_commands.empty()) {
+        std::cout << "% No changes to apply\n";
+        cleanup_ssh();
+        return 0;
+    }
+    bool ok = apply_pending();
+    cleanup_ssh();
+    return ok ? 0 : 1;
+}
+
+void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--mock] [--cache-ttl SECONDS] [--host IP] [--port N] [--user NAME] [--password PASS]\n"
+              << "       " << prog << "   [--log FILE] [--log-binary]   (default log " CLI_LOG_PATH ")\n"
+              << "       " << prog << "   [--transport shell|ubus] [--ubus-port N]   (ubus: apply and interfaces over rpcd)\n"
+              << "       " << prog << " [--mock] --fleet INVENTORY\n"
+              << "       " << prog << " [options] --batch FILE   (FILE '-' reads the script from stdin)\n";
+}
+
+int main(int argc, char** argv) {
+    std::string batch_path;
+    std::string log_path = CLI_LOG_PATH;
+    bool log_binary = false;
+    bool use_ubus = false;
+    int ubus_port = UBUS_PORT;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--mock") {
+            mock_mode = true;
+        } else if (arg == "--cache-ttl" && has_value) {
+            show_cache_ttl = std::atoi(argv[++i]);
+        } else if (arg == "--host" && has_value) {
+            router_target.host = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            router_target.port = std::atoi(argv[++i]);
+        } else if (arg == "--user" && has_value) {
+            router_target.username = argv[++i];
+        } else if (arg == "--password" && has_value) {
+            router_target.password = argv[++i];
+        } else if (arg == "--batch" && has_value) {
+            batch_path = argv[++i];
+        } else if (arg == "--log" && has_value) {
+            log_path = argv[++i];
+        } else if (arg == "--log-binary") {
+            log_binary = true;
+        } else if (arg == "--transport" && has_value && (std::string(argv[i + 1]) == "shell" || std::string(argv[i + 1]) == "ubus")) {
+            use_ubus = std::string(argv[++i]) == "ubus";
+        } else if (arg == "--ubus-port" && has_value) {
+            ubus_port = std::atoi(argv[++i]);
+        } else if (arg == "--fleet" && has_value) {
+            fleet_mode = true;
+            if (!load_inventory(argv[++i], fleet)) {
+                std::cerr << "Fatal: Could not read inventory " << argv[i] << "\n";
+                return 1;
+            }
+            if (fleet.empty()) {
+                std::cerr << "Fatal: Inventory " << argv[i] << " lists no routers\n";
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (alog_open(log_path.c_str(), "CLI", log_binary, CLI_LOG_ROTATE_BYTES, CLI_LOG_KEEP) == 0) {
+        atexit(alog_close);
+        cli_log("session started (PID %d%s%s)", getpid(), mock_mode ? ", mock" : "", fleet_mode ? ", fleet" : "");
+    }
+
+    if (mock_mode) {
+        std::cout << "[INFO] Running in MOCK mode. No real SSH connection.\n";
+    }
+    if (fleet_mode) {
+        std::cout << "[INFO] Fleet mode: apply targets " << fleet.size() << " routers.\n";
+    }
+    if (use_ubus && (mock_mode || fleet_mode)) {
+        std::cout << "[INFO] The ubus transport is not used in " << (mock_mode ? "mock" : "fleet") << " mode.\n";
+    } else if (use_ubus) {
+        ubus_transport = std::make_unique<UbusTransport>(router_target, ubus_port);
+        if (ubus_transport->login()) {
+            transport = ubus_transport.get();
+            cli_log("ubus session opened on %s:%d", router_target.host.c_str(), ubus_port);
+        } else {
+            std::cout << "[INFO] Falling back to the shell transport.\n";
+        }
+    }
+
+    if (!batch_path.empty()) {
+        return run_batch(batch_path);
+    }
+
+    if (!connect_ssh()) {
+        if (!mock_mode) {
+             std::cerr << "Fatal: Could not connect to router. Use --mock for testing.\n";
+             return 1;
+        }
+    }
+
+    std::string line;
+    while (true) {
+        print_prompt();
+        if (!std::getline(std::cin, line)) break;
+        Tokens tokens = tokenize(line);
+        if (tokens.empty()) continue;
+        dispatch(tokens);
+    }
 
     cleanup_ssh();
     return 0;
@@ -29,7 +29,9 @@ execute_remote_command() {
 
     # Using sshpass for password handling if available, else plain ssh
     # Added -o HostKeyAlgorithms=+ssh-rsa -o PubkeyAcceptedKeyTypes=+ssh-rsa to support older routers
-    local ssh_cmd="ssh -o StrictHostKeyChecking=no -o HostKeyAlgorithms=+ssh-rsa -o PubkeyAcceptedKeyTypes=+ssh-rsa -p $ROUTER_PORT $USERNAME@$ROUTER_IP"
+    # ControlMaster keeps one authenticated connection open in the background,
+    # so only the first command pays for the handshake; later ones reuse it.
+    local ssh_cmd="ssh -o StrictHostKeyChecking=no -o HostKeyAlgorithms=+ssh-rsa -o PubkeyAcceptedKeyTypes=+ssh-rsa $SSH_MUX_OPTS -p $ROUTER_PORT $USERNAME@$ROUTER_IP"
     
     if command -v sshpass &> /dev/null; then
         echo "Executing remote command via sshpass: $cmd"
@@ -40,6 +42,84 @@ execute_remote_command() {
     fi
 }
 
+# Show result cache
+# Output of remote show commands is reused for SHOW_CACHE_TTL seconds.
+# Parallel indexed arrays (not `declare -A`) keep this working on bash 3.2
+# (macOS); $SECONDS is a builtin, so checking the age costs no fork.
+SHOW_CACHE_TTL=30
+SHOW_CACHE_KEYS=()
+SHOW_CACHE_VALUES=()
+SHOW_CACHE_TIMES=()
+
+# Sets SUBSYSTEM to what a remote command reads or modifies:
+# routes, interfaces, network (both), wireless, system or all.
+command_subsystem() {
+    case "$1" in
+        *wireless*|*wifi*)                          SUBSYSTEM="wireless" ;;
+        *"ip route"*|*"route "*)                    SUBSYSTEM="routes" ;;
+        *ifconfig*|*"ip address"*|*"ip addr"*|*"ip link"*) SUBSYSTEM="interfaces" ;;
+        *uci*network*|*/etc/init.d/network*)        SUBSYSTEM="network" ;;
+        *system*)                                   SUBSYSTEM="system" ;;
+        *)                                          SUBSYSTEM="all" ;;
+    esac
+}
+
+# Prints the output of a remote show command, from the cache when a copy is
+# younger than SHOW_CACHE_TTL seconds and $2 is not "fresh".
+#
+# Arguments:
+#   $1 - The remote command
+#   $2 - "fresh" to bypass the cache
+cached_remote_show() {
+    local cmd="$1" fresh="$2" i
+    if [ "$MockMode" = true ]; then
+        execute_remote_command "$cmd"
+        return
+    fi
+
+    for i in "${!SHOW_CACHE_KEYS[@]}"; do
+        if [ "${SHOW_CACHE_KEYS[$i]}" == "$cmd" ]; then
+            if [ "$fresh" != "fresh" ] && [ $((SECONDS - SHOW_CACHE_TIMES[i])) -lt "$SHOW_CACHE_TTL" ]; then
+                printf '%s\n' "${SHOW_CACHE_VALUES[$i]}"
+                return 0
+            fi
+            unset "SHOW_CACHE_KEYS[$i]" "SHOW_CACHE_VALUES[$i]" "SHOW_CACHE_TIMES[$i]"
+        fi
+    done
+
+    local output
+    # The monitor already holds the latest interface dump
+    if [ "$cmd" == "ip address show" ] && [ "$fresh" != "fresh" ] && \
+       output=$(./router_monitor --ctl INTERFACES 2>/dev/null); then
+        :
+    elif ! output=$(execute_remote_command "$cmd"); then
+        printf '%s\n' "$output"
+        return 1
+    fi
+    printf '%s\n' "$output"
+
+    SHOW_CACHE_KEYS+=("$cmd")
+    SHOW_CACHE_VALUES+=("$output")
+    SHOW_CACHE_TIMES+=("$SECONDS")
+}
+
+# Drops cached show results for every subsystem the given commands touch.
+invalidate_show_cache() {
+    local pending i touched cached
+    for pending in "$@"; do
+        command_subsystem "$pending"
+        touched="$SUBSYSTEM"
+        for i in "${!SHOW_CACHE_KEYS[@]}"; do
+            command_subsystem "${SHOW_CACHE_KEYS[$i]}"
+            cached="$SUBSYSTEM"
+            if [ "$touched" == "all" ] || [ "$touched" == "$cached" ] || \
+               { [ "$touched" == "network" ] && { [ "$cached" == "routes" ] || [ "$cached" == "interfaces" ]; }; }; then
+                unset "SHOW_CACHE_KEYS[$i]" "SHOW_CACHE_VALUES[$i]" "SHOW_CACHE_TIMES[$i]"
+            fi
+        done
+    done
+}
+
 # Displays the CLI prompt based on the current mode and hostname.
 # Format: [Hostname][(mode)]> or #
 print_prompt() {
@@ -79,11 +159,7 @@ handle_config_mode() {
                 PENDING_COMMANDS+=("/etc/init.d/system reload")
                 
                 # Persist hostname locally
-                if [ -f "$CONF_FILE" ]; then
-                     grep -v "hostname=" "$CONF_FILE" > "$CONF_FILE.tmp"
-                     mv "$CONF_FILE.tmp" "$CONF_FILE"
-                fi
-                echo "hostname=$HOSTNAME" >> "$CONF_FILE"
+                state_cmd set hostname "$HOSTNAME"
             else
                  echo "% Invalid command"
             fi
@@ -98,7 +174,6 @@ handle_config_mode() {
                     echo "Enable secret (router password) change pending"
                     
                     # 2. Update local CLI enable secret (Modes functionality)
-                    mkdir -p "$STATE_DIR"
                     local hash=""
                     if command -v sha256sum &> /dev/null; then
                         hash=$(echo -n "${cmd[2]}" | sha256sum | cut -d' ' -f1)
@@ -106,25 +181,18 @@ handle_config_mode() {
                         hash=$(echo -n "${cmd[2]}" | shasum -a 256 | cut -d' ' -f1)
                     fi
                     
-                    # Remove existing lines and append new
-                    if [ -f "$CONF_FILE" ]; then
-                        grep -v "enable_secret_hash=" "$CONF_FILE" | grep -v "enable_password=" > "$CONF_FILE.tmp"
-                        mv "$CONF_FILE.tmp" "$CONF_FILE"
-                    fi
-                    echo "enable_secret_hash=$hash" >> "$CONF_FILE"
+                    # The secret replaces any plain enable password
+                    state_cmd unset enable_password
+                    state_cmd set enable_secret_hash "$hash"
                 fi
             elif [ "${cmd[1]}" == "password" ]; then
                 if [ -z "${cmd[2]}" ]; then
                      echo "% Password required"
                 else
                      echo "Enable password set (Local CLI only)"
-                     # Update local CLI enable password
-                     mkdir -p "$STATE_DIR"
-                     if [ -f "$CONF_FILE" ]; then
-                        grep -v "enable_secret_hash=" "$CONF_FILE" | grep -v "enable_password=" > "$CONF_FILE.tmp"
-                        mv "$CONF_FILE.tmp" "$CONF_FILE"
-                     fi
-                     echo "enable_password=${cmd[2]}" >> "$CONF_FILE"
+                     # Update local CLI enable password (replaces any secret)
+                     state_cmd unset enable_secret_hash
+                     state_cmd set enable_password "${cmd[2]}"
                 fi
             else
                 echo "% Invalid command"
@@ -214,24 +282,52 @@ handle_wireless_mode() {
 
 # State directory
 STATE_DIR="state"
-CONF_FILE="$STATE_DIR/router_cli.conf"
+
+# Local state (hostname, credentials, interfaces, routes) lives in a binary
+# store shared with the monitor (c_helpers/state_store.h). state_tool reads
+# it and commits every change atomically.
+STATE_DB="$STATE_DIR/state.db"
+STATE_TOOL="./c_helpers/state_tool"
+
+state_cmd() {
+    "$STATE_TOOL" -f "$STATE_DB" "$@"
+}
+
+state_get() {
+    "$STATE_TOOL" -f "$STATE_DB" get "$1" 2>/dev/null
+}
+
+# Shared SSH connection (see execute_remote_command). The master stays up for
+# SSH_PERSIST seconds after the last command and is closed on exit.
+SSH_PERSIST=300
+SSH_CONTROL_PATH="$STATE_DIR/ssh-mux-%r@%h:%p"
+SSH_MUX_OPTS="-o ControlMaster=auto -o ControlPath=$SSH_CONTROL_PATH -o ControlPersist=$SSH_PERSIST -o ServerAliveInterval=15 -o ServerAliveCountMax=3"
+
+# Closes the shared SSH master connection, if one is running
+close_ssh_master() {
+    ssh -o ControlPath="$SSH_CONTROL_PATH" -O exit -p "$ROUTER_PORT" "$USERNAME@$ROUTER_IP" 2>/dev/null
+}
 
 # Initial state loading
 mkdir -p "$STATE_DIR"
-touch "$CONF_FILE"
+if [ ! -x "$STATE_TOOL" ] || [ "c_helpers/state_tool.c" -nt "$STATE_TOOL" ]; then
+    echo "[INFO] Compiling state_tool..."
+    if ! gcc c_helpers/state_tool.c -o "$STATE_TOOL"; then
+        echo "Fatal: Could not compile state_tool."
+        exit 1
+    fi
+fi
 
-# Persist connection info for monitor (Harmonization)
-if [ -f "$CONF_FILE" ]; then
-    grep -vE "^(router_ip|router_port|username|password)=" "$CONF_FILE" > "$CONF_FILE.tmp"
-    mv "$CONF_FILE.tmp" "$CONF_FILE"
+# Earlier versions kept the state in text files; carry it over once
+if [ ! -f "$STATE_DB" ]; then
+    state_cmd migrate "$STATE_DIR"
 fi
-echo "router_ip=$ROUTER_IP" >> "$CONF_FILE"
-echo "router_port=$ROUTER_PORT" >> "$CONF_FILE"
-echo "username=$USERNAME" >> "$CONF_FILE"
-echo "password=$PASSWORD" >> "$CONF_FILE"
+
+# Persist connection info for monitor (Harmonization)
+state_cmd set router_ip "$ROUTER_IP" router_port "$ROUTER_PORT" username "$USERNAME" password "$PASSWORD"
 
 # Load hostname if exists
-SAVED_HOSTNAME=$(grep "^hostname=" "$CONF_FILE" | cut -d= -f2)
+SAVED_HOSTNAME=$(state_get hostname)
 if [ -n "$SAVED_HOSTNAME" ]; then
     HOSTNAME="$SAVED_HOSTNAME"
 fi
@@ -240,11 +336,8 @@ fi
 # Checks for both plaintext password (enable_password) and SHA256/SHASum hash (enable_secret_hash).
 # Returns 0 on success, 1 on failure.
 check_enable_auth() {
-    mkdir -p "$STATE_DIR"
-    touch "$CONF_FILE"
-    
-    local plain=$(grep "^enable_password=" "$CONF_FILE" | cut -d= -f2)
-    local hash=$(grep "^enable_secret_hash=" "$CONF_FILE" | cut -d= -f2)
+    local plain=$(state_get enable_password)
+    local hash=$(state_get enable_secret_hash)
     
     if [ -z "$plain" ] && [ -z "$hash" ]; then
         return 0
@@ -304,8 +397,8 @@ handle_user_mode() {
 #   disable                 - Return to User Mode
 #   configure terminal      - Enter Global Configuration Mode
 #   show running-config     - Display pending commands and password changes
-#   show ip route           - Display remote routing table
-#   show ip interface       - Display remote interface IPs
+#   show ip route [fresh]   - Display remote routing table (cached; "fresh" refetches)
+#   show ip interface [fresh] - Display remote interface IPs (cached; "fresh" refetches)
 #   apply                   - Execute all pending commands on remote router
 #   exit                    - Return to User Mode
 handle_privileged_mode() {
@@ -333,9 +426,9 @@ handle_privileged_mode() {
                     echo "Change password to: $PENDING_PASSWORD_CHANGE"
                 fi
             elif [ "${cmd[1]}" == "ip" ] && [ "${cmd[2]}" == "route" ]; then
-                execute_remote_command "ip route show"
+                cached_remote_show "ip route show" "${cmd[3]}"
             elif [ "${cmd[1]}" == "ip" ] && [ "${cmd[2]}" == "interface" ]; then
-                execute_remote_command "ip address show"
+                cached_remote_show "ip address show" "${cmd[3]}"
             else
                  echo "% Invalid command"
             fi
@@ -348,6 +441,7 @@ handle_privileged_mode() {
                 for pending in "${PENDING_COMMANDS[@]}"; do
                     execute_remote_command "$pending"
                 done
+                invalidate_show_cache "${PENDING_COMMANDS[@]}"
                 PENDING_COMMANDS=()
                 
                 if [ -n "$PENDING_PASSWORD_CHANGE" ]; then
@@ -364,9 +458,14 @@ handle_privileged_mode() {
                      PENDING_PASSWORD_CHANGE=""
                 fi
                 
-                # Notify monitor to fetch updates
+                # Ask the monitor to fetch updates (control socket; signal as fallback)
                 if [ -n "$MONITOR_PID" ]; then
-                    kill -SIGUSR1 "$MONITOR_PID" 2>/dev/null
+                    local refresh
+                    if refresh=$(./router_monitor --ctl REFRESH 2>/dev/null); then
+                        echo "% Monitor refreshed (${refresh})"
+                    else
+                        kill -SIGUSR1 "$MONITOR_PID" 2>/dev/null
+                    fi
                 fi
             fi
             ;;
@@ -398,11 +497,7 @@ handle_config_mode() {
                 PENDING_COMMANDS+=("/etc/init.d/system reload")
                 
                 # Persist hostname locally
-                if [ -f "$CONF_FILE" ]; then
-                     grep -v "hostname=" "$CONF_FILE" > "$CONF_FILE.tmp"
-                     mv "$CONF_FILE.tmp" "$CONF_FILE"
-                fi
-                echo "hostname=$HOSTNAME" >> "$CONF_FILE"
+                state_cmd set hostname "$HOSTNAME"
             else
                  echo "% Invalid command"
             fi
@@ -417,7 +512,6 @@ handle_config_mode() {
                     echo "Enable secret (router password) change pending"
                     
                     # 2. update local CLI enable secret (Modes functionality)
-                    mkdir -p "$STATE_DIR"
                     local hash=""
                     if command -v sha256sum &> /dev/null; then
                         hash=$(echo -n "${cmd[2]}" | sha256sum | cut -d' ' -f1)
@@ -425,25 +519,18 @@ handle_config_mode() {
                         hash=$(echo -n "${cmd[2]}" | shasum -a 256 | cut -d' ' -f1)
                     fi
                     
-                    # remove existing lines and append new
-                    if [ -f "$CONF_FILE" ]; then
-                        grep -v "enable_secret_hash=" "$CONF_FILE" | grep -v "enable_password=" > "$CONF_FILE.tmp"
-                        mv "$CONF_FILE.tmp" "$CONF_FILE"
-                    fi
-                    echo "enable_secret_hash=$hash" >> "$CONF_FILE"
+                    # the secret replaces any plain enable password
+                    state_cmd unset enable_password
+                    state_cmd set enable_secret_hash "$hash"
                 fi
             elif [ "${cmd[1]}" == "password" ]; then
                 if [ -z "${cmd[2]}" ]; then
                      echo "% Password required"
                 else
                      echo "Enable password set (Local CLI only)"
-                     # Update local CLI enable password
-                     mkdir -p "$STATE_DIR"
-                     if [ -f "$CONF_FILE" ]; then
-                        grep -v "enable_secret_hash=" "$CONF_FILE" | grep -v "enable_password=" > "$CONF_FILE.tmp"
-                        mv "$CONF_FILE.tmp" "$CONF_FILE"
-                     fi
-                     echo "enable_password=${cmd[2]}" >> "$CONF_FILE"
+                     # Update local CLI enable password (replaces any secret)
+                     state_cmd unset enable_secret_hash
+                     state_cmd set enable_password "${cmd[2]}"
                 fi
             else
                 echo "% Invalid command"
@@ -487,14 +574,6 @@ handle_config_mode() {
 #   exit                    - Return to Global Configuration Mode
 handle_interface_mode() {
     local cmd=($1)
-    
-    # ensure interface config file exists
-    local IF_CONF="$STATE_DIR/interfaces.conf"
-    mkdir -p "$STATE_DIR"
-    touch "$IF_CONF"
-    
-    #escape interface name for sed
-    local IF_ESC="${CURRENT_INTERFACE//\//\\/}"
 
     case "${cmd[0]}" in
         "ip")
@@ -502,46 +581,21 @@ handle_interface_mode() {
              if [ "${cmd[1]}" == "address" ] && [ -n "${cmd[2]}" ] && [ -n "${cmd[3]}" ]; then
                   local if_cmd="ifconfig $CURRENT_INTERFACE ${cmd[2]} netmask ${cmd[3]} up"
                   PENDING_COMMANDS+=("$if_cmd")
-                  
-                  #update the interface configuration file used by interface modes
-                  # If the interface already exists, update its entry
-                  # Otherwise, add a new entry
-                  if grep -q "^$CURRENT_INTERFACE," "$IF_CONF"; then
-                        # sed behaves differently on macOS and Linux
-                        # macOS requires an empty string after -i, while Linux does not
-                        # check the OS type to apply the correct sed syntax
-                      if [[ "$OSTYPE" == "darwin"* ]]; then
-                          sed -i '' "/^${IF_ESC},/s/.*/${CURRENT_INTERFACE},${cmd[2]},${cmd[3]},up/" "$IF_CONF"
-                      else
-                          sed -i "/^${IF_ESC},/s/.*/${CURRENT_INTERFACE},${cmd[2]},${cmd[3]},up/" "$IF_CONF"
-                      fi
-                  else
-                      echo "${CURRENT_INTERFACE},${cmd[2]},${cmd[3]},up" >> "$IF_CONF"
-                  fi
+
+                  # Record the interface's address locally (added if new)
+                  state_cmd iface "$CURRENT_INTERFACE" "${cmd[2]}" "${cmd[3]}" up
              else
                   echo "% Invalid command"
              fi
              ;;
         "shutdown")
              PENDING_COMMANDS+=("ifconfig $CURRENT_INTERFACE down")
-             if grep -q "^$CURRENT_INTERFACE," "$IF_CONF"; then
-                  if [[ "$OSTYPE" == "darwin"* ]]; then
-                      sed -i '' "/^${IF_ESC},/s/up/down/" "$IF_CONF"
-                  else
-                      sed -i "/^${IF_ESC},/s/up/down/" "$IF_CONF"
-                  fi
-             fi
+             state_cmd iface "$CURRENT_INTERFACE" down
              ;;
         "no")
              if [ "${cmd[1]}" == "shutdown" ]; then
                  PENDING_COMMANDS+=("ifconfig $CURRENT_INTERFACE up")
-                 if grep -q "^$CURRENT_INTERFACE," "$IF_CONF"; then
-                     if [[ "$OSTYPE" == "darwin"* ]]; then
-                         sed -i '' "/^${IF_ESC},/s/down/up/" "$IF_CONF"
-                     else
-                         sed -i "/^${IF_ESC},/s/down/up/" "$IF_CONF"
-                     fi
-                 fi
+                 state_cmd iface "$CURRENT_INTERFACE" up
              else
                  echo "% Invalid command"
              fi
@@ -620,6 +674,7 @@ handle_wireless_mode() {
 
 if [ "$1" == "--clean" ]; then
     rm -rf "$STATE_DIR"
+    mkdir -p "$STATE_DIR"
     echo "[INFO] State cleared."
 fi
  
@@ -644,7 +699,7 @@ fi
 if [ -f "router_monitor.c" ]; then
     if [ ! -f "router_monitor" ] || [ "router_monitor.c" -nt "router_monitor" ]; then
          echo "[INFO] Compiling router_monitor..."
-         gcc router_monitor.c -o router_monitor
+         gcc router_monitor.c -o router_monitor -lssh2 -pthread
          if [ $? -ne 0 ]; then
              echo "[WARN] Failed to compile router_monitor. Continuing without it."
          fi
@@ -653,14 +708,15 @@ fi
 
 MONITOR_PID=""
 if [ -f "router_monitor" ]; then
-    #output to log file
-    ./router_monitor >> router_monitor.log 2>&1 &
+    #the monitor writes (and rotates) its own log; stderr only carries fatal errors
+    ./router_monitor --log router_monitor.log 2>> router_monitor.log &
     MONITOR_PID=$!
     #ensure monitor is killed on exit
-    trap "kill $MONITOR_PID 2>/dev/null" EXIT
+    trap "kill $MONITOR_PID 2>/dev/null; close_ssh_master" EXIT
     echo "[INFO] Started router_monitor (PID: $MONITOR_PID). Logs at router_monitor.log"
 else
     echo "[WARN] router_monitor binary not found."
+    trap "close_ssh_master" EXIT
 fi
 
 
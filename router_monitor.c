@@ -2,206 +2,1380 @@
  * router_monitor.c
  * * Purpose: 
  * Runs as a background process to monitor and fetch data from the remote router.
- * It sleeps to save CPU but wakes up immediately when the Bash CLI script 
- * sends a signal (IPC) indicating that changes were applied.
+ * It blocks in epoll_wait() to save CPU but wakes up immediately when the Bash
+ * CLI script sends a signal (IPC) indicating that changes were applied, when
+ * the shared state store changes, or when a periodic health poll is due.
+ *
+ * Build: gcc router_monitor.c -o router_monitor -lssh2 -pthread
+ * Usage: ./router_monitor [--poll-interval SECONDS] [--telemetry-interval SECONDS]
+ *                         [--log FILE] [--log-binary]
+ *        ./router_monitor --ctl REQUEST...   (client: send one control request)
  */
 
+#define _GNU_SOURCE   // accept4(), open_memstream()
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>   // Required for signal handling (SIGUSR1, SIGTERM)
-#include <unistd.h>   // Required for sleep(), getpid()
+#include <unistd.h>   // Required for getpid()
 #include <string.h>
 #include <time.h>     // Required for timestamping logs
+#include <stdarg.h>   // log_fmt()
+#include <ctype.h>
+#include <libssh2.h>  // In-process SSH client (no sshpass/ssh fork per refresh)
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>     // Event loop
+#include <sys/signalfd.h>  // Signals delivered as readable fds (no handler races)
+#include <sys/timerfd.h>   // Keepalive and health-poll timers
+#include <sys/inotify.h>   // Watch state/ for state store commits
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "c_helpers/monitor_ctl.h"  // Control socket protocol shared with the CLIs
+#include "c_helpers/latency_hist.h" // Per-phase SSH latency histograms
+#include "c_helpers/state_store.h"  // Settings shared with the CLIs (state/state.db)
+#include "c_helpers/async_log.h"    // Non-blocking log writer
 
-/* * Global Flags for IPC
- * * 'volatile': Tells the compiler not to optimize/cache these variables, as they 
- * can change at any time outside the normal flow (by the signal handler).
- * 'sig_atomic_t': An integer type that guarantees atomic access, ensuring data 
- * doesn't get corrupted if a signal interrupts a read/write operation.
+#define SSH_TIMEOUT_MS 10000       // Upper bound for any blocking libssh2 call
+#define SSH_KEEPALIVE_INTERVAL 10  // Seconds between keepalives on the idle session
+#define DEFAULT_POLL_INTERVAL 60   // Seconds between health polls (0 disables them)
+#define CONFIG_DEBOUNCE_MS 200     // The Bash CLI commits several edits in a row at startup
+#define STATE_DIR "state"
+#define STATE_DB_FILE "state.db"   // STATE_DB_PATH, as seen by the inotify watch on STATE_DIR
+#define METRICS_PATH STATE_DIR "/monitor_metrics.prom"  // Prometheus textfile, rewritten after each refresh
+
+#define MAX_IFACES 64              // Interfaces tracked per snapshot
+#define MAX_ADDRS 16               // Addresses tracked per interface
+
+/*
+ * Global Flags
+ * * Signals are no longer handled asynchronously: they are blocked and read
+ * from a signalfd inside the event loop, so these are plain ints that are
+ * only ever touched from the main thread.
+ */
+int stop_request = 0;
+int full_dump_request = 0;
+
+/*
+ * Latency Statistics
+ * * Every SSH phase is timed into a histogram (see latency_hist.h). They are
+ * dumped to METRICS_PATH after each refresh and served as a table over the
+ * control socket (STATS). Only successful phases are recorded, so a router
+ * that times out shows up as errors in the log rather than as 10 s samples.
  */
-volatile sig_atomic_t update_request = 0;
-volatile sig_atomic_t stop_request = 0;
+LatencyHist stat_tcp_connect = HIST_INIT("tcp_connect");
+LatencyHist stat_handshake = HIST_INIT("handshake");
+LatencyHist stat_auth = HIST_INIT("auth");
+LatencyHist stat_channel_open = HIST_INIT("channel_open");
+LatencyHist stat_exec = HIST_INIT("exec");
+LatencyHist stat_read = HIST_INIT("read");
+LatencyHist stat_refresh = HIST_INIT("refresh");
+LatencyHist stat_telemetry = HIST_INIT("telemetry");
+
+LatencyHist* const all_stats[] = {
+    &stat_tcp_connect, &stat_handshake, &stat_auth,
+    &stat_channel_open, &stat_exec, &stat_read, &stat_refresh, &stat_telemetry,
+};
+#define STAT_COUNT ((int)(sizeof(all_stats) / sizeof(all_stats[0])))
 
 /*
- * Signal Handler for SIGUSR1
- * * Triggered by the Bash script command: `kill -SIGUSR1 [PID]`
- * We keep this handler extremely short. We only set a flag here.
- * Heavy lifting (networking/IO) is done in the main loop to avoid 
- * race conditions or deadlocks inside the interrupt context.
+ * Logging
+ * * Lines are queued to the async logger (async_log.h) and written by its
+ * thread, so a refresh never waits on the disk and the timestamp is only
+ * formatted once per second. Output is router_monitor.log (--log, rotated by
+ * size) or stdout.
  */
-void handle_sigusr1(int sig) {
-    update_request = 1;
+#define LOG_SOURCE "MONITOR"
+#define LOG_ROTATE_BYTES (4 * 1024 * 1024)
+#define LOG_KEEP 3
+
+// Helper: Logs a message with a readable timestamp like [2025-12-30 10:00:00]
+void log_with_timestamp(const char* msg) {
+    alog_write(msg, strlen(msg));
+}
+
+// Helper: printf-style variant of log_with_timestamp()
+void log_fmt(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    alog_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+// Helper: Logs a block of text line-by-line (used to show local config state)
+void log_text_lines(const char* text, const char* label) {
+    while (*text) {
+        size_t len = strcspn(text, "\n");
+        log_fmt("%s: %.*s", label, (int)len, text);
+        text += len;
+        if (*text) text++;
+    }
 }
 
 /*
- * Signal Handler for Shutdown (SIGTERM/SIGINT)
- * * Triggered when the script exits or user presses Ctrl+C.
+ * Router Settings
+ * * Read from the shared state store (state_store.h), which stays mapped:
+ * each key is a hash lookup in the mapping, with nothing to parse. The
+ * store is only remapped when inotify reports a commit; a CLI can also push
+ * new settings directly over the control socket (CONFIG request).
  */
-void handle_sigterm(int sig) {
-    stop_request = 1;
+typedef struct {
+    char ip[64];
+    char port[16];
+    char user[64];
+    char pass[64];
+    int poll_interval;   // -1: not set in the file
+} MonitorConfig;
+
+MonitorConfig router_config = { "192.168.1.2", "22", "root", "root", -1 };
+
+// Applies one "key=value" pair; returns 1 if the key is known
+int apply_config_pair(MonitorConfig* cfg, const char* key, size_t key_len, const char* val) {
+    struct { const char* key; char* dest; size_t size; } fields[] = {
+        { "router_ip", cfg->ip, sizeof(cfg->ip) },
+        { "router_port", cfg->port, sizeof(cfg->port) },
+        { "username", cfg->user, sizeof(cfg->user) },
+        { "password", cfg->pass, sizeof(cfg->pass) },
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strlen(fields[i].key) == key_len && strncmp(fields[i].key, key, key_len) == 0) {
+            snprintf(fields[i].dest, fields[i].size, "%s", val);
+            return 1;
+        }
+    }
+    if (key_len == strlen("monitor_poll_interval") && strncmp(key, "monitor_poll_interval", key_len) == 0) {
+        cfg->poll_interval = atoi(val);
+        return 1;
+    }
+    return 0;
 }
 
-// Helper: Prints messages with a readable timestamp like [2025-12-30 10:00:00]
-void log_with_timestamp(const char* msg) {
-    time_t now;
-    time(&now);
-    char buf[20];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    printf("[%s] [MONITOR] %s\n", buf, msg);
+StateStore state_db;
+
+// Reads every known key from the state store into `cfg`; keys not in the
+// store keep their value. Returns 0 if there is no store yet.
+int load_config(MonitorConfig* cfg) {
+    static const char* keys[] = { "router_ip", "router_port", "username", "password", "monitor_poll_interval" };
+
+    state_refresh(&state_db, STATE_DB_PATH);
+    if (!state_db.hdr) return 0;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        const char* val = state_get(state_db.hdr, keys[i]);
+        if (val) apply_config_pair(cfg, keys[i], strlen(keys[i]), val);
+    }
+    return 1;
 }
 
-// Helper: Reads a file line-by-line and logs it (used to show local config state)
-void log_file_content(const char* filepath, const char* label) {
-    FILE* fp = fopen(filepath, "r");
-    if (!fp) return;
+int config_targets_session(const MonitorConfig* cfg);
 
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        // Remove trailing newline character to format log cleanly
-        line[strcspn(line, "\n")] = 0;
-        
-        time_t now;
-        time(&now);
-        char buf[20];
-        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-        printf("[%s] [MONITOR] %s: %s\n", buf, label, line);
+/*
+ * Long-lived SSH connection
+ * * The monitor keeps one authenticated libssh2 session open between refreshes,
+ * so an update costs a channel open + exec instead of fork/exec of
+ * sshpass + ssh and a full key exchange. The credentials it was opened with
+ * are remembered; if the state store changes them, we reconnect.
+ * The password never appears in any process's argv.
+ */
+int ssh_sock = -1;
+LIBSSH2_SESSION* ssh_session = NULL;
+char conn_ip[64] = "";
+char conn_port[16] = "";
+char conn_user[64] = "";
+char conn_pass[64] = "";
+
+// True if the open session was made with exactly these settings
+int config_targets_session(const MonitorConfig* cfg) {
+    return strcmp(cfg->ip, conn_ip) == 0 && strcmp(cfg->port, conn_port) == 0 &&
+           strcmp(cfg->user, conn_user) == 0 && strcmp(cfg->pass, conn_pass) == 0;
+}
+
+void ssh_disconnect(void) {
+    if (ssh_session) {
+        libssh2_session_disconnect(ssh_session, "Monitor disconnecting");
+        libssh2_session_free(ssh_session);
+        ssh_session = NULL;
+    }
+    if (ssh_sock != -1) {
+        close(ssh_sock);
+        ssh_sock = -1;
     }
-    fclose(fp);
+}
+
+// Non-blocking connect bounded by SSH_TIMEOUT_MS, so an unreachable router
+// stalls the event loop for seconds rather than the kernel's SYN retries.
+// Leaves the socket blocking. Returns 0 on success.
+static int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t len) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, addr, len);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (poll(&pfd, 1, SSH_TIMEOUT_MS) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0) {
+            rc = 0;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    return rc;
+}
+
+int ssh_connect(const char* ip, const char* port, const char* user, const char* pass) {
+    struct addrinfo hints;
+    struct addrinfo* res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(ip, port, &hints, &res) != 0 || !res) {
+        log_with_timestamp("Error: Could not resolve router address.");
+        return 0;
+    }
+
+    uint64_t start = hist_now_us();
+    ssh_sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (ssh_sock < 0 || connect_with_timeout(ssh_sock, res->ai_addr, res->ai_addrlen) != 0) {
+        freeaddrinfo(res);
+        log_with_timestamp("Error: Could not connect to router.");
+        ssh_disconnect();
+        return 0;
+    }
+    freeaddrinfo(res);
+    hist_record_since(&stat_tcp_connect, start);
+
+    start = hist_now_us();
+    ssh_session = libssh2_session_init();
+    libssh2_session_set_timeout(ssh_session, SSH_TIMEOUT_MS);
+    if (libssh2_session_handshake(ssh_session, ssh_sock) != 0) {
+        log_with_timestamp("Error: SSH handshake failed.");
+        ssh_disconnect();
+        return 0;
+    }
+    hist_record_since(&stat_handshake, start);
+
+    start = hist_now_us();
+    if (libssh2_userauth_password(ssh_session, user, pass) != 0) {
+        log_with_timestamp("Error: SSH authentication failed.");
+        ssh_disconnect();
+        return 0;
+    }
+    hist_record_since(&stat_auth, start);
+    libssh2_keepalive_config(ssh_session, 1, SSH_KEEPALIVE_INTERVAL);
+
+    // Remember who we are connected to, so a config change forces a reconnect
+    snprintf(conn_ip, sizeof(conn_ip), "%s", ip);
+    snprintf(conn_port, sizeof(conn_port), "%s", port);
+    snprintf(conn_user, sizeof(conn_user), "%s", user);
+    snprintf(conn_pass, sizeof(conn_pass), "%s", pass);
+    return 1;
 }
 
 /*
- * read_config_value
- * * Parses the "key=value" file generated by the Bash script (router_cli.conf).
- * This allows the C program to know the current IP, User, and Password 
- * without hardcoding them.
+ * ssh_exec
+ * * Runs one command on a new channel of the persistent session and returns its
+ * output (stdout + stderr) in a malloc'd, NUL-terminated buffer that grows as
+ * needed, so long lines are never split. Returns NULL if the channel could
+ * not be used. The caller frees the buffer.
  */
-int read_config_value(const char* filepath, const char* key, char* dest, size_t dest_size) {
-    FILE* fp = fopen(filepath, "r");
-    if (!fp) return 0;
+char* ssh_exec(const char* command, int* exit_status) {
+    if (!ssh_session) return NULL;
 
-    char line[256];
-    int found = 0;
-    size_t key_len = strlen(key);
-    
-    while (fgets(line, sizeof(line), fp)) {
-        // Check if line starts with key and is followed by '='
-        if (strncmp(line, key, key_len) == 0 && line[key_len] == '=') {
-            // Found key="val\n"
-            char* val = line + key_len + 1; // Pointer to the value part
-            val[strcspn(val, "\n")] = 0;    // Trim newline
-            
-            // Safe string copy to destination buffer
-            strncpy(dest, val, dest_size - 1);
-            dest[dest_size - 1] = '\0';
-            found = 1;
-            break;
+    uint64_t start = hist_now_us();
+    LIBSSH2_CHANNEL* channel = libssh2_channel_open_session(ssh_session);
+    if (!channel) return NULL;
+    hist_record_since(&stat_channel_open, start);
+
+    start = hist_now_us();
+    if (libssh2_channel_exec(channel, command) != 0) {
+        libssh2_channel_free(channel);
+        return NULL;
+    }
+    hist_record_since(&stat_exec, start);
+
+    start = hist_now_us();
+    size_t cap = 4096, len = 0;
+    char* out = malloc(cap);
+    if (!out) {
+        libssh2_channel_free(channel);
+        return NULL;
+    }
+
+    int streams[2] = { 0, SSH_EXTENDED_DATA_STDERR };
+    for (int i = 0; i < 2; i++) {
+        ssize_t n;
+        do {
+            if (cap - len < 4096) {
+                char* bigger = realloc(out, cap * 2);
+                if (!bigger) break;
+                out = bigger;
+                cap *= 2;
+            }
+            n = libssh2_channel_read_ex(channel, streams[i], out + len, cap - len - 1);
+            if (n > 0) len += n;
+        } while (n > 0);
+    }
+    out[len] = '\0';
+
+    libssh2_channel_close(channel);
+    libssh2_channel_wait_closed(channel);
+    if (exit_status) *exit_status = libssh2_channel_get_exit_status(channel);
+    libssh2_channel_free(channel);
+    hist_record_since(&stat_read, start);
+    return out;
+}
+
+// Logs a block of remote output line by line with the REMOTE prefix
+void log_remote_output(const char* text) {
+    log_text_lines(text, "REMOTE");
+}
+
+/*
+ * Router Snapshot
+ * * Instead of logging every line of `ip address show` on every refresh, the
+ * output is parsed into these structs. The previous snapshot is kept, and
+ * only the differences between the two are logged. An unchanged router
+ * costs a single log line, and any drift from the last known state (link
+ * flaps, addresses changed behind our back) shows up as an explicit CHANGE.
+ */
+typedef struct {
+    char name[64];
+    int admin_up;             // "UP" flag: interface enabled
+    int link_up;              // "LOWER_UP" flag: carrier present
+    char state[16];           // Kernel operstate (UP, DOWN, UNKNOWN, ...)
+    int mtu;
+    char mac[32];
+    int addr_count;
+    char addrs[MAX_ADDRS][64]; // "inet 192.168.1.1/24", "inet6 fe80::1/64"
+} InterfaceState;
+
+typedef struct {
+    int valid;
+    char hostname[256];
+    int iface_count;
+    InterfaceState ifaces[MAX_IFACES];
+} RouterSnapshot;
+
+RouterSnapshot last_snapshot;     // State after the previous successful refresh
+RouterSnapshot current_snapshot;  // Being filled by the current refresh
+
+// Parses `uci show system.@system[0].hostname` (system.cfg01.hostname='name')
+void parse_hostname(const char* text, RouterSnapshot* snap) {
+    const char* eq = strchr(text, '=');
+    if (!eq) return;
+    const char* val = eq + 1;
+    size_t len = strcspn(val, "\n");
+    if (len >= 2 && val[0] == '\'' && val[len - 1] == '\'') {
+        val++;
+        len -= 2;
+    }
+    if (len >= sizeof(snap->hostname)) len = sizeof(snap->hostname) - 1;
+    memcpy(snap->hostname, val, len);
+    snap->hostname[len] = '\0';
+}
+
+// Returns the value following `key ` on the line (e.g. "mtu 1500" -> "1500")
+int find_field(const char* line, const char* key, char* dest, size_t dest_size) {
+    const char* p = strstr(line, key);
+    if (!p) return 0;
+    p += strlen(key);
+    size_t len = strcspn(p, " \n");
+    if (len >= dest_size) len = dest_size - 1;
+    memcpy(dest, p, len);
+    dest[len] = '\0';
+    return 1;
+}
+
+/*
+ * parse_interfaces
+ * * Parses `ip address show`:
+ *   2: eth0: <BROADCAST,MULTICAST,UP,LOWER_UP> mtu 1500 qdisc ... state UP ...
+ *       link/ether 00:11:22:33:44:55 brd ff:ff:ff:ff:ff:ff
+ *       inet 192.168.1.1/24 brd 192.168.1.255 scope global br-lan
+ */
+void parse_interfaces(const char* text, RouterSnapshot* snap) {
+    InterfaceState* cur = NULL;
+    const char* line = text;
+
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        char buf[512];
+        if (len >= sizeof(buf)) len = sizeof(buf) - 1;  // Only the leading fields matter
+        memcpy(buf, line, len);
+        buf[len] = '\0';
+
+        if (isdigit((unsigned char)buf[0])) {
+            // New interface header: "<index>: <name>[@parent]: <FLAGS> ..."
+            cur = NULL;
+            char* name = strchr(buf, ':');
+            // A truncated header without the ": " separator is skipped, not read past
+            if (name && name[1] == ' ' && snap->iface_count < MAX_IFACES) {
+                cur = &snap->ifaces[snap->iface_count++];
+                memset(cur, 0, sizeof(*cur));
+                name += 2;
+                size_t name_len = strcspn(name, ":@");
+                if (name_len >= sizeof(cur->name)) name_len = sizeof(cur->name) - 1;
+                memcpy(cur->name, name, name_len);
+
+                char* flags = strchr(buf, '<');
+                char* flags_end = flags ? strchr(flags, '>') : NULL;
+                if (flags && flags_end) {
+                    *flags_end = '\0';
+                    cur->admin_up = strstr(flags, ",UP") != NULL || strncmp(flags, "<UP", 3) == 0;
+                    cur->link_up = strstr(flags, "LOWER_UP") != NULL;
+                    *flags_end = '>';
+                }
+
+                char mtu[16];
+                if (find_field(buf, " mtu ", mtu, sizeof(mtu))) cur->mtu = atoi(mtu);
+                if (!find_field(buf, " state ", cur->state, sizeof(cur->state))) {
+                    strcpy(cur->state, "UNKNOWN");
+                }
+            }
+        } else if (cur) {
+            const char* p = buf;
+            while (*p == ' ') p++;
+            if (strncmp(p, "link/", 5) == 0) {
+                const char* mac = strchr(p, ' ');
+                if (mac) {
+                    mac++;
+                    size_t mac_len = strcspn(mac, " ");
+                    if (mac_len >= sizeof(cur->mac)) mac_len = sizeof(cur->mac) - 1;
+                    memcpy(cur->mac, mac, mac_len);
+                    cur->mac[mac_len] = '\0';
+                }
+            } else if ((strncmp(p, "inet ", 5) == 0 || strncmp(p, "inet6 ", 6) == 0) &&
+                       cur->addr_count < MAX_ADDRS) {
+                // Keep "inet <addr>/<prefix>", drop brd/scope/label noise
+                size_t family_len = strcspn(p, " ");
+                const char* addr = p + family_len + 1;
+                size_t addr_len = strcspn(addr, " ");
+                snprintf(cur->addrs[cur->addr_count++], sizeof(cur->addrs[0]), "%.*s %.*s",
+                         (int)family_len, p, (int)addr_len, addr);
+            }
+        }
+
+        if (!end) break;
+        line = end + 1;
+    }
+}
+
+const InterfaceState* find_interface(const RouterSnapshot* snap, const char* name) {
+    for (int i = 0; i < snap->iface_count; i++) {
+        if (strcmp(snap->ifaces[i].name, name) == 0) return &snap->ifaces[i];
+    }
+    return NULL;
+}
+
+int has_address(const InterfaceState* iface, const char* addr) {
+    for (int i = 0; i < iface->addr_count; i++) {
+        if (strcmp(iface->addrs[i], addr) == 0) return 1;
+    }
+    return 0;
+}
+
+void log_interface(const InterfaceState* iface) {
+    log_fmt("STATE: %s admin %s, link %s, state %s, mtu %d, mac %s", iface->name,
+            iface->admin_up ? "up" : "down", iface->link_up ? "up" : "down",
+            iface->state, iface->mtu, iface->mac[0] ? iface->mac : "-");
+    for (int i = 0; i < iface->addr_count; i++) {
+        log_fmt("STATE: %s %s", iface->name, iface->addrs[i]);
+    }
+}
+
+void log_snapshot(const RouterSnapshot* snap) {
+    log_fmt("STATE: hostname %s", snap->hostname);
+    for (int i = 0; i < snap->iface_count; i++) {
+        log_interface(&snap->ifaces[i]);
+    }
+}
+
+/*
+ * diff_snapshots
+ * * Logs one CHANGE line per difference between `old` and `cur` and returns
+ * how many there were.
+ */
+int diff_snapshots(const RouterSnapshot* old, const RouterSnapshot* cur) {
+    int changes = 0;
+
+    if (strcmp(old->hostname, cur->hostname) != 0) {
+        log_fmt("CHANGE: hostname '%s' -> '%s'", old->hostname, cur->hostname);
+        changes++;
+    }
+
+    for (int i = 0; i < old->iface_count; i++) {
+        if (!find_interface(cur, old->ifaces[i].name)) {
+            log_fmt("CHANGE: %s removed", old->ifaces[i].name);
+            changes++;
+        }
+    }
+
+    for (int i = 0; i < cur->iface_count; i++) {
+        const InterfaceState* now = &cur->ifaces[i];
+        const InterfaceState* was = find_interface(old, now->name);
+        if (!was) {
+            log_fmt("CHANGE: %s added", now->name);
+            log_interface(now);
+            changes++;
+            continue;
+        }
+        if (was->admin_up != now->admin_up) {
+            log_fmt("CHANGE: %s admin %s -> %s", now->name,
+                    was->admin_up ? "up" : "down", now->admin_up ? "up" : "down");
+            changes++;
+        }
+        if (was->link_up != now->link_up) {
+            log_fmt("CHANGE: %s link %s -> %s", now->name,
+                    was->link_up ? "up" : "down", now->link_up ? "up" : "down");
+            changes++;
+        }
+        if (was->mtu != now->mtu) {
+            log_fmt("CHANGE: %s mtu %d -> %d", now->name, was->mtu, now->mtu);
+            changes++;
+        }
+        if (strcmp(was->mac, now->mac) != 0) {
+            log_fmt("CHANGE: %s mac %s -> %s", now->name, was->mac, now->mac);
+            changes++;
+        }
+        for (int a = 0; a < was->addr_count; a++) {
+            if (!has_address(now, was->addrs[a])) {
+                log_fmt("CHANGE: %s -%s", now->name, was->addrs[a]);
+                changes++;
+            }
+        }
+        for (int a = 0; a < now->addr_count; a++) {
+            if (!has_address(was, now->addrs[a])) {
+                log_fmt("CHANGE: %s +%s", now->name, now->addrs[a]);
+                changes++;
+            }
         }
     }
-    fclose(fp);
-    return found;
+    return changes;
+}
+
+/*
+ * write_metrics
+ * * Rewrites METRICS_PATH in the Prometheus text format (for node_exporter's
+ * textfile collector or a plain scrape). Written to a temp file and renamed,
+ * so a reader never sees a half-written dump.
+ */
+void write_metrics(void) {
+    const char* tmp_path = METRICS_PATH ".tmp";
+    FILE* f = fopen(tmp_path, "w");
+    if (!f) return;
+    hist_write_prometheus(f, "router_monitor_ssh_latency_seconds",
+                          "Latency of SSH phases and full refreshes against the router.",
+                          all_stats, STAT_COUNT);
+    if (fclose(f) == 0) rename(tmp_path, METRICS_PATH);
+    else unlink(tmp_path);
 }
 
 /*
  * fetch_remote_config
  * * The core logic: Uses SSH to run commands on the router and reads the output.
+ * With `interfaces_only`, the hostname query is skipped and the previous
+ * hostname carried over. Returns the number of changes logged, or -1 if the
+ * router could not be queried.
  */
-void fetch_remote_config() {
-    // Default values (fallback)
-    char ip[64] = "192.168.1.2"; 
-    char port[16] = "22";
-    char user[64] = "root";
-    char pass[64] = "root";
-    
-    // 1. Read the latest credentials from the shared config file
-    //    (The Bash script writes to this file before signaling us)
-    read_config_value("state/router_cli.conf", "router_ip", ip, sizeof(ip));
-    read_config_value("state/router_cli.conf", "router_port", port, sizeof(port));
-    read_config_value("state/router_cli.conf", "username", user, sizeof(user));
-    read_config_value("state/router_cli.conf", "password", pass, sizeof(pass));
-
-    // 2. Construct the SSH command string dynamically
-    //    Using 'sshpass' to handle the password non-interactively.
-    //    Executes two remote commands: `uci show ...hostname` and `ip address show`
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd), 
-             "sshpass -p '%s' ssh -o StrictHostKeyChecking=no -o HostKeyAlgorithms=+ssh-rsa -o PubkeyAcceptedKeyTypes=+ssh-rsa -p %s %s@%s \"echo '--- Remote Hostname ---'; uci show system.@system[0].hostname; echo '--- Remote Interfaces ---'; ip address show\" 2>&1",
-             pass, port, user, ip);
-
-    // 3. popen() executes the shell command and opens a pipe to read its output
-    FILE* fp = popen(cmd, "r");
-    if (!fp) {
-        log_with_timestamp("Error: Failed to execute remote fetch command.");
-        return;
+char* last_interfaces_raw = NULL;  // Last `ip address show` output, served over the control socket
+
+int fetch_remote_config(int log_unchanged, int interfaces_only) {
+    const MonitorConfig* cfg = &router_config;
+    uint64_t start = hist_now_us();
+
+    // 1. Reuse the open session unless the target or credentials changed
+    if (ssh_session && !config_targets_session(cfg)) {
+        log_with_timestamp("Router settings changed. Reconnecting...");
+        ssh_disconnect();
+    }
+    if (!ssh_session && !ssh_connect(cfg->ip, cfg->port, cfg->user, cfg->pass)) {
+        log_with_timestamp("Warning: Remote fetch failed (router unreachable).");
+        return -1;
     }
 
-    // 4. Read the SSH output line by line and print it to our log
-    char line[512];
-    while (fgets(line, sizeof(line), fp)) {
-        line[strcspn(line, "\n")] = 0; // Clean up newline
-        
-        time_t now;
-        time(&now);
-        char buf[20];
-        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-        
-        printf("[%s] [MONITOR] REMOTE: %s\n", buf, line);
+    // 2. Run the queries as channel execs on the same session.
+    //    A failed channel open usually means the router dropped the
+    //    connection since the last refresh: reconnect once and retry.
+    const char* queries[2] = {
+        "uci show system.@system[0].hostname",
+        "ip address show",
+    };
+    memset(&current_snapshot, 0, sizeof(current_snapshot));
+    if (interfaces_only) {
+        strcpy(current_snapshot.hostname, last_snapshot.hostname);
     }
-    
-    // 5. Close the pipe
-    int status = pclose(fp);
-    if (status != 0) {
-        log_with_timestamp("Warning: Remote fetch command finished with errors (or mock mode/network issue).");
+    for (int i = interfaces_only ? 1 : 0; i < 2; i++) {
+        int status = 0;
+        char* out = ssh_exec(queries[i], &status);
+        if (!out) {
+            ssh_disconnect();
+            if (ssh_connect(cfg->ip, cfg->port, cfg->user, cfg->pass)) {
+                out = ssh_exec(queries[i], &status);
+            }
+        }
+        if (!out) {
+            log_with_timestamp("Error: Failed to execute remote fetch command.");
+            return -1;
+        }
+
+        if (status != 0) {
+            // Keep the previous snapshot; a half-read state would show up as bogus changes
+            log_fmt("Warning: '%s' failed (exit %d):", queries[i], status);
+            log_remote_output(out);
+            free(out);
+            return -1;
+        }
+
+        // 3. Parse into the structured snapshot
+        if (i == 0) {
+            parse_hostname(out, &current_snapshot);
+            free(out);
+        } else {
+            parse_interfaces(out, &current_snapshot);
+            free(last_interfaces_raw);
+            last_interfaces_raw = out;
+        }
     }
+    current_snapshot.valid = 1;
+
+    // 4. Log only what changed (or everything, on first run / SIGUSR2)
+    int changes = 0;
+    if (!last_snapshot.valid || full_dump_request) {
+        log_with_timestamp("Full router state:");
+        log_snapshot(&current_snapshot);
+    } else {
+        changes = diff_snapshots(&last_snapshot, &current_snapshot);
+        if (changes == 0 && log_unchanged) {
+            log_with_timestamp("No changes since last refresh.");
+        }
+    }
+    last_snapshot = current_snapshot;
+
+    hist_record_since(&stat_refresh, start);
+    write_metrics();
+    return changes;
 }
 
-// Wrapper function called when update signal is received
-void fetch_router_updates() {
-    log_with_timestamp("Received signal. Fetching REAL updates from router...");
+// Wrapper function called when an update is requested (signal, socket or config change)
+int fetch_router_updates(const char* reason, int interfaces_only) {
+    log_with_timestamp(reason);
     
     // Fetch live data via SSH
-    fetch_remote_config();
+    int changes = fetch_remote_config(1, interfaces_only);
     
-    // Also log the local 'router_cli.conf' content to verify consistency
-    log_with_timestamp("Local State (for comparison):");
-    log_file_content("state/router_cli.conf", "Config");
+    // On a full dump, also log the local state store to verify consistency
+    if (full_dump_request) {
+        log_with_timestamp("Local State (for comparison):");
+        char* text = NULL;
+        size_t len = 0;
+        FILE* out = open_memstream(&text, &len);
+        state_refresh(&state_db, STATE_DB_PATH);
+        if (out && state_db.hdr) state_export(state_db.hdr, out);
+        if (out) fclose(out);
+        if (text) log_text_lines(text, "Config");
+        free(text);
+        full_dump_request = 0;
+    }
     
-    printf("\n"); // Visual Separator in log
+    alog_write("", 0); // Visual Separator in log
+    return changes;
+}
+
+/*
+ * Interface Telemetry
+ * * Every telemetry tick (--telemetry-interval, default 5 s) a single channel
+ * exec reads /proc/net/dev, /proc/net/wireless and the station count of each
+ * radio. Counter deltas become per-second rates, kept per interface in a
+ * ring of TELEMETRY_SAMPLES slots stored as columns (one array per metric),
+ * so reading one metric walks contiguous memory. The store is a fixed array
+ * of MAX_TELEMETRY_IFACES series: memory does not grow with uptime. The
+ * CLIs read it with the TELEMETRY control request.
+ */
+#define DEFAULT_TELEMETRY_INTERVAL 5   // Seconds between counter samples (0 disables them)
+#define TELEMETRY_SAMPLES 720          // Samples kept per interface (1 hour at 5 s)
+#define MAX_TELEMETRY_IFACES 32        // Series kept; a vanished interface's is reused first
+#define TELEMETRY_RETRY_TICKS 12       // Ticks to wait after a failed connect
+
+#define TELEMETRY_COMMAND \
+    "cat /proc/net/dev; echo '#wireless'; cat /proc/net/wireless 2>/dev/null; echo '#stations'; " \
+    "for d in /sys/class/net/*/phy80211; do [ -e \"$d\" ] || continue; i=${d%/phy80211}; i=${i##*/}; " \
+    "echo \"$i $(iw dev \"$i\" station dump 2>/dev/null | grep -c '^Station')\"; done"
+
+#define SIGNAL_NONE INT8_MIN           // Interface has no /proc/net/wireless entry
+
+typedef struct {
+    char name[32];
+    uint64_t seen_us;              // Tick that last listed the interface
+
+    // Counters of the previous tick; rates need two in a row
+    int primed;
+    uint64_t last_us;
+    uint64_t rx_bytes, tx_bytes, rx_packets, tx_packets, errors;
+
+    // Ring of samples: `head` is the next slot written, `count` the valid ones
+    uint32_t head, count;
+    uint32_t time[TELEMETRY_SAMPLES];        // Unix time of the sample
+    uint32_t rx_bytes_ps[TELEMETRY_SAMPLES];
+    uint32_t tx_bytes_ps[TELEMETRY_SAMPLES];
+    uint32_t rx_packets_ps[TELEMETRY_SAMPLES];
+    uint32_t tx_packets_ps[TELEMETRY_SAMPLES];
+    uint32_t error_count[TELEMETRY_SAMPLES]; // Errors + drops during the interval
+    int8_t signal[TELEMETRY_SAMPLES];        // dBm, or SIGNAL_NONE
+    uint8_t stations[TELEMETRY_SAMPLES];     // Associated stations (radios only)
+} IfaceSeries;
+
+IfaceSeries telemetry[MAX_TELEMETRY_IFACES];
+int telemetry_interval = DEFAULT_TELEMETRY_INTERVAL;
+int telemetry_skip_ticks = 0;   // Back-off after a failed connect
+
+// One interface's counters from a tick
+typedef struct {
+    char name[32];
+    uint64_t rx_bytes, tx_bytes, rx_packets, tx_packets, errors;
+    int signal;
+    int stations;
+} IfaceCounters;
+
+// Series for `name`: the existing one, a free slot, or the one whose
+// interface has been gone longest. NULL if all are live this tick.
+IfaceSeries* telemetry_series(const char* name, uint64_t now_us) {
+    IfaceSeries* oldest = NULL;
+    for (int i = 0; i < MAX_TELEMETRY_IFACES; i++) {
+        IfaceSeries* s = &telemetry[i];
+        if (strcmp(s->name, name) == 0) return s;
+        if (!oldest || s->seen_us < oldest->seen_us) oldest = s;
+    }
+    if (oldest->seen_us == now_us) return NULL;
+    memset(oldest, 0, sizeof(*oldest));
+    snprintf(oldest->name, sizeof(oldest->name), "%s", name);
+    return oldest;
 }
 
-int main() {
-    printf("[MONITOR] Starting router monitor (PID: %d)...\n", getpid());
+// Increase of a kernel counter since the previous tick. Counters are 32 bits
+// on 32-bit routers and wrap; any other decrease is a reset (reboot, driver
+// reload) and sets *reset.
+uint64_t counter_delta(uint64_t prev, uint64_t cur, int* reset) {
+    if (cur >= prev) return cur - prev;
+    if (prev <= UINT32_MAX && prev > UINT32_MAX / 4 * 3) return cur + ((uint64_t)1 << 32) - prev;
+    *reset = 1;
+    return 0;
+}
+
+uint32_t per_second(uint64_t delta, uint64_t elapsed_us) {
+    uint64_t rate = delta * 1000000u / elapsed_us;
+    return rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+}
+
+void telemetry_record(IfaceSeries* s, const IfaceCounters* c, uint64_t now_us, uint32_t now) {
+    int reset = 0;
+    uint64_t elapsed = now_us - s->last_us;
+    uint64_t rx = counter_delta(s->rx_bytes, c->rx_bytes, &reset);
+    uint64_t tx = counter_delta(s->tx_bytes, c->tx_bytes, &reset);
+    uint64_t rx_pk = counter_delta(s->rx_packets, c->rx_packets, &reset);
+    uint64_t tx_pk = counter_delta(s->tx_packets, c->tx_packets, &reset);
+    uint64_t err = counter_delta(s->errors, c->errors, &reset);
+
+    if (s->primed && !reset && elapsed > 0) {
+        uint32_t slot = s->head;
+        s->time[slot] = now;
+        s->rx_bytes_ps[slot] = per_second(rx, elapsed);
+        s->tx_bytes_ps[slot] = per_second(tx, elapsed);
+        s->rx_packets_ps[slot] = per_second(rx_pk, elapsed);
+        s->tx_packets_ps[slot] = per_second(tx_pk, elapsed);
+        s->error_count[slot] = err > UINT32_MAX ? UINT32_MAX : (uint32_t)err;
+        s->signal[slot] = c->signal;
+        s->stations[slot] = c->stations > 255 ? 255 : (uint8_t)c->stations;
+        s->head = (slot + 1) % TELEMETRY_SAMPLES;
+        if (s->count < TELEMETRY_SAMPLES) s->count++;
+    }
+    s->primed = 1;
+    s->last_us = now_us;
+    s->rx_bytes = c->rx_bytes;
+    s->tx_bytes = c->tx_bytes;
+    s->rx_packets = c->rx_packets;
+    s->tx_packets = c->tx_packets;
+    s->errors = c->errors;
+}
+
+// Returns the counters entry for `name`, or NULL
+IfaceCounters* find_counters(IfaceCounters* list, int count, const char* name, size_t name_len) {
+    for (int i = 0; i < count; i++) {
+        if (strlen(list[i].name) == name_len && strncmp(list[i].name, name, name_len) == 0) return &list[i];
+    }
+    return NULL;
+}
+
+/*
+ * parse_telemetry
+ * * Parses the output of TELEMETRY_COMMAND into `out` (at most `max`):
+ *   /proc/net/dev    "  eth0: <rx bytes> <packets> <errs> <drop> ... <tx bytes> <packets> <errs> <drop> ..."
+ *   #wireless        " wlan0: 0000   70.  -40.  -256 ..."   (status, link, level, noise)
+ *   #stations        "wlan0 3"
+ * Returns the number of interfaces.
+ */
+int parse_telemetry(const char* text, IfaceCounters* out, int max) {
+    enum { NET_DEV, WIRELESS, STATIONS } section = NET_DEV;
+    int count = 0;
+
+    for (const char* line = text; *line; ) {
+        size_t line_len = strcspn(line, "\n");
+        const char* end = line + line_len;
+        const char* next = *end ? end + 1 : end;
+
+        if (strncmp(line, "#wireless", 9) == 0) section = WIRELESS;
+        else if (strncmp(line, "#stations", 9) == 0) section = STATIONS;
+
+        size_t skip = 0;
+        while (skip < line_len && line[skip] == ' ') skip++;
+        const char* name = line + skip;
+        size_t len = line_len - skip;
+        const char* colon = memchr(name, ':', len);
+        const char* bar = memchr(line, '|', line_len);
+
+        if (section == STATIONS) {
+            size_t name_len = strcspn(name, " \n");
+            IfaceCounters* c = find_counters(out, count, name, name_len);
+            if (c && name + name_len < end) c->stations = atoi(name + name_len);
+        } else if (colon && !bar) {
+            size_t name_len = colon - name;
+            char* p = (char*)colon + 1;
+            if (section == NET_DEV && count < max && name_len < sizeof(out->name)) {
+                uint64_t f[16];
+                int n = 0;
+                while (n < 16) {
+                    char* after;
+                    f[n] = strtoull(p, &after, 10);
+                    if (after == p || after > end) break;
+                    p = after;
+                    n++;
+                }
+                if (n == 16) {
+                    IfaceCounters* c = &out[count++];
+                    memcpy(c->name, name, name_len);
+                    c->name[name_len] = '\0';
+                    c->rx_bytes = f[0];
+                    c->rx_packets = f[1];
+                    c->errors = f[2] + f[3] + f[10] + f[11];
+                    c->tx_bytes = f[8];
+                    c->tx_packets = f[9];
+                    c->signal = SIGNAL_NONE;
+                    c->stations = 0;
+                }
+            } else if (section == WIRELESS) {
+                IfaceCounters* c = find_counters(out, count, name, name_len);
+                strtoul(p, &p, 16);                 // Status
+                strtod(p, &p);                      // Link quality
+                double level = strtod(p, NULL);
+                if (level > 63) level -= 256;       // Old drivers report dBm + 256
+                if (c && level > -128 && level < 0) c->signal = (int)level;
+            }
+        }
+        line = next;
+    }
+    return count;
+}
+
+void telemetry_tick(void) {
+    const MonitorConfig* cfg = &router_config;
+    if (telemetry_skip_ticks > 0) {
+        telemetry_skip_ticks--;
+        return;
+    }
+    if (ssh_session && !config_targets_session(cfg)) ssh_disconnect();
+    if (!ssh_session && !ssh_connect(cfg->ip, cfg->port, cfg->user, cfg->pass)) {
+        telemetry_skip_ticks = TELEMETRY_RETRY_TICKS;
+        return;
+    }
+
+    uint64_t start = hist_now_us();
+    int status = 0;
+    char* out = ssh_exec(TELEMETRY_COMMAND, &status);
+    if (!out) {
+        ssh_disconnect();   // Reconnected on the next tick
+        return;
+    }
+    uint64_t now_us = hist_now_us();
+    uint32_t now = (uint32_t)time(NULL);
+
+    IfaceCounters counters[MAX_TELEMETRY_IFACES];
+    int count = parse_telemetry(out, counters, MAX_TELEMETRY_IFACES);
+    free(out);
+    if (count == 0) return;
+
+    for (int i = 0; i < count; i++) {
+        IfaceSeries* s = telemetry_series(counters[i].name, now_us);
+        if (!s) continue;
+        s->seen_us = now_us;
+        telemetry_record(s, &counters[i], now_us, now);
+    }
+    // An interface that comes back starts over instead of spanning the gap
+    for (int i = 0; i < MAX_TELEMETRY_IFACES; i++) {
+        if (telemetry[i].seen_us != now_us) telemetry[i].primed = 0;
+    }
+    hist_record_since(&stat_telemetry, start);
+}
+
+/*
+ * Event Loop
+ * * Every input the monitor reacts to is a file descriptor registered with
+ * epoll, paired with a handler. Adding a new event source later (a socket,
+ * another timer) means one more EventSource and one loop_add() call.
+ */
+typedef struct EventSource {
+    int fd;
+    void (*handler)(struct EventSource* src);
+} EventSource;
+
+int epoll_fd = -1;
+int poll_interval = DEFAULT_POLL_INTERVAL;
+
+EventSource signal_source;     // SIGUSR1 / SIGUSR2 / SIGTERM / SIGINT
+EventSource keepalive_source;  // Periodic SSH keepalive
+EventSource poll_source;       // Periodic health poll
+EventSource inotify_source;    // Changes in state/
+EventSource debounce_source;   // Settles bursts of config file writes
+EventSource control_source;    // Control socket (monitor_ctl.h)
+EventSource telemetry_source;  // Interface counter samples
+
+int loop_add(EventSource* src, int fd, void (*handler)(EventSource*)) {
+    src->fd = fd;
+    src->handler = handler;
+    if (fd < 0) return 0;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = src;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// Arms a timerfd: first expiry after `initial_ms`, then every `interval_ms` (0 = one-shot)
+void timer_arm(int fd, long initial_ms, long interval_ms) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = initial_ms / 1000;
+    spec.it_value.tv_nsec = (initial_ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(fd, 0, &spec, NULL);
+}
+
+// Consumes a timer expiration so the fd stops being readable
+void timer_ack(int fd) {
+    uint64_t expirations;
+    ssize_t n = read(fd, &expirations, sizeof(expirations));
+    (void)n;
+}
+
+void on_signal(EventSource* src) {
+    struct signalfd_siginfo info;
+    while (read(src->fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGUSR1:
+                fetch_router_updates("Received signal. Fetching REAL updates from router...", 0);
+                break;
+            case SIGUSR2:
+                full_dump_request = 1;
+                fetch_router_updates("Received full dump request. Fetching router state...", 0);
+                break;
+            case SIGTERM:
+            case SIGINT:
+                stop_request = 1;
+                break;
+        }
+    }
+}
+
+void on_keepalive(EventSource* src) {
+    timer_ack(src->fd);
+    // Keeps the idle session usable and drops a dead one before the next
+    // refresh needs it
+    if (ssh_session) {
+        int next = 0;
+        if (libssh2_keepalive_send(ssh_session, &next) != 0) {
+            ssh_disconnect();
+        }
+    }
+}
+
+void on_poll(EventSource* src) {
+    timer_ack(src->fd);
+    // Quiet unless something drifted: only CHANGE lines reach the log
+    fetch_remote_config(0, 0);
+}
+
+void on_telemetry(EventSource* src) {
+    timer_ack(src->fd);
+    telemetry_tick();
+}
+
+void on_inotify(EventSource* src) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int touched = 0;
+
+    while ((len = read(src->fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + len; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->len && strcmp(ev->name, STATE_DB_FILE) == 0) touched = 1;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    // Wait for the write burst to settle before re-reading the file
+    if (touched) timer_arm(debounce_source.fd, CONFIG_DEBOUNCE_MS, 0);
+}
+
+// Applies new settings from the state store or a CONFIG request
+void config_updated(const MonitorConfig* cfg) {
+    if (cfg->poll_interval >= 0 && cfg->poll_interval != poll_interval) {
+        poll_interval = cfg->poll_interval;
+        timer_arm(poll_source.fd, poll_interval * 1000L, poll_interval * 1000L);
+        log_fmt("Health poll interval set to %d s.", poll_interval);
+    }
+    router_config = *cfg;
+
+    // Only refresh if the connection settings changed; a hostname edit
+    // alone is picked up by the next signal or poll
+    if (ssh_session && !config_targets_session(&router_config)) {
+        fetch_router_updates("Router settings changed. Fetching updates from new target...", 0);
+    }
+}
+
+void on_config_changed(EventSource* src) {
+    timer_ack(src->fd);
+
+    MonitorConfig cfg = router_config;
+    if (load_config(&cfg)) {
+        config_updated(&cfg);
+    }
+}
+
+/*
+ * Control Socket
+ * * The CLIs send typed requests here instead of SIGUSR1 (see monitor_ctl.h).
+ * Requests are answered synchronously: a refresh takes one SSH round trip
+ * on the warm session, and the client is the one waiting for it.
+ */
+void reply_ok(int fd, const char* payload, size_t len) {
+    char header[32];
+    int n = snprintf(header, sizeof(header), "OK %zu\n", len);
+    if (write(fd, header, n) == n && len) {
+        ssize_t w = write(fd, payload, len);
+        (void)w;
+    }
+}
+
+void reply_err(int fd, const char* msg) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "ERR %s\n", msg);
+    ssize_t w = write(fd, line, n);
+    (void)w;
+}
+
+void reply_snapshot(int fd, const RouterSnapshot* snap) {
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    if (!out) {
+        reply_err(fd, "out of memory");
+        return;
+    }
+    fprintf(out, "STATE: hostname %s\n", snap->hostname);
+    for (int i = 0; i < snap->iface_count; i++) {
+        const InterfaceState* iface = &snap->ifaces[i];
+        fprintf(out, "STATE: %s admin %s, link %s, state %s, mtu %d, mac %s\n", iface->name,
+                iface->admin_up ? "up" : "down", iface->link_up ? "up" : "down",
+                iface->state, iface->mtu, iface->mac[0] ? iface->mac : "-");
+        for (int a = 0; a < iface->addr_count; a++) {
+            fprintf(out, "STATE: %s %s\n", iface->name, iface->addrs[a]);
+        }
+    }
+    fclose(out);
+    reply_ok(fd, buf, len);
+    free(buf);
+}
+
+void reply_stats(int fd) {
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    if (!out) {
+        reply_err(fd, "out of memory");
+        return;
+    }
+    hist_write_table(out, all_stats, STAT_COUNT);
+    fclose(out);
+    reply_ok(fd, buf, len);
+    free(buf);
+}
+
+// TELEMETRY reply: per interface an "iface <name> <count>" line, then one
+// line per sample, oldest first:
+//   <unix time> <rx B/s> <tx B/s> <rx pkt/s> <tx pkt/s> <errors> <signal dBm|-> <stations|->
+void reply_telemetry(int fd, char* args) {
+    uint32_t max_samples = TELEMETRY_SAMPLES;
+    const char* only = NULL;
+    for (char* pair = strtok(args, " "); pair; pair = strtok(NULL, " ")) {
+        if (strncmp(pair, "samples=", 8) == 0) max_samples = (uint32_t)strtoul(pair + 8, NULL, 10);
+        else if (strncmp(pair, "iface=", 6) == 0) only = pair + 6;
+        else {
+            reply_err(fd, "bad TELEMETRY field");
+            return;
+        }
+    }
+
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    if (!out) {
+        reply_err(fd, "out of memory");
+        return;
+    }
+    fprintf(out, "interval %d\n", telemetry_interval);
+    for (int i = 0; i < MAX_TELEMETRY_IFACES; i++) {
+        const IfaceSeries* s = &telemetry[i];
+        if (!s->name[0] || (only && strcmp(s->name, only) != 0)) continue;
+        uint32_t n = s->count < max_samples ? s->count : max_samples;
+        fprintf(out, "iface %s %u\n", s->name, n);
+        uint32_t slot = (s->head + TELEMETRY_SAMPLES - n) % TELEMETRY_SAMPLES;
+        for (uint32_t k = 0; k < n; k++, slot = (slot + 1) % TELEMETRY_SAMPLES) {
+            fprintf(out, "%u %u %u %u %u %u ", s->time[slot], s->rx_bytes_ps[slot], s->tx_bytes_ps[slot],
+                    s->rx_packets_ps[slot], s->tx_packets_ps[slot], s->error_count[slot]);
+            if (s->signal[slot] == SIGNAL_NONE) fputs("- -\n", out);
+            else fprintf(out, "%d %u\n", s->signal[slot], s->stations[slot]);
+        }
+    }
+    fclose(out);
+    reply_ok(fd, buf, len);
+    free(buf);
+}
+
+void handle_control_request(int fd, char* request) {
+    char* args = strchr(request, ' ');
+    if (args) *args++ = '\0';
+    else args = request + strlen(request);
+
+    if (strcmp(request, MONITOR_REQ_REFRESH) == 0 ||
+        strcmp(request, MONITOR_REQ_REFRESH_INTERFACES) == 0) {
+        int interfaces_only = strcmp(request, MONITOR_REQ_REFRESH_INTERFACES) == 0;
+        int changes = fetch_router_updates("Received refresh request. Fetching updates from router...",
+                                           interfaces_only);
+        if (changes < 0) {
+            reply_err(fd, "router unreachable");
+        } else {
+            char payload[32];
+            int n = snprintf(payload, sizeof(payload), "changes=%d\n", changes);
+            reply_ok(fd, payload, n);
+        }
+    } else if (strcmp(request, MONITOR_REQ_CONFIG) == 0) {
+        // CONFIG key=value key=value ... (values percent-encoded)
+        MonitorConfig cfg = router_config;
+        for (char* pair = strtok(args, " "); pair; pair = strtok(NULL, " ")) {
+            char* eq = strchr(pair, '=');
+            if (!eq || !monitor_decode_value(eq + 1) || !apply_config_pair(&cfg, pair, eq - pair, eq + 1)) {
+                reply_err(fd, "bad CONFIG field");
+                return;
+            }
+        }
+        reply_ok(fd, NULL, 0);
+        config_updated(&cfg);
+    } else if (strcmp(request, MONITOR_REQ_INTERFACES) == 0) {
+        if (!last_interfaces_raw && fetch_remote_config(1, 1) < 0) {
+            reply_err(fd, "router unreachable");
+            return;
+        }
+        reply_ok(fd, last_interfaces_raw, strlen(last_interfaces_raw));
+    } else if (strcmp(request, MONITOR_REQ_SNAPSHOT) == 0) {
+        if (!last_snapshot.valid && fetch_remote_config(1, 0) < 0) {
+            reply_err(fd, "router unreachable");
+            return;
+        }
+        reply_snapshot(fd, &last_snapshot);
+    } else if (strcmp(request, MONITOR_REQ_STATS) == 0) {
+        reply_stats(fd);
+    } else if (strcmp(request, MONITOR_REQ_TELEMETRY) == 0) {
+        reply_telemetry(fd, args);
+    } else {
+        reply_err(fd, "unknown request");
+    }
+}
+
+void on_control(EventSource* src) {
+    int client;
+    while ((client = accept4(src->fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        // Clients send their request right after connecting; don't let a
+        // stuck one hold up the loop
+        struct timeval tv = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        char request[1024];
+        size_t len = 0;
+        ssize_t n;
+        while (len < sizeof(request) - 1 &&
+               (n = read(client, request + len, sizeof(request) - 1 - len)) > 0) {
+            len += n;
+            if (memchr(request, '\n', len)) break;
+        }
+        request[len] = '\0';
+        request[strcspn(request, "\r\n")] = '\0';
+
+        if (request[0]) handle_control_request(client, request);
+        close(client);
+    }
+}
+
+int control_listen(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, MONITOR_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    unlink(MONITOR_SOCKET_PATH);  // Left over from a monitor that did not shut down cleanly
+
+    // CONFIG carries the router password: the socket is created 0600, so
+    // it is never reachable by others, not even between bind and a chmod
+    mode_t old_umask = umask(077);
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_umask);
+    if (rc != 0 || listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Client mode: ./router_monitor --ctl VERB [args...]
+int run_control_client(int argc, char** argv) {
+    char request[1024] = "";
+    for (int i = 0; i < argc; i++) {
+        if (i) strncat(request, " ", sizeof(request) - strlen(request) - 1);
+        strncat(request, argv[i], sizeof(request) - strlen(request) - 1);
+    }
+
+    char* reply;
+    size_t len;
+    int status = monitor_request(request, &reply, &len);
+    if (status < 0) {
+        fprintf(stderr, "%% Monitor not running (no %s)\n", MONITOR_SOCKET_PATH);
+        return 2;
+    }
+    if (status == 0) fwrite(reply, 1, len, stdout);
+    else fprintf(stderr, "%% Monitor: %s\n", reply);
+    free(reply);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2 && strcmp(argv[1], "--ctl") == 0) {
+        return run_control_client(argc - 2, argv + 2);
+    }
+
+    // Until the logger thread starts (after the signals are blocked, so it
+    // inherits the mask), lines are written directly to stdout
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    snprintf(alog_state.source, sizeof(alog_state.source), "%s", LOG_SOURCE);
+    libssh2_init(0);
+
+    const char* log_path = NULL;
+    int log_binary = 0;
+
+    load_config(&router_config);
+    if (router_config.poll_interval >= 0) {
+        poll_interval = router_config.poll_interval;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--poll-interval") == 0 && i + 1 < argc) {
+            poll_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--telemetry-interval") == 0 && i + 1 < argc) {
+            telemetry_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "--log-binary") == 0) {
+            log_binary = 1;
+        }
+    }
+    if (poll_interval < 0) poll_interval = 0;
+    if (telemetry_interval < 0) telemetry_interval = 0;
 
     // --- 1. Signal Registration ---
-    
-    // Register handler for SIGUSR1 (The "Update Now" signal)
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = handle_sigusr1;
-    sigaction(SIGUSR1, &sa, NULL);
-
-    // Register handler for SIGTERM/SIGINT (Graceful Shutdown)
-    struct sigaction sa_term;
-    memset(&sa_term, 0, sizeof(sa_term));
-    sa_term.sa_handler = handle_sigterm;
-    sigaction(SIGTERM, &sa_term, NULL);
-    sigaction(SIGINT, &sa_term, NULL);
-
-    // --- 2. Main Event Loop ---
+    // Block the signals and receive them through a signalfd instead. A signal
+    // that arrives while a refresh is running simply waits in the fd, so
+    // there is no window between "check flag" and "sleep" to lose it in.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);  // "Update Now"
+    sigaddset(&mask, SIGUSR2);  // "Log everything"
+    sigaddset(&mask, SIGTERM);  // Graceful shutdown
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    if (alog_open(log_path, LOG_SOURCE, log_binary, LOG_ROTATE_BYTES, LOG_KEEP) != 0) {
+        perror("[MONITOR] log");
+        return 1;
+    }
+    log_fmt("Starting router monitor (PID: %d)...", getpid());
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("[MONITOR] epoll_create1");
+        return 1;
+    }
+    loop_add(&signal_source, signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC), on_signal);
+
+    // --- 2. Timers ---
+    loop_add(&keepalive_source, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_keepalive);
+    timer_arm(keepalive_source.fd, SSH_KEEPALIVE_INTERVAL * 1000L, SSH_KEEPALIVE_INTERVAL * 1000L);
+
+    loop_add(&poll_source, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_poll);
+    timer_arm(poll_source.fd, poll_interval * 1000L, poll_interval * 1000L);
+
+    loop_add(&telemetry_source, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_telemetry);
+    timer_arm(telemetry_source.fd, telemetry_interval * 1000L, telemetry_interval * 1000L);
+
+    // --- 3. Config File Watch ---
+    // Every store commit renames a new file over state.db, which would orphan
+    // a watch on the file itself, so watch the directory and filter by name.
+    int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd >= 0 && inotify_add_watch(ifd, STATE_DIR, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        log_with_timestamp("Warning: Cannot watch " STATE_DIR "/ for config changes.");
+    }
+    loop_add(&inotify_source, ifd, on_inotify);
+    loop_add(&debounce_source, timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), on_config_changed);
+
+    // --- 4. Control Socket ---
+    if (!loop_add(&control_source, control_listen(), on_control)) {
+        log_with_timestamp("Warning: Control socket unavailable; only signals will trigger updates.");
+    }
+
+    // --- 5. Main Event Loop ---
     while (!stop_request) {
-        
-        // Check if the signal handler set the flag
-        if (update_request) {
-            update_request = 0; // Reset flag
-            fetch_router_updates();
+        struct epoll_event events[8];
+        int n = epoll_wait(epoll_fd, events, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("[MONITOR] epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n && !stop_request; i++) {
+            EventSource* src = events[i].data.ptr;
+            src->handler(src);
         }
-        
-        // Sleep for 10 seconds to act as a background heartbeat.
-        // KEY BEHAVIOR: sleep() is interrupted by signals!
-        // If SIGUSR1 arrives at second 2, sleep wakes up immediately,
-        // the loop restarts, catches 'if (update_request)', and runs instantly.
-        sleep(10);
     }
 
-    printf("[MONITOR] Shutting down...\n");
+    log_with_timestamp("Shutting down...");
+    if (control_source.fd >= 0) {
+        close(control_source.fd);
+        unlink(MONITOR_SOCKET_PATH);
+    }
+    ssh_disconnect();
+    libssh2_exit();
+    if (alog_dropped()) log_fmt("%llu log line(s) were dropped (logger ring full)", (unsigned long long)alog_dropped());
+    alog_close();
     return 0;
 }
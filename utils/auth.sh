@@ -1,7 +1,7 @@
 #!/bin/bash
 
-plain=$(grep enable_password state/router.conf | cut -d= -f2)
-hash=$(grep enable_secret_hash state/router.conf | cut -d= -f2)
+plain=$(get_setting enable_password)
+hash=$(get_setting enable_secret_hash)
 
 # No password or secret set → allow enable without prompt
 if [[ -z "$plain" && -z "$hash" ]]; then
@@ -1,5 +1,8 @@
 LOG_FILE="state/router.log"
 
+# printf's %(...)T formats the time inside bash (4.2+): no `date` fork per line
 log() {
-  echo "$(date '+%Y-%m-%d %H:%M:%S') - $1" >> "$LOG_FILE"
+  local ts
+  printf -v ts '%(%Y-%m-%d %H:%M:%S)T' -1
+  printf '%s - %s\n' "$ts" "$1" >> "$LOG_FILE"
 }
@@ -1,6 +1,6 @@
 
 get_hostname() {
-  grep hostname state/router.conf | cut -d= -f2
+  get_setting hostname
 }
 
 print_prompt() {
@@ -1,28 +1,53 @@
+# Local state helpers. The state lives in the binary store state/state.db
+# (c_helpers/state_store.h); state_tool commits each change atomically.
+STATE_TOOL="${STATE_TOOL:-./c_helpers/state_tool}"
+STATE_DB="${STATE_DB:-state/state.db}"
+
+get_setting() {
+  "$STATE_TOOL" -f "$STATE_DB" get "$1" 2>/dev/null
+}
+
+# The text dump as the old files looked: config, "!", interfaces, "!", routes.
+# The router login the C CLIs keep in the store is left out.
+show_running_config() {
+  "$STATE_TOOL" -f "$STATE_DB" export |
+    awk '/^#/ || $0 == "[config]" { next } /^\[/ { print "!"; next } !/^password=/'
+}
+
+show_routes() {
+  "$STATE_TOOL" -f "$STATE_DB" export | awk '/^\[/ { on = ($0 == "[routes]"); next } on'
+}
+
 set_hostname() {
-  sed -i "s/^hostname=.*/hostname=$1/" state/router.conf
+  "$STATE_TOOL" -f "$STATE_DB" set hostname "$1"
 }
 
 set_enable_password() {
-  sed -i "s/^enable_password=.*/enable_password=$1/" state/router.conf
+  "$STATE_TOOL" -f "$STATE_DB" set enable_password "$1"
 }
 
 set_enable_secret() {
   hash=$(echo -n "$1" | sha256sum | cut -d' ' -f1)
-  sed -i "s/^enable_secret_hash=.*/enable_secret_hash=$hash/" state/router.conf
+  "$STATE_TOOL" -f "$STATE_DB" set enable_secret_hash "$hash"
 }
 
 add_interface() {
-  grep -q "^$1," state/interfaces.conf || echo "$1,,," >> state/interfaces.conf
+  "$STATE_TOOL" -f "$STATE_DB" iface "$1"
 }
 
 set_interface_ip() {
-  sed -i "/^$1,/c\\$1,$2,$3,up" state/interfaces.conf
+  "$STATE_TOOL" -f "$STATE_DB" iface "$1" "$2" "$3" up
 }
 
+# set_interface_status <name> <ip> <mask> <up|down>; ip and mask may be empty
 set_interface_status() {
-  sed -i "/^$1,/c\\$1,$2,$3,$4" state/interfaces.conf
+  if [ -n "$2" ]; then
+    "$STATE_TOOL" -f "$STATE_DB" iface "$1" "$2" "$3" "$4"
+  else
+    "$STATE_TOOL" -f "$STATE_DB" iface "$1" "$4"
+  fi
 }
 
 add_route() {
-  echo "$1,$2,$3" >> state/routes.conf
+  "$STATE_TOOL" -f "$STATE_DB" route add "$1" "$2" "$3"
 }